@@ -0,0 +1,55 @@
+#include "Harriet.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Utility.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file license.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// every evaluation of the tree allocates and frees a value per node
+void evaluateLoop(uint64_t iterations)
+{
+   harriet::Environment environment;
+   environment.add("a", harriet::make_unique<harriet::IntegerValue>(7));
+   environment.add("b", harriet::make_unique<harriet::FloatValue>(2.5f));
+   auto expression = harriet::parse("(a*3+b)/(b-1.5) + (a%4)*(a-b) - cast<float>(a*a)", environment);
+   float sum = 0;
+   for(uint64_t i=0; i<iterations; i++)
+      sum += reinterpret_cast<harriet::FloatValue&>(*expression->evaluate(environment)).result;
+   if(sum == 42) // keep the loop alive
+      cout << "";
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+   // usage: ./benchmark [iterations per thread] [max threads]
+   uint64_t iterations = argc>1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+   uint32_t maxThreads = argc>2 ? strtoul(argv[2], nullptr, 10) : max(1u, thread::hardware_concurrency());
+
+   // each thread does the same amount of work => the time should stay constant as long as there are free cores
+   cout << "threads  time[ms]  evaluations/s" << endl;
+   for(uint32_t threadCount=1; threadCount<=maxThreads; threadCount*=2) {
+      auto begin = chrono::steady_clock::now();
+      vector<thread> threads;
+      for(uint32_t i=0; i<threadCount; i++)
+         threads.push_back(thread(evaluateLoop, iterations));
+      for(auto& iter : threads)
+         iter.join();
+      double ms = chrono::duration<double, milli>(chrono::steady_clock::now()-begin).count();
+      cout << threadCount << "  " << ms << "  " << static_cast<uint64_t>(threadCount*iterations/ms*1000) << endl;
+   }
+   return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,119 @@
+#include "Harriet.hpp"
+#include "CppGenerator.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include "Utility.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file license.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+// Compiles formulas ahead of time into a c++ header with one inline function per formula. The input has one declaration per line:
+//    variable <type> <name>                       a variable the formulas can read, a parameter of each formula reading it
+//    function <result type> <name> <argument types>   a c++ function defined elsewhere, it is only declared by the output
+//    formula <name> <expression>                  the expression is parsed like harriet::parse does (type inference, casts, folding)
+// Empty lines and lines starting with # are ignored. Names are used as c++ identifiers, so they have to be unique and may not be c++ keywords
+// (see CppGenerator::checkIdentifier).
+//---------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+   // check arguments
+   if(argc!=2 && argc!=3) {
+      cout << "usage: ./harrietc formulas.txt [namespace] > formulas.hpp" << endl;
+      return 0;
+   }
+   ifstream input(argv[1]);
+   if(!input) {
+      cerr << "unable to open '" << argv[1] << "'" << endl;
+      return 1;
+   }
+   string nameSpace = argc==3 ? argv[2] : "formulas";
+   try {
+      harriet::CppGenerator::checkIdentifier(nameSpace);
+   } catch(harriet::Exception& e) {
+      cerr << "namespace: " << e.what() << endl;
+      return 1;
+   }
+
+   harriet::Environment environment;
+   vector<string> variables;
+   unordered_set<string> names; // of variables, functions and formulas
+   ostringstream declarations;
+   ostringstream functions;
+   string line;
+   for(uint32_t lineNumber=1; getline(input, line); lineNumber++) {
+      istringstream stream(line);
+      string kind, name;
+      stream >> kind;
+      if(kind.empty() || kind[0]=='#')
+         continue;
+
+      try {
+         auto declare = [&names](const string& name) {
+            harriet::CppGenerator::checkIdentifier(name);
+            if(!names.insert(name).second)
+               throw harriet::Exception{"'" + name + "' is already declared"};
+         };
+         if(kind == "variable") {
+            string type;
+            stream >> type >> name;
+            declare(name);
+            environment.add(name, harriet::createDefaultValue(harriet::nameToType(type)));
+            variables.push_back(name);
+         } else if(kind == "function") {
+            // only declared => not pure, calls are neither folded nor shared
+            string type;
+            stream >> type >> name;
+            declare(name);
+            auto resultType = harriet::nameToType(type);
+            vector<harriet::VariableType> argumentTypes;
+            while(stream >> type)
+               argumentTypes.push_back(harriet::nameToType(type));
+            declarations << harriet::CppGenerator::typeName(resultType) << " " << name << "(";
+            for(uint32_t i=0; i<argumentTypes.size(); i++)
+               declarations << (i==0 ? "" : ", ") << harriet::CppGenerator::typeName(argumentTypes[i]);
+            declarations << ");\n";
+            auto body = [name](vector<unique_ptr<harriet::Value>>&, harriet::Environment&) -> unique_ptr<harriet::Value> {throw harriet::Exception{"function '" + name + "' is only declared"};};
+            environment.addFunction(harriet::make_unique<harriet::Function>(name, lineNumber, body, argumentTypes, resultType));
+         } else if(kind == "formula") {
+            stream >> name;
+            declare(name);
+            string expression;
+            getline(stream, expression);
+            auto tree = harriet::parse(expression, environment);
+            functions << "//---------------------------------------------------------------------------\n";
+            functions << "///" << expression << "\n";
+            functions << harriet::CppGenerator::generateFunction(name, *tree, environment, variables);
+         } else {
+            throw harriet::Exception{"unknown declaration '" + kind + "'"};
+         }
+      } catch(harriet::Exception& e) {
+         cerr << argv[1] << ":" << lineNumber << ": " << e.what() << endl;
+         return 1;
+      }
+   }
+
+   // print the translation unit
+   cout << "// generated by harrietc from " << argv[1] << ", do not edit" << endl;
+   cout << "#include \"Operations.hpp\"" << endl;
+   cout << "#include <limits>" << endl;
+   cout << "#include <stdint.h>" << endl;
+   cout << "//---------------------------------------------------------------------------" << endl;
+   cout << "namespace " << nameSpace << " {" << endl;
+   cout << "//---------------------------------------------------------------------------" << endl;
+   cout << declarations.str();
+   cout << functions.str();
+   cout << "//---------------------------------------------------------------------------" << endl;
+   cout << "} // end of namespace " << nameSpace << endl;
+   cout << "//---------------------------------------------------------------------------" << endl;
+   return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,261 @@
+#include "Harriet.hpp"
+#include "BatchProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Utility.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file license.txt for copying permission.
+//---------------------------------------------------------------------------
+// Checks that every kernel set supported by this cpu computes bit identical results to the tree interpreter (harriet::Expression::evaluate). Each
+// operator is run for every pair of operand types on all pairs of a list of edge values (NaN, -0, infinities, INT_MIN, ..), which includes
+// the quirks of the tree (<= on an int rhs, int % 0 is 0). Rows on which the tree traps (integer division by 0, INT_MIN / -1) are checked
+// separately: a block containing one of them has to trap in batch mode as well. Exits with 1 if any result differs.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+const char* kernelSetNames[] = {"scalar", "128 bit", "256 bit", "512 bit"};
+const char* typeNames[] = {"int", "float", "bool", "string", "vector"};
+//---------------------------------------------------------------------------
+vector<harriet::Scalar> edgeValues(harriet::VariableType type)
+{
+   const float nan = numeric_limits<float>::quiet_NaN();
+   const float inf = numeric_limits<float>::infinity();
+   switch(type) {
+      case harriet::VariableType::TInteger: {
+         vector<harriet::Scalar> result;
+         for(int32_t value : {0, 1, -1, 2, -2, 3, 7, -7, 31, 32, 100, numeric_limits<int32_t>::max(), numeric_limits<int32_t>::min(), numeric_limits<int32_t>::min()+1})
+            result.push_back(harriet::Scalar(value));
+         return result;
+      }
+      case harriet::VariableType::TFloat: {
+         vector<harriet::Scalar> result;
+         for(float value : {0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f, 3.0f, 7.25f, 1e30f, 1e-40f, numeric_limits<float>::max(), nan, inf, -inf})
+            result.push_back(harriet::Scalar(value));
+         return result;
+      }
+      case harriet::VariableType::TBool:
+         return vector<harriet::Scalar>{harriet::Scalar(false), harriet::Scalar(true)};
+      default:
+         return vector<harriet::Scalar>{harriet::Scalar(harriet::Vector3<float>(0, 0, 0)), harriet::Scalar(harriet::Vector3<float>(1, -2, 3)), harriet::Scalar(harriet::Vector3<float>(-0.0f, 0.5f, nan)), harriet::Scalar(harriet::Vector3<float>(inf, -1, 2))};
+   }
+}
+//---------------------------------------------------------------------------
+/// same type and same bits (NaNs are compared by their bits as well)
+bool identical(const harriet::Scalar& lhs, const harriet::Scalar& rhs)
+{
+   if(lhs.type != rhs.type)
+      return false;
+   switch(lhs.type) {
+      case harriet::VariableType::TInteger: return lhs.integer == rhs.integer;
+      case harriet::VariableType::TFloat:   return memcmp(&lhs.floating, &rhs.floating, sizeof(float)) == 0;
+      case harriet::VariableType::TBool:    return lhs.boolean == rhs.boolean;
+      default: {
+         auto l = lhs.getVector(), r = rhs.getVector();
+         return memcmp(&l, &r, sizeof(l)) == 0;
+      }
+   }
+}
+//---------------------------------------------------------------------------
+/// one column of a batch in the layout harriet::BatchProgram expects
+struct TypedColumn {
+   harriet::VariableType type;
+   vector<int32_t> integers;
+   vector<float> floats;
+   unique_ptr<bool[]> bools;
+   vector<harriet::Vector3<float>> vectors;
+
+   TypedColumn(harriet::VariableType type, uint32_t rows) : type(type), integers(rows), floats(rows), bools(new bool[rows]()), vectors(rows) {}
+
+   void set(uint32_t row, const harriet::Scalar& value)
+   {
+      switch(type) {
+         case harriet::VariableType::TInteger: integers[row] = value.integer; break;
+         case harriet::VariableType::TFloat:   floats[row] = value.floating; break;
+         case harriet::VariableType::TBool:    bools[row] = value.boolean; break;
+         default:                     vectors[row] = value.getVector(); break;
+      }
+   }
+
+   harriet::Scalar get(uint32_t row) const
+   {
+      switch(type) {
+         case harriet::VariableType::TInteger: return harriet::Scalar(integers[row]);
+         case harriet::VariableType::TFloat:   return harriet::Scalar(floats[row]);
+         case harriet::VariableType::TBool:    return harriet::Scalar(bools[row]);
+         default:                     return harriet::Scalar(vectors[row]);
+      }
+   }
+
+   harriet::Column column()
+   {
+      switch(type) {
+         case harriet::VariableType::TInteger: return harriet::Column(integers.data());
+         case harriet::VariableType::TFloat:   return harriet::Column(floats.data());
+         case harriet::VariableType::TBool:    return harriet::Column(bools.get());
+         default:                     return harriet::Column(vectors.data());
+      }
+   }
+};
+//---------------------------------------------------------------------------
+/// runs the callable in a child process, returns true if the child was killed by a signal and false if it exited with 0
+template<class Callable>
+bool runsIntoTrap(Callable callable, bool& failed)
+{
+   cout.flush();
+   pid_t pid = fork();
+   if(pid == 0) {
+      freopen("/dev/null", "w", stderr); // failed asserts (vector division by 0) are expected traps
+      bool ok = callable();
+      cout.flush();
+      _exit(ok ? 0 : 1);
+   }
+   int status;
+   waitpid(pid, &status, 0);
+   if(WIFSIGNALED(status))
+      return true;
+   failed |= WEXITSTATUS(status) != 0;
+   return false;
+}
+//---------------------------------------------------------------------------
+struct Statistics {
+   uint32_t expressions;
+   uint32_t notAccepted;
+   uint32_t notBatched;
+   uint64_t rows;
+   uint32_t trapRows;
+   uint32_t failures;
+};
+//---------------------------------------------------------------------------
+void check(const string& input, harriet::VariableType lhsType, harriet::VariableType rhsType, harriet::KernelSet widest, Statistics& statistics)
+{
+   harriet::Environment environment;
+   environment.add("a", harriet::Scalar(edgeValues(lhsType)[0]).toValue());
+   environment.add("b", harriet::Scalar(edgeValues(rhsType)[0]).toValue());
+   unique_ptr<harriet::Expression> expression;
+   try {
+      expression = harriet::parse(input, environment);
+   } catch(harriet::Exception&) {
+      statistics.notAccepted++; // the operator does not accept the types
+      return;
+   }
+   if(harriet::BatchProgram::compile(*expression, environment, harriet::KernelSet::TScalar) == nullptr) {
+      statistics.notBatched++;
+      return;
+   }
+   statistics.expressions++;
+
+   // all pairs of edge values, rows on which the tree traps are kept apart
+   vector<pair<harriet::Scalar, harriet::Scalar>> rows, trapRows;
+   bool divides = input.find_first_of("/%") != string::npos;
+   for(auto& lhs : edgeValues(lhsType)) {
+      for(auto& rhs : edgeValues(rhsType)) {
+         bool failed = false;
+         auto evaluateRow = [&]() {environment.update("a", lhs.toValue()); environment.update("b", rhs.toValue()); expression->evaluate(environment); return true;};
+         if(divides && runsIntoTrap(evaluateRow, failed))
+            trapRows.push_back(make_pair(lhs, rhs)); else
+            rows.push_back(make_pair(lhs, rhs));
+      }
+   }
+
+   // repeated so that there are several blocks and the vector kernels get a tail of odd length
+   const uint32_t repetitions = 7;
+   uint32_t rowCount = rows.size()*repetitions + 5;
+   vector<harriet::Scalar> expected(rowCount);
+   TypedColumn lhsColumn(lhsType, rowCount), rhsColumn(rhsType, rowCount);
+   for(uint32_t row=0; row<rowCount; row++) {
+      auto& values = rows[row % rows.size()];
+      lhsColumn.set(row, values.first);
+      rhsColumn.set(row, values.second);
+      environment.update("a", values.first.toValue());
+      environment.update("b", values.second.toValue());
+      expected[row] = harriet::Scalar::fromValue(*expression->evaluate(environment));
+   }
+   statistics.rows += rowCount;
+   statistics.trapRows += trapRows.size();
+
+   for(uint32_t set=0; set<=static_cast<uint32_t>(widest); set++) {
+      auto program = harriet::BatchProgram::compile(*expression, environment, static_cast<harriet::KernelSet>(set));
+      vector<harriet::Column> columns;
+      for(auto& variable : program->getVariables())
+         columns.push_back(variable=="a" ? lhsColumn.column() : rhsColumn.column());
+
+      // rows the tree computes
+      bool failed = false;
+      auto compare = [&]() {
+         TypedColumn result(program->getResultType(), rowCount);
+         program->execute(columns, result.column(), rowCount, environment);
+         for(uint32_t row=0; row<rowCount; row++) {
+            if(!identical(result.get(row), expected[row])) {
+               cout << input << " (" << typeNames[static_cast<uint32_t>(lhsType)] << ", " << typeNames[static_cast<uint32_t>(rhsType)] << ") " << kernelSetNames[set] << ": row " << row << " differs from the tree" << endl;
+               return false;
+            }
+         }
+         return true;
+      };
+      if(runsIntoTrap(compare, failed)) {
+         cout << input << " (" << typeNames[static_cast<uint32_t>(lhsType)] << ", " << typeNames[static_cast<uint32_t>(rhsType)] << ") " << kernelSetNames[set] << ": traps on rows the tree computes" << endl;
+         failed = true;
+      }
+
+      // a block with one row on which the tree traps
+      for(auto& trapRow : trapRows) {
+         TypedColumn lhsTrap(lhsType, rows.size()+1), rhsTrap(rhsType, rows.size()+1);
+         for(uint32_t row=0; row<=rows.size(); row++) {
+            auto& values = row==rows.size()/2 ? trapRow : rows[row % rows.size()];
+            lhsTrap.set(row, values.first);
+            rhsTrap.set(row, values.second);
+         }
+         vector<harriet::Column> trapColumns;
+         for(auto& variable : program->getVariables())
+            trapColumns.push_back(variable=="a" ? lhsTrap.column() : rhsTrap.column());
+         auto run = [&]() {TypedColumn result(program->getResultType(), rows.size()+1); program->execute(trapColumns, result.column(), rows.size()+1, environment); return true;};
+         if(!runsIntoTrap(run, failed)) {
+            cout << input << " (" << typeNames[static_cast<uint32_t>(lhsType)] << ", " << typeNames[static_cast<uint32_t>(rhsType)] << ") " << kernelSetNames[set] << ": does not trap where the tree does" << endl;
+            failed = true;
+         }
+      }
+      statistics.failures += failed;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+int main()
+{
+   harriet::KernelSet widest = harriet::detectKernelSet();
+   cout << "kernel sets: scalar up to " << kernelSetNames[static_cast<uint32_t>(widest)] << endl;
+
+   const harriet::VariableType types[] = {harriet::VariableType::TInteger, harriet::VariableType::TFloat, harriet::VariableType::TBool, harriet::VariableType::TVector};
+   const char* binaryOperators[] = {"+", "-", "*", "/", "%", "^", "&", "|", ">", "<", ">=", "<=", "==", "!="};
+   const char* unaryExpressions[] = {"-a", "!a", "cast<int> a", "cast<float> a", "cast<bool> a"};
+   const char* compoundExpressions[] = {"(a != b) & (a / b > 1)", "(a == b) | (b % a < 0)", "(a < b) & (a < 0) | (a > b)", "a * b + b / 2 - a % 3"};
+
+   Statistics statistics = {0, 0, 0, 0, 0, 0};
+   for(auto lhsType : types) {
+      for(auto rhsType : types)
+         for(auto operatorSign : binaryOperators)
+            check(string("a ") + operatorSign + " b", lhsType, rhsType, widest, statistics);
+      for(auto input : unaryExpressions)
+         check(input, lhsType, lhsType, widest, statistics);
+   }
+   for(auto lhsType : types)
+      for(auto rhsType : types)
+         for(auto input : compoundExpressions)
+            check(input, lhsType, rhsType, widest, statistics);
+
+   cout << statistics.expressions << " expressions (" << statistics.notAccepted << " type combinations not accepted, " << statistics.notBatched << " not batched), "
+        << statistics.rows << " rows and " << statistics.trapRows << " trapping rows per kernel set, " << statistics.failures << " failures" << endl;
+   return statistics.failures==0 ? 0 : 1;
+}
+//---------------------------------------------------------------------------
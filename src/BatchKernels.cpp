@@ -0,0 +1,454 @@
+#include "BatchKernels.hpp"
+#include "Operations.hpp"
+#include <cstring>
+#include <limits>
+#include <type_traits>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+#if defined(__x86_64__) || defined(__i386__)
+   #define HARRIET_X86_KERNELS
+#endif
+#define HARRIET_INLINE inline __attribute__((always_inline))
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+// Scalar kernels, one Operation::apply per row
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+void binaryKernel(const void* const* arguments, void* result, uint32_t count)
+{
+   auto lhs = static_cast<const L*>(arguments[0]);
+   auto rhs = static_cast<const R*>(arguments[1]);
+   auto out = static_cast<decltype(Operation::apply(declval<L>(), declval<R>()))*>(result);
+   for(uint32_t i=0; i<count; i++)
+      out[i] = Operation::apply(lhs[i], rhs[i]);
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+void unaryKernel(const void* const* arguments, void* result, uint32_t count)
+{
+   auto input = static_cast<const T*>(arguments[0]);
+   auto out = static_cast<decltype(Operation::apply(declval<T>()))*>(result);
+   for(uint32_t i=0; i<count; i++)
+      out[i] = Operation::apply(input[i]);
+}
+//---------------------------------------------------------------------------
+/// CastOperation by target type
+template<class Target> struct CastTo;
+template<> struct CastTo<int32_t> {template<class T> static int32_t apply(const T& value) {return CastOperation::toInteger(value);}};
+template<> struct CastTo<float> {template<class T> static float apply(const T& value) {return CastOperation::toFloat(value);}};
+template<> struct CastTo<bool> {template<class T> static bool apply(const T& value) {return CastOperation::toBool(value);}};
+template<> struct CastTo<Vector3<float>> {template<class T> static Vector3<float> apply(const T& value) {return CastOperation::toVector(value);}};
+//---------------------------------------------------------------------------
+// Vector kernels, written with the gcc vector extensions. The loops are shared by all widths and instantiated in functions with the matching
+// target attribute, so one binary runs on every cpu. The rows which do not fill a whole vector are computed by Operation::apply.
+//---------------------------------------------------------------------------
+/// N lanes of T, bools are stored as bytes
+template<class T, unsigned N> struct VectorOf;
+template<unsigned N> struct VectorOf<int32_t, N> {typedef int32_t type __attribute__((vector_size(N*4)));};
+template<unsigned N> struct VectorOf<float, N> {typedef float type __attribute__((vector_size(N*4)));};
+template<unsigned N> struct VectorOf<double, N> {typedef double type __attribute__((vector_size(N*8)));};
+template<unsigned N> struct VectorOf<uint8_t, N> {typedef uint8_t type __attribute__((vector_size(N)));};
+template<unsigned N> struct VectorOf<bool, N> : VectorOf<uint8_t, N> {};
+//---------------------------------------------------------------------------
+/// vectors are only passed by reference, by value their abi would depend on the target
+template<class V, class T>
+HARRIET_INLINE void load(V& vector, const T* data) {memcpy(&vector, data, sizeof(V));}
+template<class T, class V>
+HARRIET_INLINE void store(T* data, const V& vector) {memcpy(data, &vector, sizeof(V));}
+//---------------------------------------------------------------------------
+/// loads N values converted to T (the usual arithmetic conversions)
+template<unsigned N, class T, class From>
+HARRIET_INLINE void loadAs(typename VectorOf<T, N>::type& vector, const From* data)
+{
+   typename VectorOf<From, N>::type raw;
+   load(raw, data);
+   vector = __builtin_convertvector(raw, typename VectorOf<T, N>::type);
+}
+//---------------------------------------------------------------------------
+/// stores a mask of 32 bit lanes (0 or -1) as bools
+template<unsigned N>
+HARRIET_INLINE void storeMask(bool* data, const typename VectorOf<int32_t, N>::type& mask)
+{
+   typedef typename VectorOf<uint8_t, 4*N>::type Bytes;
+   Bytes bytes = reinterpret_cast<const Bytes&>(mask) & 1;
+   Bytes lowBytes = __builtin_shuffle(bytes, Bytes{0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60});
+   memcpy(data, &lowBytes, N);
+}
+//---------------------------------------------------------------------------
+/// the type both operands are converted to before a comparison
+template<class L, class R> struct CommonType {typedef float type;};
+template<> struct CommonType<int32_t, int32_t> {typedef int32_t type;};
+//---------------------------------------------------------------------------
+/// the vector version of each operator, comparisons give 0 or -1 per lane
+template<class Operation> struct Lanes;
+template<> struct Lanes<AddOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l + r);}};
+template<> struct Lanes<SubOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l - r);}};
+template<> struct Lanes<MulOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l * r);}};
+template<> struct Lanes<DivOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l / r);}};
+template<> struct Lanes<AndOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l & r);}};
+template<> struct Lanes<OrOperation>  {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l | r);}};
+template<> struct Lanes<GtOperation>  {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l > r);}};
+template<> struct Lanes<LtOperation>  {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l < r);}};
+template<> struct Lanes<GeqOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l >= r);}};
+template<> struct Lanes<LeqOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l <= r);}};
+template<> struct Lanes<EqOperation>  {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l == r);}};
+template<> struct Lanes<NeqOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& l, const V& r, Out& out) {out = (Out)(l != r);}};
+//---------------------------------------------------------------------------
+/// x <= int is computed as x >= int, see LeqOperation
+template<class Operation, class R> struct CompareLanes : Lanes<Operation> {};
+template<> struct CompareLanes<LeqOperation, int32_t> : Lanes<GeqOperation> {};
+//---------------------------------------------------------------------------
+/// how the vector loop of an operator looks like for the operand types
+enum struct Shape : uint8_t {TNone, TArithmetic, TCompare, TBytes, TIntegerDivision};
+template<Shape shape> using ShapeTag = integral_constant<Shape, shape>;
+//---------------------------------------------------------------------------
+template<class T> struct IsNumber : integral_constant<bool, is_same<T, int32_t>::value || is_same<T, float>::value> {};
+template<class L, class R> struct BothNumbers : integral_constant<bool, IsNumber<L>::value && IsNumber<R>::value> {};
+template<class L, class R> struct BothIntegers : integral_constant<bool, is_same<L, int32_t>::value && is_same<R, int32_t>::value> {};
+template<class L, class R> struct BothBools : integral_constant<bool, is_same<L, bool>::value && is_same<R, bool>::value> {};
+//---------------------------------------------------------------------------
+template<class L, class R> struct ArithmeticShape : ShapeTag<BothNumbers<L, R>::value ? Shape::TArithmetic : Shape::TNone> {};
+template<class L, class R> struct CompareShape : ShapeTag<BothNumbers<L, R>::value ? Shape::TCompare : Shape::TNone> {};
+template<class L, class R> struct EqualityShape : ShapeTag<BothNumbers<L, R>::value ? Shape::TCompare : BothBools<L, R>::value ? Shape::TBytes : Shape::TNone> {};
+template<class L, class R> struct BitwiseShape : ShapeTag<BothIntegers<L, R>::value ? Shape::TArithmetic : BothBools<L, R>::value ? Shape::TBytes : Shape::TNone> {};
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R> struct ShapeOf : ShapeTag<Shape::TNone> {};
+template<class L, class R> struct ShapeOf<AddOperation, L, R> : ArithmeticShape<L, R> {};
+template<class L, class R> struct ShapeOf<SubOperation, L, R> : ArithmeticShape<L, R> {};
+template<class L, class R> struct ShapeOf<MulOperation, L, R> : ArithmeticShape<L, R> {};
+template<class L, class R> struct ShapeOf<DivOperation, L, R> : ShapeTag<BothIntegers<L, R>::value ? Shape::TIntegerDivision : ArithmeticShape<L, R>::value> {};
+template<class L, class R> struct ShapeOf<ModOperation, L, R> : ShapeTag<IsNumber<L>::value && is_same<R, int32_t>::value ? Shape::TIntegerDivision : Shape::TNone> {};
+template<class L, class R> struct ShapeOf<AndOperation, L, R> : BitwiseShape<L, R> {};
+template<class L, class R> struct ShapeOf<OrOperation, L, R>  : BitwiseShape<L, R> {};
+template<class L, class R> struct ShapeOf<GtOperation, L, R>  : CompareShape<L, R> {};
+template<class L, class R> struct ShapeOf<LtOperation, L, R>  : CompareShape<L, R> {};
+template<class L, class R> struct ShapeOf<GeqOperation, L, R> : CompareShape<L, R> {};
+template<class L, class R> struct ShapeOf<LeqOperation, L, R> : CompareShape<L, R> {};
+template<class L, class R> struct ShapeOf<EqOperation, L, R>  : EqualityShape<L, R> {};
+template<class L, class R> struct ShapeOf<NeqOperation, L, R> : EqualityShape<L, R> {};
+//---------------------------------------------------------------------------
+/// +, -, *, float division and & | on integers: the result has the type of the converted operands
+template<unsigned N, class Operation, class L, class R, class Out>
+HARRIET_INLINE uint32_t vectorLoop(const L* lhs, const R* rhs, Out* out, uint32_t count, ShapeTag<Shape::TArithmetic>)
+{
+   typename VectorOf<Out, N>::type l, r, o;
+   uint32_t i = 0;
+   for(; i+N<=count; i+=N) {
+      loadAs<N, Out>(l, lhs+i);
+      loadAs<N, Out>(r, rhs+i);
+      Lanes<Operation>::apply(l, r, o);
+      store(out+i, o);
+   }
+   return i;
+}
+//---------------------------------------------------------------------------
+/// comparisons of numbers
+template<unsigned N, class Operation, class L, class R>
+HARRIET_INLINE uint32_t vectorLoop(const L* lhs, const R* rhs, bool* out, uint32_t count, ShapeTag<Shape::TCompare>)
+{
+   typedef typename CommonType<L, R>::type Common;
+   typename VectorOf<Common, N>::type l, r;
+   typename VectorOf<int32_t, N>::type mask;
+   uint32_t i = 0;
+   for(; i+N<=count; i+=N) {
+      loadAs<N, Common>(l, lhs+i);
+      loadAs<N, Common>(r, rhs+i);
+      CompareLanes<Operation, R>::apply(l, r, mask);
+      storeMask<N>(out+i, mask);
+   }
+   return i;
+}
+//---------------------------------------------------------------------------
+/// & | == != on bools, works on the bytes
+template<unsigned N, class Operation>
+HARRIET_INLINE uint32_t vectorLoop(const bool* lhs, const bool* rhs, bool* out, uint32_t count, ShapeTag<Shape::TBytes>)
+{
+   typedef typename VectorOf<uint8_t, N>::type Bytes;
+   Bytes l, r, o;
+   uint32_t i = 0;
+   for(; i+N<=count; i+=N) {
+      load(l, lhs+i);
+      load(r, rhs+i);
+      Lanes<Operation>::apply(l, r, o);
+      o &= 1;
+      store(out+i, o);
+   }
+   return i;
+}
+//---------------------------------------------------------------------------
+/// Integer / and %. There is no vector instruction for them, but the truncated double quotient of two 32 bit integers is exact. The lhs of
+/// float % int is truncated first (and the result is a float again). A block containing a division which traps in the scalar version (x/0,
+/// INT_MIN/-1 and float%0) is left to the scalar loop, so that it fails the same way. int % 0 is 0.
+template<unsigned N, class Operation, class L, class Out>
+HARRIET_INLINE uint32_t vectorLoop(const L* lhs, const int32_t* rhs, Out* out, uint32_t count, ShapeTag<Shape::TIntegerDivision>)
+{
+   const bool zeroIsZero = is_same<Operation, ModOperation>::value && is_same<L, int32_t>::value;
+   bool traps = false;
+   for(uint32_t i=0; i<count; i++)
+      traps |= (rhs[i]==0 && !zeroIsZero) | (CastTo<int32_t>::apply(lhs[i])==numeric_limits<int32_t>::min() && rhs[i]==-1);
+   if(traps)
+      return 0;
+
+   // half vectors of integers, the doubles fill a whole register
+   const unsigned H = N / 2;
+   typedef typename VectorOf<int32_t, H>::type Integers;
+   typedef typename VectorOf<double, H>::type Doubles;
+   Integers l, r;
+   uint32_t i = 0;
+   for(; i+H<=count; i+=H) {
+      typename VectorOf<L, H>::type raw;
+      load(raw, lhs+i);
+      l = __builtin_convertvector(raw, Integers);
+      load(r, rhs+i);
+      Integers isZero = r == 0;
+      Integers divisor = r - isZero; // 0 => 1
+      Integers quotient = __builtin_convertvector(__builtin_convertvector(l, Doubles) / __builtin_convertvector(divisor, Doubles), Integers);
+      if(is_same<Operation, DivOperation>::value)
+         store(out+i, __builtin_convertvector(quotient, typename VectorOf<Out, H>::type)); else
+         store(out+i, __builtin_convertvector((l - quotient*divisor) & ~isZero, typename VectorOf<Out, H>::type));
+   }
+   return i;
+}
+//---------------------------------------------------------------------------
+template<unsigned N, class Operation, class L, class R>
+HARRIET_INLINE void runBinary(const void* const* arguments, void* result, uint32_t count)
+{
+   auto lhs = static_cast<const L*>(arguments[0]);
+   auto rhs = static_cast<const R*>(arguments[1]);
+   auto out = static_cast<decltype(Operation::apply(declval<L>(), declval<R>()))*>(result);
+   for(uint32_t i=vectorLoop<N, Operation>(lhs, rhs, out, count, ShapeOf<Operation, L, R>()); i<count; i++)
+      out[i] = Operation::apply(lhs[i], rhs[i]);
+}
+//---------------------------------------------------------------------------
+/// the vector version of the unary operators and casts with a vector kernel
+template<class Operation, class T> struct HasUnaryLanes : false_type {};
+template<> struct HasUnaryLanes<InvOperation, int32_t> : true_type {};
+template<> struct HasUnaryLanes<InvOperation, float> : true_type {};
+template<> struct HasUnaryLanes<NotOperation, bool> : true_type {};
+template<> struct HasUnaryLanes<CastTo<float>, int32_t> : true_type {};
+template<> struct HasUnaryLanes<CastTo<int32_t>, float> : true_type {};
+//---------------------------------------------------------------------------
+template<class Operation> struct UnaryLanes;
+template<> struct UnaryLanes<InvOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& v, Out& out) {out = -v;}};
+template<> struct UnaryLanes<NotOperation> {template<class V, class Out> static HARRIET_INLINE void apply(const V& v, Out& out) {out = v ^ 1;}};
+template<class Target> struct UnaryLanes<CastTo<Target>> {template<class V, class Out> static HARRIET_INLINE void apply(const V& v, Out& out) {out = __builtin_convertvector(v, Out);}};
+//---------------------------------------------------------------------------
+template<unsigned N, class Operation, class T>
+HARRIET_INLINE void runUnary(const void* const* arguments, void* result, uint32_t count)
+{
+   typedef decltype(Operation::apply(declval<T>())) Out;
+   auto input = static_cast<const T*>(arguments[0]);
+   auto out = static_cast<Out*>(result);
+   typename VectorOf<T, N>::type v;
+   typename VectorOf<Out, N>::type o;
+   uint32_t i = 0;
+   for(; i+N<=count; i+=N) {
+      load(v, input+i);
+      UnaryLanes<Operation>::apply(v, o);
+      store(out+i, o);
+   }
+   for(; i<count; i++)
+      out[i] = Operation::apply(input[i]);
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+void binaryKernel128(const void* const* arguments, void* result, uint32_t count) {runBinary<4, Operation, L, R>(arguments, result, count);}
+template<class Operation, class T>
+void unaryKernel128(const void* const* arguments, void* result, uint32_t count) {runUnary<4, Operation, T>(arguments, result, count);}
+#ifdef HARRIET_X86_KERNELS
+template<class Operation, class L, class R> __attribute__((target("avx2")))
+void binaryKernel256(const void* const* arguments, void* result, uint32_t count) {runBinary<8, Operation, L, R>(arguments, result, count);}
+template<class Operation, class T> __attribute__((target("avx2")))
+void unaryKernel256(const void* const* arguments, void* result, uint32_t count) {runUnary<8, Operation, T>(arguments, result, count);}
+template<class Operation, class L, class R> __attribute__((target("avx512f,avx512bw")))
+void binaryKernel512(const void* const* arguments, void* result, uint32_t count) {runBinary<16, Operation, L, R>(arguments, result, count);}
+template<class Operation, class T> __attribute__((target("avx512f,avx512bw")))
+void unaryKernel512(const void* const* arguments, void* result, uint32_t count) {runUnary<16, Operation, T>(arguments, result, count);}
+#endif
+//---------------------------------------------------------------------------
+// Selection, the operator is known => choose the kernel by the operand types
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+BatchKernel pickBinary(KernelSet kernels, true_type /*vectorized*/)
+{
+   switch(kernels) {
+#ifdef HARRIET_X86_KERNELS
+      case KernelSet::TVector512: return &binaryKernel512<Operation, L, R>;
+      case KernelSet::TVector256: return &binaryKernel256<Operation, L, R>;
+#else
+      case KernelSet::TVector512:
+      case KernelSet::TVector256:
+#endif
+      case KernelSet::TVector128: return &binaryKernel128<Operation, L, R>;
+      default:                    return &binaryKernel<Operation, L, R>;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+BatchKernel pickBinary(KernelSet /*kernels*/, false_type /*vectorized*/)
+{
+   return &binaryKernel<Operation, L, R>;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+auto selectBinary(harriet::VariableType& resultType, KernelSet kernels, int) -> decltype(Operation::apply(declval<L>(), declval<R>()), BatchKernel())
+{
+   resultType = StaticType<decltype(Operation::apply(declval<L>(), declval<R>()))>::value;
+   return pickBinary<Operation, L, R>(kernels, integral_constant<bool, ShapeOf<Operation, L, R>::value != Shape::TNone>());
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+BatchKernel selectBinary(harriet::VariableType& /*resultType*/, KernelSet /*kernels*/, long)
+{
+   return nullptr;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L>
+BatchKernel selectRhs(harriet::VariableType rhsType, harriet::VariableType& resultType, KernelSet kernels)
+{
+   switch(rhsType) {
+      case harriet::VariableType::TInteger: return selectBinary<Operation, L, int32_t>(resultType, kernels, 0);
+      case harriet::VariableType::TFloat:   return selectBinary<Operation, L, float>(resultType, kernels, 0);
+      case harriet::VariableType::TBool:    return selectBinary<Operation, L, bool>(resultType, kernels, 0);
+      case harriet::VariableType::TVector:  return selectBinary<Operation, L, Vector3<float>>(resultType, kernels, 0);
+      default:                                     return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+BatchKernel selectBinaryOperation(harriet::VariableType lhsType, harriet::VariableType rhsType, harriet::VariableType& resultType, KernelSet kernels)
+{
+   switch(lhsType) {
+      case harriet::VariableType::TInteger: return selectRhs<Operation, int32_t>(rhsType, resultType, kernels);
+      case harriet::VariableType::TFloat:   return selectRhs<Operation, float>(rhsType, resultType, kernels);
+      case harriet::VariableType::TBool:    return selectRhs<Operation, bool>(rhsType, resultType, kernels);
+      case harriet::VariableType::TVector:  return selectRhs<Operation, Vector3<float>>(rhsType, resultType, kernels);
+      default:                                     return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+BatchKernel pickUnary(KernelSet kernels, true_type /*vectorized*/)
+{
+   switch(kernels) {
+#ifdef HARRIET_X86_KERNELS
+      case KernelSet::TVector512: return &unaryKernel512<Operation, T>;
+      case KernelSet::TVector256: return &unaryKernel256<Operation, T>;
+#else
+      case KernelSet::TVector512:
+      case KernelSet::TVector256:
+#endif
+      case KernelSet::TVector128: return &unaryKernel128<Operation, T>;
+      default:                    return &unaryKernel<Operation, T>;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+BatchKernel pickUnary(KernelSet /*kernels*/, false_type /*vectorized*/)
+{
+   return &unaryKernel<Operation, T>;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+auto selectUnary(harriet::VariableType& resultType, KernelSet kernels, int) -> decltype(Operation::apply(declval<T>()), BatchKernel())
+{
+   resultType = StaticType<decltype(Operation::apply(declval<T>()))>::value;
+   return pickUnary<Operation, T>(kernels, HasUnaryLanes<Operation, T>());
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+BatchKernel selectUnary(harriet::VariableType& /*resultType*/, KernelSet /*kernels*/, long)
+{
+   return nullptr;
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+BatchKernel selectUnaryOperation(harriet::VariableType type, harriet::VariableType& resultType, KernelSet kernels)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return selectUnary<Operation, int32_t>(resultType, kernels, 0);
+      case harriet::VariableType::TFloat:   return selectUnary<Operation, float>(resultType, kernels, 0);
+      case harriet::VariableType::TBool:    return selectUnary<Operation, bool>(resultType, kernels, 0);
+      case harriet::VariableType::TVector:  return selectUnary<Operation, Vector3<float>>(resultType, kernels, 0);
+      default:                                     return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+template<class T>
+BatchKernel selectCastTarget(harriet::VariableType target, KernelSet kernels)
+{
+   harriet::VariableType resultType;
+   switch(target) {
+      case harriet::VariableType::TInteger: return selectUnary<CastTo<int32_t>, T>(resultType, kernels, 0);
+      case harriet::VariableType::TFloat:   return selectUnary<CastTo<float>, T>(resultType, kernels, 0);
+      case harriet::VariableType::TBool:    return selectUnary<CastTo<bool>, T>(resultType, kernels, 0);
+      case harriet::VariableType::TVector:  return selectUnary<CastTo<Vector3<float>>, T>(resultType, kernels, 0);
+      default:                                     return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+KernelSet detectKernelSet()
+{
+#ifdef HARRIET_X86_KERNELS
+   __builtin_cpu_init();
+   if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+      return KernelSet::TVector512;
+   if(__builtin_cpu_supports("avx2"))
+      return KernelSet::TVector256;
+#endif
+   return KernelSet::TVector128;
+}
+//---------------------------------------------------------------------------
+BatchKernel selectBinaryKernel(OperatorType operatorType, harriet::VariableType lhsType, harriet::VariableType rhsType, harriet::VariableType& resultType, KernelSet kernels)
+{
+   switch(operatorType) {
+      case OperatorType::TPlus:           return selectBinaryOperation<AddOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TMinus:          return selectBinaryOperation<SubOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TMultiplication: return selectBinaryOperation<MulOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TDivision:       return selectBinaryOperation<DivOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TModulo:         return selectBinaryOperation<ModOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TExponentiation: return selectBinaryOperation<ExpOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TAnd:            return selectBinaryOperation<AndOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TOr:             return selectBinaryOperation<OrOperation> (lhsType, rhsType, resultType, kernels);
+      case OperatorType::TGreater:        return selectBinaryOperation<GtOperation> (lhsType, rhsType, resultType, kernels);
+      case OperatorType::TLess:           return selectBinaryOperation<LtOperation> (lhsType, rhsType, resultType, kernels);
+      case OperatorType::TGreaterEqual:   return selectBinaryOperation<GeqOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TLessEqual:      return selectBinaryOperation<LeqOperation>(lhsType, rhsType, resultType, kernels);
+      case OperatorType::TEqual:          return selectBinaryOperation<EqOperation> (lhsType, rhsType, resultType, kernels);
+      case OperatorType::TNotEqual:       return selectBinaryOperation<NeqOperation>(lhsType, rhsType, resultType, kernels);
+      default:                            return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+BatchKernel selectUnaryKernel(OperatorType operatorType, harriet::VariableType type, harriet::VariableType& resultType, KernelSet kernels)
+{
+   switch(operatorType) {
+      case OperatorType::TUnaryMinus: return selectUnaryOperation<InvOperation>(type, resultType, kernels);
+      case OperatorType::TNot:        return selectUnaryOperation<NotOperation>(type, resultType, kernels);
+      default:                        return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+BatchKernel selectCastKernel(harriet::VariableType type, harriet::VariableType target, KernelSet kernels)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return selectCastTarget<int32_t>(target, kernels);
+      case harriet::VariableType::TFloat:   return selectCastTarget<float>(target, kernels);
+      case harriet::VariableType::TBool:    return selectCastTarget<bool>(target, kernels);
+      case harriet::VariableType::TVector:  return selectCastTarget<Vector3<float>>(target, kernels);
+      default:                                     return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
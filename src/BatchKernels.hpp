@@ -0,0 +1,31 @@
+#ifndef SCRIPTLANGUAGE_BATCHKERNELS_HPP_
+#define SCRIPTLANGUAGE_BATCHKERNELS_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "Expression.hpp"
+#include <stdint.h>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+/// Computes count rows of the result from the argument columns, the types are fixed by the kernel.
+typedef void (*BatchKernel)(const void* const* arguments, void* result, uint32_t count);
+//---------------------------------------------------------------------------
+/// Vector width of the kernels: 128 bit is SSE2 (or the native vector unit on other architectures), 256 bit is AVX2 and 512 bit AVX-512 (F
+/// and BW). All sets compute bit identical results, operators without a vector version (^, vector math, ..) always use the scalar kernel.
+enum struct KernelSet : uint8_t {TScalar, TVector128, TVector256, TVector512};
+//---------------------------------------------------------------------------
+/// the widest set supported by this cpu
+KernelSet detectKernelSet();
+//---------------------------------------------------------------------------
+/// The kernel for the operand types or nullptr if the operator does not accept them. The result type of the kernel is stored in resultType.
+BatchKernel selectBinaryKernel(OperatorType operatorType, harriet::VariableType lhsType, harriet::VariableType rhsType, harriet::VariableType& resultType, KernelSet kernels);
+BatchKernel selectUnaryKernel(OperatorType operatorType, harriet::VariableType type, harriet::VariableType& resultType, KernelSet kernels);
+BatchKernel selectCastKernel(harriet::VariableType type, harriet::VariableType target, KernelSet kernels);
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
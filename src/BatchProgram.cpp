@@ -0,0 +1,380 @@
+#include "BatchProgram.hpp"
+#include "BatchKernels.hpp"
+#include "ClosureProgram.hpp"
+#include "Expression.hpp"
+#include "Environment.hpp"
+#include "Function.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// rows processed by each kernel call, the registers of a block should stay in the cache
+const uint32_t kBlockSize = 1024;
+//---------------------------------------------------------------------------
+const uint32_t kNoSlot = ~0u;
+//---------------------------------------------------------------------------
+atomic<uint64_t> nextProgramId(1);
+//---------------------------------------------------------------------------
+uint32_t typeSize(harriet::VariableType type)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return sizeof(int32_t);
+      case harriet::VariableType::TFloat:   return sizeof(float);
+      case harriet::VariableType::TBool:    return sizeof(bool);
+      case harriet::VariableType::TVector:  return sizeof(Vector3<float>);
+      default:                                     throw harriet::Exception{"type '" + harriet::typeToName(type) + "' can not be stored in a column"};
+   }
+}
+//---------------------------------------------------------------------------
+Scalar loadScalar(const void* data, harriet::VariableType type, uint32_t row)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return Scalar(static_cast<const int32_t*>(data)[row]);
+      case harriet::VariableType::TFloat:   return Scalar(static_cast<const float*>(data)[row]);
+      case harriet::VariableType::TBool:    return Scalar(static_cast<const bool*>(data)[row]);
+      case harriet::VariableType::TVector:  return Scalar(static_cast<const Vector3<float>*>(data)[row]);
+      default:                                     throw harriet::Exception{"unreachable"};
+   }
+}
+//---------------------------------------------------------------------------
+void storeScalar(const Scalar& value, void* data, uint32_t row)
+{
+   switch(value.type) {
+      case harriet::VariableType::TInteger: static_cast<int32_t*>(data)[row] = value.integer; break;
+      case harriet::VariableType::TFloat:   static_cast<float*>(data)[row] = value.floating; break;
+      case harriet::VariableType::TBool:    static_cast<bool*>(data)[row] = value.boolean; break;
+      case harriet::VariableType::TVector:  static_cast<Vector3<float>*>(data)[row] = value.getVector(); break;
+      default:                                     throw harriet::Exception{"unreachable"};
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+BatchProgram::BatchProgram()
+: id(nextProgramId++)
+, registerCount(0)
+, resultSlot(0)
+, parallel(true)
+{
+}
+//---------------------------------------------------------------------------
+BatchProgram::~BatchProgram()
+{
+}
+//---------------------------------------------------------------------------
+unique_ptr<BatchProgram> BatchProgram::compile(const Expression& expression, Environment& environment, KernelSet kernels)
+{
+   unique_ptr<BatchProgram> program(new BatchProgram());
+   if(!program->compileNode(expression, environment, kernels, program->resultSlot))
+      return nullptr;
+   return program;
+}
+//---------------------------------------------------------------------------
+harriet::VariableType BatchProgram::getResultType() const
+{
+   return slots[resultSlot].type;
+}
+//---------------------------------------------------------------------------
+bool BatchProgram::compileNode(const Expression& expression, Environment& environment, KernelSet kernels, uint32_t& slot)
+{
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TValue: {
+         auto& value = reinterpret_cast<const Value&>(expression);
+         if(value.getResultType() == harriet::VariableType::TString)
+            return false;
+         slot = addSlot(SlotKind::TConstant, value.getResultType(), constants.size());
+         constants.push_back(Scalar::fromValue(value));
+         return true;
+      }
+      case ExpressionType::TVariable: {
+         // the static type of the variable is the type of its column
+         auto& variable = reinterpret_cast<const Variable&>(expression);
+         if(variable.getResultType() == harriet::VariableType::TString)
+            return false;
+         auto iter = find(variables.begin(), variables.end(), variable.getIdentifier());
+         if(iter != variables.end()) {
+            for(slot=0; slots[slot].kind!=SlotKind::TColumn || slots[slot].index!=static_cast<uint32_t>(iter-variables.begin()); slot++);
+            return true;
+         }
+         slot = addSlot(SlotKind::TColumn, variable.getResultType(), variables.size());
+         variables.push_back(variable.getIdentifier());
+         variableTypes.push_back(variable.getResultType());
+         return true;
+      }
+      case ExpressionType::TUnaryOperator: {
+         auto& unary = reinterpret_cast<const UnaryOperator&>(expression);
+         uint32_t child;
+         if(!compileNode(unary.getChild(), environment, kernels, child))
+            return false;
+         harriet::VariableType childType = slots[child].type;
+         harriet::VariableType resultType = unary.getResultType();
+         BatchKernel kernel;
+         if(unary.getOperatorType() == OperatorType::TCast)
+            kernel = selectCastKernel(childType, resultType, kernels); else
+            kernel = selectUnaryKernel(unary.getOperatorType(), childType, resultType, kernels);
+         if(kernel == nullptr)
+            return false;
+         assert(resultType == unary.getResultType());
+         slot = addStep(kernel, resultType, vector<uint32_t>{child});
+         return true;
+      }
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+         if(binary.getOperatorType() == OperatorType::TAssignment)
+            return false; // rows are independent of each other, there is nothing to assign to
+         uint32_t lhs, rhs;
+         if(!compileNode(binary.getLhs(), environment, kernels, lhs))
+            return false;
+         if(binary.getOperatorType()==OperatorType::TAnd || binary.getOperatorType()==OperatorType::TOr) {
+            if(!compileShortCircuit(binary, environment, kernels, lhs, rhs))
+               return false;
+         } else if(!compileNode(binary.getRhs(), environment, kernels, rhs)) {
+            return false;
+         }
+         harriet::VariableType lhsType = slots[lhs].type;
+         harriet::VariableType rhsType = slots[rhs].type;
+         harriet::VariableType resultType;
+         BatchKernel kernel = selectBinaryKernel(binary.getOperatorType(), lhsType, rhsType, resultType, kernels);
+         if(kernel == nullptr)
+            return false;
+         assert(resultType == binary.getResultType());
+         slot = addStep(kernel, resultType, vector<uint32_t>{lhs, rhs});
+         return true;
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         auto function = environment.getFunction(call.getFunctionIdentifier());
+         if(function->getResultType() == harriet::VariableType::TString)
+            return false;
+         vector<uint32_t> arguments(call.getArguments().size());
+         for(uint32_t i=0; i<arguments.size(); i++)
+            if(!compileNode(*call.getArguments()[i], environment, kernels, arguments[i]) || slots[arguments[i]].type!=function->getArgumentType(i))
+               return false;
+         slot = addStep(nullptr, function->getResultType(), ::move(arguments));
+         steps.back().kind = StepKind::TCall;
+         parallel &= function->isPure();
+         steps.back().function = functions.size();
+         functions.push_back(call.getFunctionIdentifier());
+         return true;
+      }
+      case ExpressionType::TSharedScope:
+         return compileNode(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), environment, kernels, slot);
+      case ExpressionType::TCompiled:
+         return compileNode(reinterpret_cast<const CompiledExpression&>(expression).getTree(), environment, kernels, slot);
+      case ExpressionType::TShared: {
+         // the register of the first occurrence is read by the others
+         auto& shared = reinterpret_cast<const SharedExpression&>(expression);
+         if(shared.getIndex() >= sharedSlots.size())
+            sharedSlots.resize(shared.getIndex()+1, kNoSlot);
+         if(sharedSlots[shared.getIndex()] != kNoSlot) {
+            slot = sharedSlots[shared.getIndex()];
+            return true;
+         }
+         if(!compileNode(shared.getChild(), environment, kernels, slot))
+            return false;
+         sharedSlots[shared.getIndex()] = slot;
+         return true;
+      }
+      default:
+         return false;
+   }
+}
+//---------------------------------------------------------------------------
+uint32_t BatchProgram::addSlot(SlotKind kind, harriet::VariableType type, uint32_t index)
+{
+   slots.push_back(Slot{kind, type, index});
+   return slots.size() - 1;
+}
+//---------------------------------------------------------------------------
+uint32_t BatchProgram::addStep(BatchKernel kernel, harriet::VariableType resultType, vector<uint32_t> arguments)
+{
+   uint32_t result = addSlot(SlotKind::TRegister, resultType, registerCount++);
+   steps.push_back(Step{StepKind::TKernel, kernel, 0, ::move(arguments), result});
+   return result;
+}
+//---------------------------------------------------------------------------
+bool BatchProgram::compileShortCircuit(const BinaryOperator& binary, Environment& environment, KernelSet kernels, uint32_t lhs, uint32_t& rhs)
+{
+   // the steps of a bool rhs only run for the rows not decided by the lhs, the combining kernel ignores the rhs of the other rows
+   if(!reinterpret_cast<const LogicOperator&>(binary).isShortCircuit() || slots[lhs].type!=harriet::VariableType::TBool)
+      return compileNode(binary.getRhs(), environment, kernels, rhs);
+   uint32_t select = steps.size();
+   uint32_t firstSlot = slots.size();
+   steps.push_back(Step{binary.getOperatorType()==OperatorType::TAnd ? StepKind::TSelectTrue : StepKind::TSelectFalse, nullptr, 0, vector<uint32_t>{lhs}, 0});
+   auto sharedBefore = sharedSlots; // the registers of the region only hold the selected rows
+   if(!compileNode(binary.getRhs(), environment, kernels, rhs))
+      return false;
+   sharedSlots = ::move(sharedBefore);
+   if(steps.size() == select+1) {
+      steps.pop_back(); // a column or a constant, nothing to skip
+      return true;
+   }
+
+   // columns and the registers computed before are gathered into registers of their own, constants are the same in every row
+   vector<uint32_t> reads;
+   for(uint32_t i=select+1; i<steps.size(); i++)
+      for(auto argument : steps[i].arguments)
+         if((slots[argument].kind==SlotKind::TColumn || (slots[argument].kind==SlotKind::TRegister && argument<firstSlot)) && find(reads.begin(), reads.end(), argument)==reads.end())
+            reads.push_back(argument);
+   auto& step = steps[select];
+   step.function = steps.size();
+   step.arguments.insert(step.arguments.end(), reads.begin(), reads.end());
+   for(auto read : reads)
+      step.arguments.push_back(addSlot(SlotKind::TRegister, slots[read].type, registerCount++));
+   step.result = addSlot(SlotKind::TRegister, harriet::VariableType::TInteger, registerCount++);
+   return true;
+}
+//---------------------------------------------------------------------------
+void BatchProgram::execute(const vector<Column>& columns, Column result, uint64_t rowCount, Environment& environment) const
+{
+   Scratch scratch;
+   execute(columns, result, 0, rowCount, scratch, environment);
+}
+//---------------------------------------------------------------------------
+void BatchProgram::execute(const vector<Column>& columns, Column result, uint64_t begin, uint64_t end, Scratch& scratch, Environment& environment) const
+{
+   if(columns.size() != variables.size())
+      throw harriet::Exception{"expected " + to_string(variables.size()) + " columns but got " + to_string(columns.size())};
+   for(uint32_t i=0; i<columns.size(); i++)
+      if(columns[i].type != variableTypes[i])
+         throw harriet::Exception{"column for '" + variables[i] + "' has type '" + harriet::typeToName(columns[i].type) + "' but the expression expects '" + harriet::typeToName(variableTypes[i]) + "'"};
+   if(result.type != getResultType())
+      throw harriet::Exception{"result column has type '" + harriet::typeToName(result.type) + "' but the expression returns '" + harriet::typeToName(getResultType()) + "'"};
+   if(scratch.program != id)
+      prepare(scratch);
+
+   auto& data = scratch.data;
+   uint32_t resultSize = typeSize(getResultType());
+   for(uint64_t row=begin; row<end; row+=kBlockSize) {
+      uint32_t count = min<uint64_t>(kBlockSize, end-row);
+      for(uint32_t i=0; i<slots.size(); i++)
+         if(slots[i].kind == SlotKind::TColumn)
+            data[i] = static_cast<uint8_t*>(columns[slots[i].index].data) + row*typeSize(slots[i].type);
+      run(0, steps.size(), count, scratch, environment);
+      memcpy(static_cast<uint8_t*>(result.data) + row*resultSize, data[resultSlot], count*resultSize);
+   }
+}
+//---------------------------------------------------------------------------
+void BatchProgram::run(uint32_t begin, uint32_t end, uint32_t count, Scratch& scratch, Environment& environment) const
+{
+   auto& data = scratch.data;
+   auto& arguments = scratch.arguments;
+   for(uint32_t i=begin; i<end; i++) {
+      auto& step = steps[i];
+      switch(step.kind) {
+         case StepKind::TKernel:
+         case StepKind::TCall:
+            arguments.clear();
+            for(auto argument : step.arguments)
+               arguments.push_back(data[argument]);
+            if(step.kind == StepKind::TKernel)
+               step.kernel(arguments.data(), data[step.result], count); else
+               callFunction(step, arguments.data(), data[step.result], count, environment);
+            break;
+         case StepKind::TSelectTrue:
+         case StepKind::TSelectFalse:
+            select(step, count, scratch, environment);
+            i = step.function - 1;
+            break;
+      }
+   }
+}
+//---------------------------------------------------------------------------
+void BatchProgram::select(const Step& step, uint32_t count, Scratch& scratch, Environment& environment) const
+{
+   auto& data = scratch.data;
+   uint32_t first = &step - steps.data() + 1;
+   const bool* condition = reinterpret_cast<const bool*>(data[step.arguments[0]]);
+   bool value = step.kind == StepKind::TSelectTrue;
+   uint32_t* selection = reinterpret_cast<uint32_t*>(data[step.result]);
+   uint32_t selected = 0;
+   for(uint32_t row=0; row<count; row++) {
+      selection[selected] = row;
+      selected += condition[row] == value;
+   }
+   if(selected == count)
+      return run(first, step.function, count, scratch, environment);
+   if(selected == 0)
+      return;
+
+   // run the region on the selected rows only and scatter its result back, the combining kernel masks the rows in between
+   uint32_t readCount = (step.arguments.size()-1) / 2;
+   vector<uint8_t*> original(readCount);
+   for(uint32_t i=0; i<readCount; i++) {
+      uint32_t read = step.arguments[1+i];
+      uint32_t size = typeSize(slots[read].type);
+      uint8_t* gathered = data[step.arguments[1+readCount+i]];
+      for(uint32_t row=0; row<selected; row++)
+         memcpy(gathered + row*size, data[read] + selection[row]*size, size);
+      original[i] = data[read];
+      data[read] = gathered;
+   }
+   run(first, step.function, selected, scratch, environment);
+   for(uint32_t i=0; i<readCount; i++)
+      data[step.arguments[1+i]] = original[i];
+   uint32_t result = steps[step.function-1].result;
+   uint32_t size = typeSize(slots[result].type);
+   for(uint32_t row=selected; row-->0;)
+      memmove(data[result] + selection[row]*size, data[result] + row*size, size);
+}
+//---------------------------------------------------------------------------
+void BatchProgram::prepare(Scratch& scratch) const
+{
+   // registers and broadcasted constants hold one block each
+   uint64_t size = 0;
+   for(auto& slot : slots)
+      if(slot.kind != SlotKind::TColumn)
+         size += kBlockSize * typeSize(slot.type);
+   scratch.memory.assign(size, 0);
+   scratch.data.assign(slots.size(), nullptr);
+   uint8_t* position = scratch.memory.data();
+   for(uint32_t i=0; i<slots.size(); i++) {
+      if(slots[i].kind == SlotKind::TColumn)
+         continue;
+      scratch.data[i] = position;
+      position += kBlockSize * typeSize(slots[i].type);
+      if(slots[i].kind == SlotKind::TConstant)
+         for(uint32_t row=0; row<kBlockSize; row++)
+            storeScalar(constants[slots[i].index], scratch.data[i], row);
+   }
+   scratch.program = id;
+}
+//---------------------------------------------------------------------------
+void BatchProgram::callFunction(const Step& step, const void* const* arguments, void* result, uint32_t count, Environment& environment) const
+{
+   // host functions are called row by row
+   auto function = environment.getFunction(functions[step.function]);
+   if(function->isUnboxed()) {
+      vector<Scalar> argv(step.arguments.size());
+      for(uint32_t row=0; row<count; row++) {
+         for(uint32_t i=0; i<argv.size(); i++)
+            argv[i] = loadScalar(arguments[i], slots[step.arguments[i]].type, row);
+         storeScalar(function->executeScalar(argv.data(), environment), result, row);
+      }
+      return;
+   }
+   vector<unique_ptr<Value>> values(step.arguments.size());
+   for(uint32_t row=0; row<count; row++) {
+      for(uint32_t i=0; i<values.size(); i++)
+         values[i] = loadScalar(arguments[i], slots[step.arguments[i]].type, row).toValue();
+      auto value = function->execute(values, environment);
+      if(value->getResultType() != function->getResultType())
+         throw harriet::Exception{"function '" + function->getName() + "' returned '" + harriet::typeToName(value->getResultType()) + "' instead of '" + harriet::typeToName(function->getResultType()) + "'"};
+      storeScalar(Scalar::fromValue(*value), result, row);
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
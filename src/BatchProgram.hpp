@@ -0,0 +1,112 @@
+#ifndef SCRIPTLANGUAGE_BATCHPROGRAM_HPP_
+#define SCRIPTLANGUAGE_BATCHPROGRAM_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "BatchKernels.hpp"
+#include "Scalar.hpp"
+#include "vector3.hpp"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class BinaryOperator;
+class Environment;
+class Expression;
+//---------------------------------------------------------------------------
+/// Non owning view on an array with one value per row. Input columns are only read, the const_cast is never written through.
+struct Column {
+   harriet::VariableType type;
+   void* data;
+
+   explicit Column(const int32_t* data) : type(harriet::VariableType::TInteger), data(const_cast<int32_t*>(data)) {}
+   explicit Column(const float* data) : type(harriet::VariableType::TFloat), data(const_cast<float*>(data)) {}
+   explicit Column(const bool* data) : type(harriet::VariableType::TBool), data(const_cast<bool*>(data)) {}
+   explicit Column(const Vector3<float>* data) : type(harriet::VariableType::TVector), data(const_cast<Vector3<float>*>(data)) {}
+};
+//---------------------------------------------------------------------------
+/// An expression compiled for evaluating many rows at once. Each variable is bound to a column, the kernel of every operator is chosen once
+/// at compile time from the static types and then runs over a whole block of rows. The results are the ones of the tree, row by row.
+class BatchProgram {
+public:
+   /// returns nullptr if the expression can not run in batch mode (strings, assignments), use the tree per row in this case
+   static std::unique_ptr<BatchProgram> compile(const Expression& expression, Environment& environment, KernelSet kernels = detectKernelSet());
+   ~BatchProgram();
+
+   /// the variables read by the expression, execute expects one column per variable in this order
+   const std::vector<std::string>& getVariables() const {return variables;}
+   harriet::VariableType getVariableType(uint32_t index) const {return variableTypes[index];}
+   harriet::VariableType getResultType() const;
+
+   /// registers of one executing thread, a thread can reuse its scratch for any number of execute calls
+   class Scratch {
+   public:
+      Scratch() : program(0) {}
+   private:
+      friend class BatchProgram;
+      uint64_t program; // id of the program the scratch is prepared for, addresses of destroyed programs are reused
+      std::vector<uint8_t> memory;
+      std::vector<uint8_t*> data;
+      std::vector<const void*> arguments;
+   };
+
+   /// evaluates the rows [0, rowCount) of the columns into the result column, the environment is only used to call functions
+   void execute(const std::vector<Column>& columns, Column result, uint64_t rowCount, Environment& environment) const;
+   /// evaluates the rows [begin, end), the program is not modified => threads with their own scratch can work on disjoint rows concurrently
+   void execute(const std::vector<Column>& columns, Column result, uint64_t begin, uint64_t end, Scratch& scratch, Environment& environment) const;
+   /// false if the program calls a function which is not pure, these may modify the environment and are only called from one thread
+   bool isParallelizable() const {return parallel;}
+
+private:
+   /// where the operands of a step come from
+   enum struct SlotKind : uint8_t {TColumn, TConstant, TRegister};
+
+   struct Slot {
+      SlotKind kind;
+      harriet::VariableType type;
+      uint32_t index; // into the columns, constants or registers
+   };
+
+   /// a select step runs the steps up to its end only for the rows where its condition has the given value (the rhs of a short circuit)
+   enum struct StepKind : uint8_t {TKernel, TCall, TSelectTrue, TSelectFalse};
+
+   struct Step {
+      StepKind kind;
+      BatchKernel kernel;
+      uint32_t function; // index into functions; for a select the step after its region
+      std::vector<uint32_t> arguments; // slots; for a select the condition, the slots read in the region and the registers they are gathered into
+      uint32_t result; // slot; for a select the indices of the selected rows
+   };
+
+   BatchProgram();
+   bool compileNode(const Expression& expression, Environment& environment, KernelSet kernels, uint32_t& slot);
+   uint32_t addSlot(SlotKind kind, harriet::VariableType type, uint32_t index);
+   uint32_t addStep(BatchKernel kernel, harriet::VariableType resultType, std::vector<uint32_t> arguments);
+   bool compileShortCircuit(const BinaryOperator& binary, Environment& environment, KernelSet kernels, uint32_t lhs, uint32_t& rhs);
+   void prepare(Scratch& scratch) const;
+   void run(uint32_t begin, uint32_t end, uint32_t count, Scratch& scratch, Environment& environment) const;
+   void select(const Step& step, uint32_t count, Scratch& scratch, Environment& environment) const;
+   void callFunction(const Step& step, const void* const* arguments, void* result, uint32_t count, Environment& environment) const;
+
+   std::vector<Slot> slots;
+   std::vector<Step> steps;
+   std::vector<Scalar> constants;
+   std::vector<std::string> variables;
+   std::vector<harriet::VariableType> variableTypes;
+   std::vector<uint32_t> functions;
+   uint64_t id; // unique for every program
+   uint32_t registerCount;
+   uint32_t resultSlot;
+   bool parallel;
+   std::vector<uint32_t> sharedSlots; // register of each shared sub tree compiled so far, kNoSlot otherwise
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
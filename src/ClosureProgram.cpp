@@ -0,0 +1,461 @@
+#include "ClosureProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include "NativeProgram.hpp"
+#include "Operations.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+/// state of one run of a closure program
+struct ClosureContext {
+   Environment& environment;
+   Scalar* shared; // results of the shared sub trees
+   bool* computed;
+   bool useSlots; // the environment is the one the program was compiled for and has the same variables
+   bool useBoundFunctions; // ... and the same functions
+};
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+template<class T> using Closure = function<T(ClosureContext&)>;
+//---------------------------------------------------------------------------
+/// the closure of a node, only the one of its static type is set
+struct Closures {
+   harriet::VariableType type;
+   Closure<int32_t> integer;
+   Closure<float> floating;
+   Closure<bool> boolean;
+   Closure<Vector3<float>> vector;
+};
+//---------------------------------------------------------------------------
+template<class T> Closure<T> Closures::* member();
+template<> Closure<int32_t> Closures::* member<int32_t>() {return &Closures::integer;}
+template<> Closure<float> Closures::* member<float>() {return &Closures::floating;}
+template<> Closure<bool> Closures::* member<bool>() {return &Closures::boolean;}
+template<> Closure<Vector3<float>> Closures::* member<Vector3<float>>() {return &Closures::vector;}
+//---------------------------------------------------------------------------
+template<class T>
+void set(Closures& closures, Closure<T> closure)
+{
+   closures.type = NativeType<T>::type();
+   closures.*member<T>() = ::move(closure);
+}
+//---------------------------------------------------------------------------
+template<class T>
+Closure<Scalar> box(const Closure<T>& closure)
+{
+   return [closure](ClosureContext& context) {return Scalar(closure(context));};
+}
+//---------------------------------------------------------------------------
+Closure<Scalar> box(const Closures& closures)
+{
+   switch(closures.type) {
+      case harriet::VariableType::TInteger: return box(closures.integer);
+      case harriet::VariableType::TFloat:   return box(closures.floating);
+      case harriet::VariableType::TBool:    return box(closures.boolean);
+      default:                              return box(closures.vector);
+   }
+}
+//---------------------------------------------------------------------------
+template<class T> struct ValueType;
+template<> struct ValueType<int32_t> {typedef IntegerValue type;};
+template<> struct ValueType<float> {typedef FloatValue type;};
+template<> struct ValueType<bool> {typedef BoolValue type;};
+template<> struct ValueType<Vector3<float>> {typedef VectorValue type;};
+//---------------------------------------------------------------------------
+/// thrown if a variable does not have its static type, the tree has to evaluate the expression instead
+struct TypeChanged {};
+//---------------------------------------------------------------------------
+const Value& readVariable(const string& identifier, const VariableSlot& slot, bool useSlot, const Environment& environment)
+{
+   return useSlot ? environment.read(slot) : environment.read(identifier);
+}
+//---------------------------------------------------------------------------
+template<class T>
+Closure<T> makeConstant(T value)
+{
+   return [value](ClosureContext&) {return value;};
+}
+//---------------------------------------------------------------------------
+template<class T>
+Closure<T> makeVariable(const string& identifier, const VariableSlot& slot)
+{
+   return [identifier, slot](ClosureContext& context) -> T {
+      auto& value = readVariable(identifier, slot, context.useSlots, context.environment);
+      if(value.getResultType() != NativeType<T>::type())
+         throw TypeChanged();
+      return reinterpret_cast<const typename ValueType<T>::type&>(value).result;
+   };
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+auto makeUnary(const Closure<T>& child, Closures& result, int) -> decltype(Operation::apply(declval<T>()), bool())
+{
+   typedef decltype(Operation::apply(declval<T>())) Result;
+   set<Result>(result, [child](ClosureContext& context) {return Operation::apply(child(context));});
+   return true;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+bool makeUnary(const Closure<T>& /*child*/, Closures& /*result*/, long)
+{
+   return false;
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+bool dispatchUnary(const Closures& child, Closures& result)
+{
+   switch(child.type) {
+      case harriet::VariableType::TInteger: return makeUnary<Operation>(child.integer, result, 0);
+      case harriet::VariableType::TFloat:   return makeUnary<Operation>(child.floating, result, 0);
+      case harriet::VariableType::TBool:    return makeUnary<Operation>(child.boolean, result, 0);
+      case harriet::VariableType::TVector:  return makeUnary<Operation>(child.vector, result, 0);
+      default:                              return false;
+   }
+}
+//---------------------------------------------------------------------------
+template<class T>
+bool makeCast(const Closure<T>& child, harriet::VariableType target, Closures& result)
+{
+   switch(target) {
+      case harriet::VariableType::TInteger: set<int32_t>(result, [child](ClosureContext& context) {return CastOperation::toInteger(child(context));}); return true;
+      case harriet::VariableType::TFloat:   set<float>(result, [child](ClosureContext& context) {return CastOperation::toFloat(child(context));}); return true;
+      case harriet::VariableType::TBool:    set<bool>(result, [child](ClosureContext& context) {return CastOperation::toBool(child(context));}); return true;
+      case harriet::VariableType::TVector:  set<Vector3<float>>(result, [child](ClosureContext& context) {return CastOperation::toVector(child(context));}); return true;
+      default:                              return false;
+   }
+}
+//---------------------------------------------------------------------------
+bool dispatchCast(const Closures& child, harriet::VariableType target, Closures& result)
+{
+   switch(child.type) {
+      case harriet::VariableType::TInteger: return makeCast(child.integer, target, result);
+      case harriet::VariableType::TFloat:   return makeCast(child.floating, target, result);
+      case harriet::VariableType::TBool:    return makeCast(child.boolean, target, result);
+      case harriet::VariableType::TVector:  return makeCast(child.vector, target, result);
+      default:                              return false;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+auto makeBinary(const Closure<L>& lhs, const Closure<R>& rhs, Closures& result, int) -> decltype(Operation::apply(declval<L>(), declval<R>()), bool())
+{
+   typedef decltype(Operation::apply(declval<L>(), declval<R>())) Result;
+   set<Result>(result, [lhs, rhs](ClosureContext& context) -> Result {
+      L left = lhs(context); // same order as the tree
+      return Operation::apply(left, rhs(context));
+   });
+   return true;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+bool makeBinary(const Closure<L>& /*lhs*/, const Closure<R>& /*rhs*/, Closures& /*result*/, long)
+{
+   return false;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L>
+bool dispatchRhs(const Closure<L>& lhs, const Closures& rhs, Closures& result)
+{
+   switch(rhs.type) {
+      case harriet::VariableType::TInteger: return makeBinary<Operation>(lhs, rhs.integer, result, 0);
+      case harriet::VariableType::TFloat:   return makeBinary<Operation>(lhs, rhs.floating, result, 0);
+      case harriet::VariableType::TBool:    return makeBinary<Operation>(lhs, rhs.boolean, result, 0);
+      case harriet::VariableType::TVector:  return makeBinary<Operation>(lhs, rhs.vector, result, 0);
+      default:                              return false;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+bool dispatchBinary(const Closures& lhs, const Closures& rhs, Closures& result)
+{
+   switch(lhs.type) {
+      case harriet::VariableType::TInteger: return dispatchRhs<Operation>(lhs.integer, rhs, result);
+      case harriet::VariableType::TFloat:   return dispatchRhs<Operation>(lhs.floating, rhs, result);
+      case harriet::VariableType::TBool:    return dispatchRhs<Operation>(lhs.boolean, rhs, result);
+      case harriet::VariableType::TVector:  return dispatchRhs<Operation>(lhs.vector, rhs, result);
+      default:                              return false;
+   }
+}
+//---------------------------------------------------------------------------
+template<class T>
+Closure<T> makeCall(uint32_t functionIdentifier, const Function* boundFunction, vector<Closure<Scalar>> arguments)
+{
+   return [functionIdentifier, boundFunction, arguments](ClosureContext& context) -> T {
+      // the argument types are only checked if the function may have been replaced since compiling (see FunctionOperator::callUnboxed)
+      bool bound = context.useBoundFunctions;
+      auto& function = bound ? *boundFunction : *context.environment.getFunction(functionIdentifier);
+      Function::ScalarArguments argv(arguments.size());
+      for(uint32_t i=0; i<arguments.size(); i++)
+         argv[i] = arguments[i](context);
+      Scalar result = function.executeCall(argv.data(), !bound, context.environment);
+      if(result.type != NativeType<T>::type())
+         throw harriet::Exception{"function '" + function.getName() + "' returned '" + harriet::typeToName(result.type) + "' instead of '" + harriet::typeToName(NativeType<T>::type()) + "'"};
+      return NativeType<T>::unbox(result);
+   };
+}
+//---------------------------------------------------------------------------
+template<class T>
+Closure<T> makeShared(const Closure<T>& child, uint32_t index)
+{
+   return [child, index](ClosureContext& context) -> T {
+      if(context.computed[index])
+         return NativeType<T>::unbox(context.shared[index]);
+      T result = child(context);
+      context.shared[index] = Scalar(result);
+      context.computed[index] = true;
+      return result;
+   };
+}
+//---------------------------------------------------------------------------
+/// state while compiling one expression
+struct Compilation {
+   Environment& environment;
+   vector<const Variable*> variables; // only used while compiling, the closures copy what they need
+   vector<Closures> shared; // closures of the shared sub trees, type TString if not compiled yet
+   bool pure;
+};
+//---------------------------------------------------------------------------
+bool compileNode(const Expression& expression, Compilation& compilation, Closures& result)
+{
+   if(expression.getResultType() == harriet::VariableType::TString)
+      return false;
+
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TValue: {
+         Scalar value = Scalar::fromValue(reinterpret_cast<const Value&>(expression));
+         switch(value.type) {
+            case harriet::VariableType::TInteger: set(result, makeConstant(value.integer)); return true;
+            case harriet::VariableType::TFloat:   set(result, makeConstant(value.floating)); return true;
+            case harriet::VariableType::TBool:    set(result, makeConstant(value.boolean)); return true;
+            default:                              set(result, makeConstant(value.getVector())); return true;
+         }
+      }
+      case ExpressionType::TVariable: {
+         auto& variable = reinterpret_cast<const Variable&>(expression);
+         VariableSlot slot;
+         if(!compilation.environment.resolve(variable.getIdentifier(), slot))
+            return false;
+         if(none_of(compilation.variables.begin(), compilation.variables.end(), [&variable](const Variable* iter) {return iter->getIdentifier()==variable.getIdentifier();}))
+            compilation.variables.push_back(&variable);
+         switch(variable.getResultType()) {
+            case harriet::VariableType::TInteger: set(result, makeVariable<int32_t>(variable.getIdentifier(), slot)); return true;
+            case harriet::VariableType::TFloat:   set(result, makeVariable<float>(variable.getIdentifier(), slot)); return true;
+            case harriet::VariableType::TBool:    set(result, makeVariable<bool>(variable.getIdentifier(), slot)); return true;
+            case harriet::VariableType::TVector:  set(result, makeVariable<Vector3<float>>(variable.getIdentifier(), slot)); return true;
+            default:                              return false;
+         }
+      }
+      case ExpressionType::TUnaryOperator: {
+         auto& unary = reinterpret_cast<const UnaryOperator&>(expression);
+         Closures child;
+         if(!compileNode(unary.getChild(), compilation, child))
+            return false;
+         bool compiled;
+         switch(unary.getOperatorType()) {
+            case OperatorType::TUnaryMinus: compiled = dispatchUnary<InvOperation>(child, result); break;
+            case OperatorType::TNot:        compiled = dispatchUnary<NotOperation>(child, result); break;
+            case OperatorType::TCast:       compiled = dispatchCast(child, reinterpret_cast<const CastOperator&>(unary).getCastType(), result); break;
+            default:                        compiled = false; break;
+         }
+         return compiled && result.type==unary.getResultType();
+      }
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+         if(binary.getOperatorType() == OperatorType::TAssignment)
+            return false; // the static types of the variables would change
+         Closures lhs, rhs;
+         if(!compileNode(binary.getLhs(), compilation, lhs) || !compileNode(binary.getRhs(), compilation, rhs))
+            return false;
+
+         // the short circuit of bools, the static types hold at run time
+         bool logic = binary.getOperatorType()==OperatorType::TAnd || binary.getOperatorType()==OperatorType::TOr;
+         if(logic && reinterpret_cast<const LogicOperator&>(binary).isShortCircuit() && lhs.type==harriet::VariableType::TBool && rhs.type==harriet::VariableType::TBool) {
+            auto left = lhs.boolean;
+            auto right = rhs.boolean;
+            if(binary.getOperatorType() == OperatorType::TAnd)
+               set<bool>(result, [left, right](ClosureContext& context) {return left(context) && right(context);}); else
+               set<bool>(result, [left, right](ClosureContext& context) {return left(context) || right(context);});
+            return true;
+         }
+
+         bool compiled;
+         switch(binary.getOperatorType()) {
+            case OperatorType::TPlus:           compiled = dispatchBinary<AddOperation>(lhs, rhs, result); break;
+            case OperatorType::TMinus:          compiled = dispatchBinary<SubOperation>(lhs, rhs, result); break;
+            case OperatorType::TMultiplication: compiled = dispatchBinary<MulOperation>(lhs, rhs, result); break;
+            case OperatorType::TDivision:       compiled = dispatchBinary<DivOperation>(lhs, rhs, result); break;
+            case OperatorType::TModulo:         compiled = dispatchBinary<ModOperation>(lhs, rhs, result); break;
+            case OperatorType::TExponentiation: compiled = dispatchBinary<ExpOperation>(lhs, rhs, result); break;
+            case OperatorType::TAnd:            compiled = dispatchBinary<AndOperation>(lhs, rhs, result); break;
+            case OperatorType::TOr:             compiled = dispatchBinary<OrOperation>(lhs, rhs, result); break;
+            case OperatorType::TGreater:        compiled = dispatchBinary<GtOperation>(lhs, rhs, result); break;
+            case OperatorType::TLess:           compiled = dispatchBinary<LtOperation>(lhs, rhs, result); break;
+            case OperatorType::TGreaterEqual:   compiled = dispatchBinary<GeqOperation>(lhs, rhs, result); break;
+            case OperatorType::TLessEqual:      compiled = dispatchBinary<LeqOperation>(lhs, rhs, result); break;
+            case OperatorType::TEqual:          compiled = dispatchBinary<EqOperation>(lhs, rhs, result); break;
+            case OperatorType::TNotEqual:       compiled = dispatchBinary<NeqOperation>(lhs, rhs, result); break;
+            default:                            compiled = false; break;
+         }
+         return compiled && result.type==binary.getResultType();
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         auto function = compilation.environment.getFunction(call.getFunctionIdentifier());
+         vector<Closure<Scalar>> arguments;
+         for(uint32_t i=0; i<call.getArguments().size(); i++) {
+            Closures argument;
+            if(!compileNode(*call.getArguments()[i], compilation, argument) || argument.type!=function->getArgumentType(i))
+               return false;
+            arguments.push_back(box(argument));
+         }
+         compilation.pure &= function->isPure();
+         switch(function->getResultType()) {
+            case harriet::VariableType::TInteger: set(result, makeCall<int32_t>(call.getFunctionIdentifier(), function, ::move(arguments))); return true;
+            case harriet::VariableType::TFloat:   set(result, makeCall<float>(call.getFunctionIdentifier(), function, ::move(arguments))); return true;
+            case harriet::VariableType::TBool:    set(result, makeCall<bool>(call.getFunctionIdentifier(), function, ::move(arguments))); return true;
+            case harriet::VariableType::TVector:  set(result, makeCall<Vector3<float>>(call.getFunctionIdentifier(), function, ::move(arguments))); return true;
+            default:                              return false;
+         }
+      }
+      case ExpressionType::TShared: {
+         // all occurrences use the same closure, the first one called computes the result
+         auto& shared = reinterpret_cast<const SharedExpression&>(expression);
+         if(shared.getIndex() >= compilation.shared.size())
+            compilation.shared.resize(shared.getIndex()+1, Closures{harriet::VariableType::TString, nullptr, nullptr, nullptr, nullptr});
+         if(compilation.shared[shared.getIndex()].type != harriet::VariableType::TString) {
+            result = compilation.shared[shared.getIndex()];
+            return true;
+         }
+         Closures child;
+         if(!compileNode(shared.getChild(), compilation, child))
+            return false;
+         switch(child.type) {
+            case harriet::VariableType::TInteger: set(result, makeShared(child.integer, shared.getIndex())); break;
+            case harriet::VariableType::TFloat:   set(result, makeShared(child.floating, shared.getIndex())); break;
+            case harriet::VariableType::TBool:    set(result, makeShared(child.boolean, shared.getIndex())); break;
+            default:                              set(result, makeShared(child.vector, shared.getIndex())); break;
+         }
+         compilation.shared[shared.getIndex()] = result;
+         return true;
+      }
+      case ExpressionType::TSharedScope:
+         return compileNode(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), compilation, result);
+      case ExpressionType::TCompiled:
+         return compileNode(reinterpret_cast<const CompiledExpression&>(expression).getTree(), compilation, result);
+      default:
+         return false;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+ClosureProgram::ClosureProgram()
+: boundEnvironment(0)
+, boundLayoutVersion(0)
+, boundFunctionVersion(0)
+, resultType(harriet::VariableType::TInteger)
+, sharedCount(0)
+, pure(true)
+{
+}
+//---------------------------------------------------------------------------
+ClosureProgram::~ClosureProgram()
+{
+}
+//---------------------------------------------------------------------------
+unique_ptr<ClosureProgram> ClosureProgram::compile(const Expression& expression, Environment& environment)
+{
+   Compilation compilation{environment, {}, {}, true};
+   Closures closures;
+   if(!compileNode(expression, compilation, closures))
+      return nullptr;
+
+   unique_ptr<ClosureProgram> program(new ClosureProgram());
+   program->root = box(closures);
+   for(auto variable : compilation.variables) {
+      VariableReference reference{variable->getIdentifier(), VariableSlot{0, 0}, variable->getResultType()};
+      environment.resolve(reference.identifier, reference.slot);
+      program->variables.push_back(reference);
+   }
+   program->boundEnvironment = environment.getId();
+   program->boundLayoutVersion = environment.getLayoutVersion();
+   program->boundFunctionVersion = environment.getFunctionVersion();
+   program->resultType = closures.type;
+   program->sharedCount = compilation.shared.size();
+   program->pure = compilation.pure;
+   return program;
+}
+//---------------------------------------------------------------------------
+bool ClosureProgram::execute(Environment& environment, Scalar& result) const
+{
+   // functions which are not pure may change variables => check them before anything is called
+   bool useSlots = boundEnvironment==environment.getId() && boundLayoutVersion==environment.getLayoutVersion();
+   bool useBoundFunctions = boundEnvironment==environment.getId() && boundFunctionVersion==environment.getFunctionVersion();
+   if(!pure)
+      for(auto& variable : variables)
+         if(readVariable(variable.identifier, variable.slot, useSlots, environment).getResultType() != variable.type)
+            return false;
+
+   const uint32_t kInlineSharedCount = 16;
+   Scalar inlineShared[kInlineSharedCount];
+   bool inlineComputed[kInlineSharedCount];
+   vector<Scalar> heapShared;
+   unique_ptr<bool[]> heapComputed;
+   ClosureContext context{environment, inlineShared, inlineComputed, useSlots, useBoundFunctions};
+   if(sharedCount > kInlineSharedCount) {
+      heapShared.resize(sharedCount);
+      heapComputed.reset(new bool[sharedCount]);
+      context.shared = heapShared.data();
+      context.computed = heapComputed.get();
+   }
+   fill(context.computed, context.computed + sharedCount, false);
+
+   try {
+      result = root(context);
+      return true;
+   } catch(const TypeChanged&) {
+      if(!pure)
+         throw harriet::Exception{"a variable changed its type during the evaluation"}; // the tree would call the functions again
+      return false;
+   }
+}
+//---------------------------------------------------------------------------
+ClosureExpression::ClosureExpression(unique_ptr<Expression> tree, unique_ptr<ClosureProgram> program, unique_ptr<NativeProgram> native)
+: CompiledExpression(::move(tree))
+, program(::move(program))
+, native(::move(native))
+{
+}
+//---------------------------------------------------------------------------
+ClosureExpression::~ClosureExpression()
+{
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> ClosureExpression::evaluate(Environment& environment) const
+{
+   Scalar result;
+   if((native!=nullptr && native->execute(environment, result)) || (program!=nullptr && program->execute(environment, result)))
+      return result.toValue();
+   return tree->evaluate(environment);
+}
+//---------------------------------------------------------------------------
+Scalar ClosureExpression::evaluateScalar(Environment& environment) const
+{
+   Scalar result;
+   if((native!=nullptr && native->execute(environment, result)) || (program!=nullptr && program->execute(environment, result)))
+      return result;
+   return tree->evaluateScalar(environment);
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,72 @@
+#ifndef SCRIPTLANGUAGE_CLOSUREPROGRAM_HPP_
+#define SCRIPTLANGUAGE_CLOSUREPROGRAM_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Scalar.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class NativeProgram;
+struct ClosureContext;
+//---------------------------------------------------------------------------
+/// An expression compiled into a chain of closures. Every node becomes a lambda specialised for the static types of its operands (an int+int
+/// add adds two int32_t), so the evaluation is a chain of indirect calls without type switches and without allocating values. The closures
+/// rely on the variables having their static types, the caller falls back to the tree if they do not. Identifiers, slots and functions are
+/// copied from the expression while compiling, the program can be kept after the expression is destroyed.
+class ClosureProgram {
+public:
+   /// returns nullptr if the expression can not be compiled (strings, assignments), use the tree in this case
+   static std::unique_ptr<ClosureProgram> compile(const Expression& expression, Environment& environment);
+   ~ClosureProgram();
+
+   /// false if a variable does not have the type it had while compiling, nothing is evaluated in this case
+   bool execute(Environment& environment, Scalar& result) const;
+
+   harriet::VariableType getResultType() const {return resultType;}
+
+private:
+   ClosureProgram();
+
+   struct VariableReference {
+      std::string identifier;
+      VariableSlot slot;
+      harriet::VariableType type;
+   };
+
+   std::function<Scalar(ClosureContext&)> root;
+   std::vector<VariableReference> variables; // with their static types, checked before the run if a function could change them
+   uint64_t boundEnvironment; // slots and resolved functions are only used if the program runs in the environment it was compiled for
+   uint64_t boundLayoutVersion;
+   uint64_t boundFunctionVersion;
+   harriet::VariableType resultType;
+   uint32_t sharedCount;
+   bool pure;
+};
+//---------------------------------------------------------------------------
+/// The tree of an expression together with its closures and its native code, either may be missing. Evaluating it runs the native code,
+/// else the closures; the tree is only used if the variables changed their types since parsing (see harriet::parse with a Backend).
+class ClosureExpression : public CompiledExpression {
+public:
+   ClosureExpression(std::unique_ptr<Expression> tree, std::unique_ptr<ClosureProgram> program, std::unique_ptr<NativeProgram> native = nullptr);
+   virtual ~ClosureExpression();
+   virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
+protected:
+   std::unique_ptr<ClosureProgram> program;
+   std::unique_ptr<NativeProgram> native;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,346 @@
+#include "CppGenerator.hpp"
+#include "ClosureProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <unordered_set>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// a float literal which reads back as the same float (9 significant digits are enough)
+string floatLiteral(float value)
+{
+   if(std::isnan(value))
+      return "std::numeric_limits<float>::quiet_NaN()";
+   if(std::isinf(value))
+      return value<0 ? "(-std::numeric_limits<float>::infinity())" : "std::numeric_limits<float>::infinity()";
+   char buffer[32];
+   snprintf(buffer, sizeof(buffer), "%.9g", value);
+   string result = buffer;
+   if(result.find_first_of(".e") == string::npos)
+      result += ".0";
+   return value<0 ? "(" + result + "f)" : result + "f";
+}
+//---------------------------------------------------------------------------
+string integerLiteral(int32_t value)
+{
+   if(value == numeric_limits<int32_t>::min())
+      return "(-2147483647-1)";
+   return value<0 ? "(" + to_string(value) + ")" : to_string(value);
+}
+//---------------------------------------------------------------------------
+string literal(const Value& value)
+{
+   switch(value.getResultType()) {
+      case harriet::VariableType::TInteger: return integerLiteral(reinterpret_cast<const IntegerValue&>(value).result);
+      case harriet::VariableType::TFloat:   return floatLiteral(reinterpret_cast<const FloatValue&>(value).result);
+      case harriet::VariableType::TBool:    return reinterpret_cast<const BoolValue&>(value).result ? "true" : "false";
+      case harriet::VariableType::TVector: {
+         auto& vector = reinterpret_cast<const VectorValue&>(value).result;
+         return "harriet::Vector3<float>(" + floatLiteral(vector.x) + ", " + floatLiteral(vector.y) + ", " + floatLiteral(vector.z) + ")";
+      }
+      default:
+         throw harriet::Exception{"strings can not be translated to c++"};
+   }
+}
+//---------------------------------------------------------------------------
+const char* operationName(OperatorType operatorType)
+{
+   switch(operatorType) {
+      case OperatorType::TPlus:           return "AddOperation";
+      case OperatorType::TMinus:          return "SubOperation";
+      case OperatorType::TMultiplication: return "MulOperation";
+      case OperatorType::TDivision:       return "DivOperation";
+      case OperatorType::TModulo:         return "ModOperation";
+      case OperatorType::TExponentiation: return "ExpOperation";
+      case OperatorType::TAnd:            return "AndOperation";
+      case OperatorType::TOr:             return "OrOperation";
+      case OperatorType::TGreater:        return "GtOperation";
+      case OperatorType::TLess:           return "LtOperation";
+      case OperatorType::TGreaterEqual:   return "GeqOperation";
+      case OperatorType::TLessEqual:      return "LeqOperation";
+      case OperatorType::TEqual:          return "EqOperation";
+      case OperatorType::TNotEqual:       return "NeqOperation";
+      case OperatorType::TUnaryMinus:     return "InvOperation";
+      case OperatorType::TNot:            return "NotOperation";
+      default:                            throw harriet::Exception{"assignments can not be translated to c++"};
+   }
+}
+//---------------------------------------------------------------------------
+const char* castName(harriet::VariableType type)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return "toInteger";
+      case harriet::VariableType::TFloat:   return "toFloat";
+      case harriet::VariableType::TBool:    return "toBool";
+      case harriet::VariableType::TVector:  return "toVector";
+      default:                              throw harriet::Exception{"strings can not be translated to c++"};
+   }
+}
+//---------------------------------------------------------------------------
+/// keywords (up to c++20) and the names the generated code refers to without qualification
+const unordered_set<string> reservedNames = {
+   "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "char8_t", "char16_t",
+   "char32_t", "class", "co_await", "co_return", "co_yield", "compl", "concept", "const", "consteval", "constexpr", "constinit", "const_cast",
+   "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float",
+   "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or",
+   "or_eq", "private", "protected", "public", "register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static",
+   "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+   "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+   "harriet", "std", "int32_t"
+};
+/// prefix of the temporaries, no identifier of the script may start with it
+const string temporaryPrefix = "harriet_t";
+//---------------------------------------------------------------------------
+void collectVariables(const Expression& expression, vector<string>& variables)
+{
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TVariable: {
+         auto& identifier = reinterpret_cast<const Variable&>(expression).getIdentifier();
+         if(find(variables.begin(), variables.end(), identifier) == variables.end())
+            variables.push_back(identifier);
+         return;
+      }
+      case ExpressionType::TUnaryOperator:
+         return collectVariables(reinterpret_cast<const UnaryOperator&>(expression).getChild(), variables);
+      case ExpressionType::TBinaryOperator:
+         collectVariables(reinterpret_cast<const BinaryOperator&>(expression).getLhs(), variables);
+         return collectVariables(reinterpret_cast<const BinaryOperator&>(expression).getRhs(), variables);
+      case ExpressionType::TFunctionOperator:
+         for(auto& argument : reinterpret_cast<const FunctionOperator&>(expression).getArguments())
+            collectVariables(*argument, variables);
+         return;
+      case ExpressionType::TShared:
+         return collectVariables(reinterpret_cast<const SharedExpression&>(expression).getChild(), variables);
+      case ExpressionType::TSharedScope:
+         return collectVariables(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), variables);
+      case ExpressionType::TCompiled:
+         return collectVariables(reinterpret_cast<const CompiledExpression&>(expression).getTree(), variables);
+      default:
+         return;
+   }
+}
+//---------------------------------------------------------------------------
+/// statements computing the operators in the order of the tree, one constant per operator; literals and variables are used directly
+/// Shared sub trees are computed once per block (the function body and the rhs of each short circuit operator): the ones a block evaluates
+/// unconditionally are declared at its start, unless an enclosing block already has them. They are pure, so computing them first does not
+/// change the result, and the rhs of a short circuit only computes the ones it needs.
+struct Emitter {
+   const Environment& environment;
+   string code;
+   uint32_t next;
+   vector<string> sharedNames; // temporary of each shared sub tree by its index, empty if not computed in an enclosing block
+   vector<uint32_t> visibleShared; // indices with a temporary, in the order they were declared
+
+   /// the shared sub trees the expression evaluates unconditionally which have no temporary yet, the ones inside of them first
+   void collectShared(const Expression& expression, vector<const SharedExpression*>& shared) {
+      switch(expression.getExpressionType()) {
+         case ExpressionType::TUnaryOperator:
+            return collectShared(reinterpret_cast<const UnaryOperator&>(expression).getChild(), shared);
+         case ExpressionType::TBinaryOperator: {
+            auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+            collectShared(binary.getLhs(), shared);
+            bool logic = binary.getOperatorType()==OperatorType::TAnd || binary.getOperatorType()==OperatorType::TOr;
+            if(!logic || !reinterpret_cast<const LogicOperator&>(binary).isShortCircuit())
+               collectShared(binary.getRhs(), shared);
+            return;
+         }
+         case ExpressionType::TFunctionOperator:
+            for(auto& argument : reinterpret_cast<const FunctionOperator&>(expression).getArguments())
+               collectShared(*argument, shared);
+            return;
+         case ExpressionType::TShared: {
+            auto& occurrence = reinterpret_cast<const SharedExpression&>(expression);
+            if(hasTemporary(occurrence.getIndex()))
+               return;
+            for(auto iter : shared)
+               if(iter->getIndex() == occurrence.getIndex())
+                  return;
+            collectShared(occurrence.getChild(), shared);
+            shared.push_back(&occurrence);
+            return;
+         }
+         case ExpressionType::TSharedScope:
+            return collectShared(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), shared);
+         case ExpressionType::TCompiled:
+            return collectShared(reinterpret_cast<const CompiledExpression&>(expression).getTree(), shared);
+         default:
+            return;
+      }
+   }
+
+   bool hasTemporary(uint32_t index) const {
+      return index<sharedNames.size() && !sharedNames[index].empty();
+   }
+
+   /// the statements of a block evaluating the expression, the temporaries of its shared sub trees end with the block
+   string emitBlock(const Expression& expression, const string& indentation) {
+      uint32_t outerShared = visibleShared.size();
+      vector<const SharedExpression*> shared;
+      collectShared(expression, shared);
+      for(auto occurrence : shared) {
+         string name = emit(occurrence->getChild(), indentation);
+         if(sharedNames.size() <= occurrence->getIndex())
+            sharedNames.resize(occurrence->getIndex()+1);
+         sharedNames[occurrence->getIndex()] = name;
+         visibleShared.push_back(occurrence->getIndex());
+      }
+      string result = emit(expression, indentation);
+      for(uint32_t i=outerShared; i<visibleShared.size(); i++)
+         sharedNames[visibleShared[i]].clear();
+      visibleShared.resize(outerShared);
+      return result;
+   }
+
+   string temporary() {
+      return temporaryPrefix + to_string(next++);
+   }
+
+   string declare(harriet::VariableType type, const string& value, const string& indentation) {
+      string name = temporary();
+      code += indentation + "const " + CppGenerator::typeName(type) + " " + name + " = " + value + ";\n";
+      return name;
+   }
+
+   string emit(const Expression& expression, const string& indentation) {
+      if(expression.getResultType() == harriet::VariableType::TString)
+         throw harriet::Exception{"strings can not be translated to c++"};
+
+      switch(expression.getExpressionType()) {
+         case ExpressionType::TValue:
+            return literal(reinterpret_cast<const Value&>(expression));
+         case ExpressionType::TVariable: {
+            auto& identifier = reinterpret_cast<const Variable&>(expression).getIdentifier();
+            CppGenerator::checkIdentifier(identifier);
+            return identifier;
+         }
+         case ExpressionType::TUnaryOperator: {
+            auto& unary = reinterpret_cast<const UnaryOperator&>(expression);
+            string child = emit(unary.getChild(), indentation);
+            if(unary.getOperatorType() == OperatorType::TCast)
+               return declare(unary.getResultType(), string("harriet::CastOperation::") + castName(unary.getResultType()) + "(" + child + ")", indentation);
+            return declare(unary.getResultType(), string("harriet::") + operationName(unary.getOperatorType()) + "::apply(" + child + ")", indentation);
+         }
+         case ExpressionType::TBinaryOperator: {
+            auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+            const char* operation = operationName(binary.getOperatorType());
+            string lhs = emit(binary.getLhs(), indentation);
+            bool logic = binary.getOperatorType()==OperatorType::TAnd || binary.getOperatorType()==OperatorType::TOr;
+            if(logic && reinterpret_cast<const LogicOperator&>(binary).isShortCircuit()) {
+               // the rhs only runs if the lhs does not decide the result
+               string name = temporary();
+               code += indentation + "bool " + name + " = " + lhs + ";\n";
+               code += indentation + (binary.getOperatorType()==OperatorType::TAnd ? "if(" : "if(!") + name + ") {\n";
+               string rhs = emitBlock(binary.getRhs(), indentation + "   ");
+               code += indentation + "   " + name + " = " + rhs + ";\n";
+               code += indentation + "}\n";
+               return name;
+            }
+            string rhs = emit(binary.getRhs(), indentation);
+            return declare(binary.getResultType(), string("harriet::") + operation + "::apply(" + lhs + ", " + rhs + ")", indentation);
+         }
+         case ExpressionType::TFunctionOperator: {
+            auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+            vector<string> arguments;
+            for(auto& argument : call.getArguments())
+               arguments.push_back(emit(*argument, indentation));
+            auto& name = environment.getFunction(call.getFunctionIdentifier())->getName();
+            CppGenerator::checkIdentifier(name);
+            string value = name + "(";
+            for(uint32_t i=0; i<arguments.size(); i++)
+               value += (i==0 ? "" : ", ") + arguments[i];
+            return declare(call.getResultType(), value + ")", indentation);
+         }
+         case ExpressionType::TShared: {
+            // computed at the start of this or an enclosing block (emitBlock), the c++ compiler can not merge calls of functions
+            auto& occurrence = reinterpret_cast<const SharedExpression&>(expression);
+            if(!hasTemporary(occurrence.getIndex()))
+               throw harriet::Exception{"shared sub expression is used outside of its block"};
+            return sharedNames[occurrence.getIndex()];
+         }
+         case ExpressionType::TSharedScope:
+            return emit(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), indentation);
+         case ExpressionType::TCompiled:
+            return emit(reinterpret_cast<const CompiledExpression&>(expression).getTree(), indentation);
+         default:
+            throw harriet::Exception{"unable to translate expression to c++"};
+      }
+   }
+};
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+string CppGenerator::typeName(harriet::VariableType type)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return "int32_t";
+      case harriet::VariableType::TFloat:   return "float";
+      case harriet::VariableType::TBool:    return "bool";
+      case harriet::VariableType::TVector:  return "harriet::Vector3<float>";
+      default:                              throw harriet::Exception{"strings can not be translated to c++"};
+   }
+}
+//---------------------------------------------------------------------------
+void CppGenerator::checkIdentifier(const string& identifier)
+{
+   bool valid = !identifier.empty() && !isdigit(static_cast<unsigned char>(identifier[0]));
+   for(unsigned char c : identifier)
+      valid &= isalnum(c) || c=='_';
+   if(!valid)
+      throw harriet::Exception{"'" + identifier + "' is not a valid c++ identifier"};
+   if(reservedNames.count(identifier) != 0)
+      throw harriet::Exception{"'" + identifier + "' is reserved in c++"};
+   // names with a double underscore or an underscore followed by an upper case letter are reserved for the c++ implementation
+   if(identifier.find("__")!=string::npos || (identifier[0]=='_' && identifier.size()>1 && isupper(static_cast<unsigned char>(identifier[1]))))
+      throw harriet::Exception{"'" + identifier + "' is reserved in c++"};
+   if(identifier.compare(0, temporaryPrefix.size(), temporaryPrefix) == 0)
+      throw harriet::Exception{"'" + identifier + "' starts with '" + temporaryPrefix + "', which is reserved for temporaries"};
+}
+//---------------------------------------------------------------------------
+string CppGenerator::translate(const Expression& expression, const Environment& environment, const string& indentation)
+{
+   Emitter emitter{environment, "", 0, {}, {}};
+   string result = emitter.emitBlock(expression, indentation);
+   return emitter.code + indentation + "return " + result + ";\n";
+}
+//---------------------------------------------------------------------------
+string CppGenerator::generateFunction(const string& name, const Expression& expression, const Environment& environment, const vector<string>& parameters)
+{
+   checkIdentifier(name);
+   auto variables = getVariables(expression);
+   string result = "inline " + typeName(expression.getResultType()) + " " + name + "(";
+   bool first = true;
+   for(auto& parameter : parameters) {
+      if(find(variables.begin(), variables.end(), parameter) == variables.end())
+         continue;
+      result += (first ? "" : ", ") + typeName(environment.read(parameter).getResultType()) + " " + parameter;
+      first = false;
+   }
+   for(auto& variable : variables)
+      if(find(parameters.begin(), parameters.end(), variable) == parameters.end())
+         throw harriet::Exception{"variable '" + variable + "' is not a parameter of '" + name + "'"};
+   return result + ")\n{\n" + translate(expression, environment, "   ") + "}\n";
+}
+//---------------------------------------------------------------------------
+vector<string> CppGenerator::getVariables(const Expression& expression)
+{
+   vector<string> variables;
+   collectVariables(expression, variables);
+   return variables;
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
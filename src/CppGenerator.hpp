@@ -0,0 +1,40 @@
+#ifndef SCRIPTLANGUAGE_CPPGENERATOR_HPP_
+#define SCRIPTLANGUAGE_CPPGENERATOR_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class Expression;
+//---------------------------------------------------------------------------
+/// Translates parsed (typed and cast inserted) expressions into C++ source. Every operator becomes a call of its overload in Operations.hpp,
+/// so the generated code computes exactly what the interpreter computes while the C++ compiler only sees inlinable arithmetic on int32_t,
+/// float, bool and Vector3<float>. Each operator gets its own statement (a temporary named harriet_t<n>), which keeps the evaluation order
+/// of the tree; shared sub expressions (ExpressionOptimizer) are computed once, ahead of the first statement that always needs them.
+/// Variables become identifiers and functions calls of c++ functions with the same name (see samples/harrietc), so their names have to pass
+/// checkIdentifier.
+class CppGenerator {
+public:
+   /// throws harriet::Exception if the identifier can not be used as is in the generated code: c++ keywords, names reserved for the
+   /// implementation, names the generated code uses (harriet, std, int32_t) and the prefix of the temporaries
+   static void checkIdentifier(const std::string& identifier);
+   /// the c++ type of a script type, throws for strings
+   static std::string typeName(harriet::VariableType type);
+   /// the statements of a function body returning the expression, throws for strings and assignments
+   static std::string translate(const Expression& expression, const Environment& environment, const std::string& indentation);
+   /// an inline function returning the expression, the variables read by it are passed as the parameters (in the given order)
+   static std::string generateFunction(const std::string& name, const Expression& expression, const Environment& environment, const std::vector<std::string>& parameters);
+   /// identifiers of the variables read by the expression in order of their first use
+   static std::vector<std::string> getVariables(const Expression& expression);
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
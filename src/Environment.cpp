@@ -2,9 +2,14 @@
 #include "Environment.hpp"
 #include "Expression.hpp"
 #include "Function.hpp"
+#include "EvaluationArena.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <unordered_set>
 //---------------------------------------------------------------------------
 // Harriet Script Language
 // Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
@@ -14,65 +19,206 @@ using namespace std;
 //---------------------------------------------------------------------------
 namespace harriet {
 //---------------------------------------------------------------------------
+namespace {
+   atomic<uint64_t> nextEnvironmentId(1);
+
+   /// names of all functions ever added, the nodes of the set do not move => a name is identified by the address of its string
+   /// lookups only read the current snapshot (the names sorted by their strings), adding a name publishes a new one. Readers may still use
+   /// the old snapshots, they are kept until exit; new names are rare (only functions with a new name add one).
+   struct FunctionNames {
+      typedef vector<const string*> Snapshot;
+      std::mutex mutex; // for adding names
+      unordered_set<string> names;
+      vector<unique_ptr<Snapshot>> snapshots;
+      atomic<const Snapshot*> current;
+      FunctionNames() : current(nullptr) {}
+   };
+   bool lessName(const string* lhs, const string& rhs) {return *lhs < rhs;}
+   FunctionNames& getFunctionNames() {static FunctionNames functionNames; return functionNames;} // also for environments of static objects
+   uint64_t combine(uint64_t seed, uint64_t value) {return (seed ^ value) * 0x100000001b3ull;}
+   uint64_t finish(uint64_t hash) {hash ^= hash >> 33; hash *= 0xff51afd7ed558ccdull; hash ^= hash >> 33; return hash;}
+
+   uint64_t hashVariable(const string& identifier, harriet::VariableType type)
+   {
+      return finish(combine(hash<string>()(identifier), static_cast<uint64_t>(type)));
+   }
+
+   uint64_t hashFunction(const Function& function)
+   {
+      uint64_t result = combine(combine(combine(combine(hash<string>()(function.getName()), function.getId()), function.getSerial()), function.isPure()), static_cast<uint64_t>(function.getResultType()));
+      for(uint32_t i=0; i<function.getArgumentCount(); i++)
+         result = combine(result, static_cast<uint64_t>(function.getArgumentType(i)));
+      return finish(result);
+   }
+}
+//---------------------------------------------------------------------------
 Environment::Environment(Environment* parentEnvironment)
 : parent(parentEnvironment)
+, id(nextEnvironmentId++)
+, layoutVersion(0)
+, functionVersion(0)
+, localEpoch(0)
+, localSignature(0)
+, functionIdEnd(0)
 {
+   if(parent != nullptr) {
+      lock_guard<std::mutex> lock(parent->childrenMutex);
+      parent->children.push_back(this);
+   }
 }
 //---------------------------------------------------------------------------
 Environment::~Environment()
 {
+   if(parent != nullptr) {
+      lock_guard<std::mutex> lock(parent->childrenMutex);
+      parent->children.erase(find(parent->children.begin(), parent->children.end(), this));
+   }
 }
 //---------------------------------------------------------------------------
 void Environment::add(const string& identifier, unique_ptr<Value> value)
 {
-   assert(none_of(data.begin(), data.end(), [&identifier](const pair<string,unique_ptr<Value>>& iter){return iter.first==identifier;}));
-   data.push_back(make_pair(identifier, ::move(value)));
+   assert(variableIndex.count(identifier) == 0);
+   variableIndex.insert(make_pair(identifier, static_cast<uint32_t>(data.size())));
+   data.push_back(make_pair(identifier, EvaluationArena::promote(::move(value), *this)));
+   changeVersions(true); // may also change the type of an argument
+   localEpoch++;
+   localSignature += hashVariable(identifier, data.back().second->getResultType());
 }
 //---------------------------------------------------------------------------
 void Environment::update(const string& identifier, unique_ptr<Value> value)
 {
-   assert(isInAnyScope(identifier));
-   for(auto& iter : data)
-      if(iter.first == identifier) {
-         iter.second = ::move(value);
-         return;
-      }
-   parent->update(identifier, ::move(value));
+   VariableSlot slot;
+   bool found = resolve(identifier, slot);
+   assert(found);
+   (void) found;
+   update(slot, ::move(value));
 }
 //---------------------------------------------------------------------------
 const Value& Environment::read(const string& identifier) const
 {
-   assert(isInAnyScope(identifier));
-   for(auto& iter : data)
-      if(iter.first == identifier)
-         return *iter.second;
-   return parent->read(identifier);
+   VariableSlot slot;
+   bool found = resolve(identifier, slot);
+   assert(found);
+   (void) found;
+   return read(slot);
 }
 //---------------------------------------------------------------------------
 bool Environment::isInAnyScope(const string& identifier) const
 {
-   for(auto& iter : data)
-      if(iter.first == identifier)
+   for(const Environment* current = this; current!=nullptr; current=current->parent)
+      if(current->variableIndex.count(identifier) != 0)
          return true;
-   if(parent!=nullptr)
-      return parent->isInAnyScope(identifier); else
-      return false;
+   return false;
 }
 //---------------------------------------------------------------------------
 bool Environment::isInLocalScope(const string& identifier) const
 {
-   for(auto& iter : data)
-      if(iter.first == identifier)
+   return variableIndex.count(identifier) != 0;
+}
+//---------------------------------------------------------------------------
+bool Environment::resolve(const string& identifier, VariableSlot& slot) const
+{
+   const Environment* current = this;
+   for(uint32_t depth=0; current!=nullptr; depth++, current=current->parent) {
+      auto iter = current->variableIndex.find(identifier);
+      if(iter != current->variableIndex.end()) {
+         slot.depth = depth;
+         slot.index = iter->second;
          return true;
+      }
+   }
    return false;
 }
 //---------------------------------------------------------------------------
+const Value& Environment::read(const VariableSlot& slot) const
+{
+   auto& environment = getAncestor(slot.depth);
+   assert(slot.index < environment.data.size());
+   return *environment.data[slot.index].second;
+}
+//---------------------------------------------------------------------------
+void Environment::update(const VariableSlot& slot, unique_ptr<Value> value)
+{
+   auto& environment = const_cast<Environment&>(getAncestor(slot.depth));
+   assert(slot.index < environment.data.size());
+   auto& variable = environment.data[slot.index];
+   if(variable.second->getResultType() != value->getResultType()) {
+      environment.localSignature += hashVariable(variable.first, value->getResultType()) - hashVariable(variable.first, variable.second->getResultType());
+      environment.changeVersions(false); // the argument types checked when binding calls may no longer hold
+   }
+   variable.second = EvaluationArena::promote(::move(value), *this); // has to outlive the evaluation
+   environment.localEpoch++;
+}
+//---------------------------------------------------------------------------
+void Environment::changeVersions(bool layout)
+{
+   if(layout)
+      layoutVersion++;
+   functionVersion++;
+   lock_guard<std::mutex> lock(childrenMutex);
+   for(auto child : children)
+      child->changeVersions(layout);
+}
+//---------------------------------------------------------------------------
+uint64_t Environment::getEpoch() const
+{
+   uint64_t result = 0;
+   for(const Environment* current = this; current!=nullptr; current=current->parent)
+      result += current->localEpoch;
+   return result;
+}
+//---------------------------------------------------------------------------
+uint64_t Environment::getSignature() const
+{
+   uint64_t result = 0xcbf29ce484222325ull;
+   for(const Environment* current = this; current!=nullptr; current=current->parent)
+      result = combine(result, current->localSignature);
+   return result;
+}
+//---------------------------------------------------------------------------
+const Environment& Environment::getAncestor(uint32_t depth) const
+{
+   const Environment* result = this;
+   for(uint32_t i=0; i<depth; i++)
+      result = result->parent;
+   assert(result != nullptr);
+   return *result;
+}
+//---------------------------------------------------------------------------
+const string* Environment::internFunctionName(const string& identifier)
+{
+   auto name = findFunctionName(identifier);
+   if(name != nullptr)
+      return name;
+
+   auto& functionNames = getFunctionNames();
+   lock_guard<std::mutex> lock(functionNames.mutex);
+   auto inserted = functionNames.names.insert(identifier);
+   if(inserted.second) {
+      auto current = functionNames.current.load(memory_order_relaxed);
+      unique_ptr<FunctionNames::Snapshot> snapshot(current!=nullptr ? new FunctionNames::Snapshot(*current) : new FunctionNames::Snapshot());
+      snapshot->insert(lower_bound(snapshot->begin(), snapshot->end(), identifier, lessName), &*inserted.first);
+      functionNames.current.store(snapshot.get(), memory_order_release);
+      functionNames.snapshots.push_back(::move(snapshot));
+   }
+   return &*inserted.first;
+}
+//---------------------------------------------------------------------------
+const string* Environment::findFunctionName(const string& identifier)
+{
+   auto snapshot = getFunctionNames().current.load(memory_order_acquire);
+   if(snapshot == nullptr)
+      return nullptr;
+   auto iter = lower_bound(snapshot->begin(), snapshot->end(), identifier, lessName);
+   return iter!=snapshot->end() && **iter==identifier ? *iter : nullptr;
+}
+//---------------------------------------------------------------------------
 void Environment::addFunction(unique_ptr<Function> function)
 {
+   auto& overloads = functionsByName[internFunctionName(function->getName())];
+
    // ensures: functions.name equal => functions.returntype equal and functions.name equal => functions.arguments !equal
-   assert(none_of(functions.begin(), functions.end(), [&function](unique_ptr<Function>& iter) {
-      if(iter->getName()!=function->getName())
-         return false;
+   assert(none_of(overloads.begin(), overloads.end(), [&function](const Function* iter) {
       if(iter->getResultType()!=function->getResultType())
          return true;
       if(iter->getArgumentCount()!=function->getArgumentCount())
@@ -83,44 +229,58 @@ void Environment::addFunction(unique_ptr<Function> function)
       return true;
    }));
 
+   overloads.push_back(function.get());
+   if(function->getId() < kDenseFunctionIdLimit) {
+      if(denseFunctionsById.size() <= function->getId())
+         denseFunctionsById.resize(function->getId()+1, nullptr);
+      denseFunctionsById[function->getId()] = function.get();
+   } else {
+      sparseFunctionsById[function->getId()] = function.get();
+   }
+   functionIdEnd = max(functionIdEnd, function->getId()+1);
+   localSignature += hashFunction(*function);
+   changeVersions(false);
    functions.push_back(::move(function));
 }
 //---------------------------------------------------------------------------
-bool Environment::hasFunction(const string& identifier)
+uint32_t Environment::getFreeFunctionId() const
 {
-   for(auto& iter : functions)
-      if(iter->getName() == identifier)
-         return true;
-   if(parent!=nullptr)
-      return parent->hasFunction(identifier); else
-      return false;
+   uint32_t result = 0;
+   for(const Environment* current = this; current!=nullptr; current=current->parent)
+      result = max(result, current->functionIdEnd);
+   return result;
+}
+//---------------------------------------------------------------------------
+bool Environment::hasFunction(const string& identifier) const
+{
+   return forEachFunction(identifier, [](const Function&) {}) != 0;
 }
 //---------------------------------------------------------------------------
-vector<const Function*> Environment::getFunction(const string& identifier)
+vector<const Function*> Environment::getFunction(const string& identifier) const
 {
    assert(hasFunction(identifier));
    vector<const Function*> result;
-   for(auto& iter : functions)
-      if(iter->getName() == identifier)
-         result.push_back(iter.get());
-
-   if(parent!=nullptr) {
-      auto parentResult = parent->getFunction(identifier);
-      result.insert(result.end(), parentResult.begin(), parentResult.end());
-   }
+   forEachFunction(identifier, [&result](const Function& function) {result.push_back(&function);});
    return result;
 }
 //---------------------------------------------------------------------------
-const Function* Environment::getFunction(uint32_t id)
+const Function* Environment::getFunction(uint32_t id) const
 {
-   for(auto& iter : functions)
-      if(iter->getId() == id)
-         return iter.get();
-
-   if(parent!=nullptr)
-      return parent->getFunction(id);
-
-   throw;
+   for(const Environment* current = this; current!=nullptr; current=current->parent) {
+      auto function = current->findLocalFunction(id);
+      if(function != nullptr)
+         return function;
+   }
+   throw harriet::Exception{"unknown function id: " + to_string(id)};
+}
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+const Function* Environment::findLocalFunction(uint32_t id) const
+{
+   if(id < kDenseFunctionIdLimit)
+      return id<denseFunctionsById.size() ? denseFunctionsById[id] : nullptr;
+   auto iter = sparseFunctionsById.find(id);
+   return iter!=sparseFunctionsById.end() ? iter->second : nullptr;
 }
 //---------------------------------------------------------------------------
 } // end of namespace harriet
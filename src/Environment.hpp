@@ -1,8 +1,12 @@
 #ifndef SCRIPTLANGUAGE_ENVIRONMENT_HPP_
 #define SCRIPTLANGUAGE_ENVIRONMENT_HPP_
 //---------------------------------------------------------------------------
+#include "Function.hpp"
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 //---------------------------------------------------------------------------
 // Harriet Script Language
@@ -12,7 +16,12 @@
 namespace harriet {
 //---------------------------------------------------------------------------
 class Value;
-class Function;
+//---------------------------------------------------------------------------
+/// position of a variable: number of parents to walk up and index in that environment
+struct VariableSlot {
+   uint32_t depth;
+   uint32_t index;
+};
 //---------------------------------------------------------------------------
 class Environment {
 public:
@@ -27,18 +36,88 @@ public:
    bool isInAnyScope(const std::string& identifier) const; // checks parents
    bool isInLocalScope(const std::string& identifier) const; // does not check parents
 
+   /// variables by slot -- slots stay valid as long as id and layout version of the environment do not change
+   bool resolve(const std::string& identifier, VariableSlot& slot) const;
+   const Value& read(const VariableSlot& slot) const;
+   void update(const VariableSlot& slot, std::unique_ptr<Value> value);
+   uint64_t getId() const {return id;}
+   uint64_t getLayoutVersion() const {return layoutVersion;} // changes whenever a variable is added to this or a parent environment
+   uint64_t getEpoch() const; // changes whenever a variable of this or a parent environment is added or updated => equal epochs see equal values
+   /// hash of the names and types of all visible variables and of the signatures and identities (Function::getSerial) of all functions
+   /// equal signatures => a string parses to the same expression, also where calls of pure functions were folded
+   uint64_t getSignature() const;
+
    /// functions
    void addFunction(std::unique_ptr<Function> function);
-   bool hasFunction(const std::string& identifier);
-   std::vector<const Function*> getFunction(const std::string& identifier); // all functions with same name
-   const Function* getFunction(uint32_t id); // specific function
+   /// adds a c++ function or lambda under the next free id, e.g.: def("clamp", [](float x, float lo, float hi) {return std::min(std::max(x, lo), hi);})
+   /// a memoCapacity other than 0 memoizes the function (see Function::memoize)
+   template<class Callable>
+   void def(const std::string& name, Callable callable, bool pure = false, uint32_t memoCapacity = 0)
+   {
+      auto function = Function::fromNative(name, getFreeFunctionId(), callable, pure);
+      if(memoCapacity != 0)
+         function->memoize(memoCapacity);
+      addFunction(std::move(function));
+   }
+   uint32_t getFreeFunctionId() const; // larger than the id of any function in this or a parent environment
+   bool hasFunction(const std::string& identifier) const;
+   std::vector<const Function*> getFunction(const std::string& identifier) const; // all functions with same name
+   /// calls callback(const Function&) for all functions with the name, the ones of this environment first; returns their number
+   /// does not allocate, the name is looked up once and the environments are searched by the address of the interned name
+   template<class Callback>
+   uint32_t forEachFunction(const std::string& identifier, Callback callback) const;
+   const Function* getFunction(uint32_t id) const; // specific function
+   /// changes whenever a function or a variable is added to this or a parent environment or a variable changes its type => resolved
+   /// functions stay valid and the arguments of calls keep the types checked when the call was bound
+   uint64_t getFunctionVersion() const {return functionVersion;}
 
 private:
+   static const std::string* internFunctionName(const std::string& identifier);
+   static const std::string* findFunctionName(const std::string& identifier); // nullptr if no function was ever called like this
+   const Environment& getAncestor(uint32_t depth) const;
+   void changeVersions(bool layout); // of this environment and all below it
+   const Function* findLocalFunction(uint32_t id) const;
+
+   /// ids below this are kept in a dense array, larger ones in a hash table
+   static const uint32_t kDenseFunctionIdLimit = 1<<16;
+
    Environment* parent;
+   std::vector<Environment*> children; // environments with this one as parent, they are created concurrently by threads
+   std::mutex childrenMutex;
+   const uint64_t id;
+   /// versions of this environment including the changes of the parents, which pass them on to their children (changeVersions) => bound
+   /// variables and calls are validated with one load and compare
+   uint64_t layoutVersion;
+   uint64_t functionVersion;
+   uint64_t localEpoch;
+   uint64_t localSignature; // sum of the hashes of the local variables and functions, maintained by add, update and addFunction
    std::vector<std::pair<std::string, std::unique_ptr<Value>>> data; // variables
+   std::unordered_map<std::string, uint32_t> variableIndex; // identifier -> index in data
    std::vector<std::unique_ptr<Function>> functions; // functions
+   std::unordered_map<const std::string*, std::vector<const Function*>> functionsByName; // overloads by interned name
+   std::vector<const Function*> denseFunctionsById;
+   std::unordered_map<uint32_t, const Function*> sparseFunctionsById;
+   uint32_t functionIdEnd; // larger than the id of any local function, maintained by addFunction
 };
 //---------------------------------------------------------------------------
+template<class Callback>
+uint32_t Environment::forEachFunction(const std::string& identifier, Callback callback) const
+{
+   auto name = findFunctionName(identifier);
+   if(name == nullptr)
+      return 0;
+   uint32_t count = 0;
+   for(const Environment* current = this; current!=nullptr; current=current->parent) {
+      auto iter = current->functionsByName.find(name);
+      if(iter == current->functionsByName.end())
+         continue;
+      for(auto function : iter->second)
+         callback(*function);
+      count += iter->second.size();
+   }
+   return count;
+}
+//---------------------------------------------------------------------------
 } // end of namespace harriet
 //---------------------------------------------------------------------------
 #endif
@@ -0,0 +1,144 @@
+#include "EvaluationArena.hpp"
+#include "Expression.hpp"
+#include <algorithm>
+#include <cassert>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+thread_local EvaluationArena* EvaluationArena::activeArena = nullptr;
+atomic<uint32_t> EvaluationArena::activeScopes(0);
+const size_t EvaluationArena::alignment;
+const size_t EvaluationArena::defaultChunkSize;
+//---------------------------------------------------------------------------
+EvaluationArena::EvaluationArena()
+: firstChunk(nullptr)
+, currentChunk(nullptr)
+, position(nullptr)
+, end(nullptr)
+, outer(nullptr)
+{
+}
+//---------------------------------------------------------------------------
+EvaluationArena::~EvaluationArena()
+{
+   assert(activeArena != this);
+   while(firstChunk != nullptr) {
+      Chunk* next = firstChunk->next;
+      free(firstChunk);
+      firstChunk = next;
+   }
+}
+//---------------------------------------------------------------------------
+EvaluationArena::Scope::Scope(EvaluationArena& arena)
+: arena(arena)
+, previous(activeArena)
+{
+   assert(!isActive(&arena)); // the inner scope would release the values of the outer one
+   arena.outer = previous;
+   activeArena = &arena;
+   activeScopes++;
+}
+//---------------------------------------------------------------------------
+EvaluationArena::Scope::~Scope()
+{
+   activeScopes--;
+   activeArena = previous;
+   arena.outer = nullptr;
+   arena.release();
+}
+//---------------------------------------------------------------------------
+EvaluationArena* EvaluationArena::findOwner(const void* data)
+{
+   for(EvaluationArena* iter=activeArena; iter!=nullptr; iter=iter->outer)
+      if(iter->contains(data))
+         return iter;
+   return nullptr;
+}
+//---------------------------------------------------------------------------
+EvaluationArena* EvaluationArena::getOwner(const Value& value)
+{
+   // the arena holds the complete object, not the value sub object
+   return findOwner(dynamic_cast<const void*>(&value));
+}
+//---------------------------------------------------------------------------
+namespace {
+   /// lets values be allocated normally for the lifetime of the object
+   struct SuspendArena {
+      SuspendArena(EvaluationArena*& active) : active(active), arena(active) {active = nullptr;}
+      ~SuspendArena() {active = arena;}
+      EvaluationArena*& active;
+      EvaluationArena* arena;
+   };
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> EvaluationArena::promote(unique_ptr<Value> value, Environment& environment)
+{
+   if(value==nullptr || getOwner(*value)==nullptr)
+      return value;
+
+   unique_ptr<Value> result;
+   {
+      SuspendArena suspend(activeArena);
+      result = value->evaluate(environment); // evaluating a value copies it
+   }
+   return result; // the arena copy is deleted while its arena is active again
+}
+//---------------------------------------------------------------------------
+void EvaluationArena::grow(size_t size)
+{
+   // reuse the chunks of previous evaluations
+   while(currentChunk!=nullptr && currentChunk->next!=nullptr) {
+      currentChunk = currentChunk->next;
+      if(static_cast<size_t>(currentChunk->end-currentChunk->mem) >= size) {
+         position = currentChunk->mem;
+         end = currentChunk->end;
+         return;
+      }
+   }
+
+   // header and memory in one block, the header size keeps the memory aligned
+   size_t capacity = max(size, defaultChunkSize);
+   size_t headerSize = (sizeof(Chunk) + alignment - 1) & ~(alignment - 1);
+   auto block = static_cast<uint8_t*>(malloc(headerSize + capacity));
+   if(block == nullptr)
+      throw bad_alloc();
+   Chunk* chunk = reinterpret_cast<Chunk*>(block);
+   chunk->mem = block + headerSize;
+   chunk->end = chunk->mem + capacity;
+   chunk->next = nullptr;
+   if(currentChunk == nullptr)
+      firstChunk = chunk; else
+      currentChunk->next = chunk;
+   currentChunk = chunk;
+   position = chunk->mem;
+   end = chunk->end;
+}
+//---------------------------------------------------------------------------
+bool EvaluationArena::contains(const void* data) const
+{
+   // only the chunks up to the current one hold values
+   auto address = static_cast<const uint8_t*>(data);
+   for(Chunk* chunk=firstChunk; chunk!=nullptr; chunk=chunk->next) {
+      if(chunk->mem<=address && address<chunk->end)
+         return true;
+      if(chunk == currentChunk)
+         break;
+   }
+   return false;
+}
+//---------------------------------------------------------------------------
+void EvaluationArena::release()
+{
+   currentChunk = firstChunk;
+   position = firstChunk!=nullptr ? firstChunk->mem : nullptr;
+   end = firstChunk!=nullptr ? firstChunk->end : nullptr;
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,100 @@
+#ifndef SCRIPTLANGUAGE_EVALUATIONARENA_HPP_
+#define SCRIPTLANGUAGE_EVALUATIONARENA_HPP_
+//---------------------------------------------------------------------------
+#include <stdint.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class EvaluationArena;
+class Value;
+//---------------------------------------------------------------------------
+/// Bump allocator for the temporary values of an evaluation. While a Scope is active on a thread, all values created by that thread are
+/// placed in the arena and deleting them is free. Leaving the scope releases everything at once, so a value which has to outlive the
+/// evaluation (the result, values stored in an environment) is promoted to the normal allocator first.
+/// The chunks are kept for the next evaluation => an arena is meant to be reused (but only by one thread at a time). Values carry no mark of
+/// their arena, deleting one checks whether its address lies in an arena of the thread => they have to be deleted by that thread, in the scope.
+class EvaluationArena {
+public:
+   EvaluationArena();
+   ~EvaluationArena();
+
+   /// activates the arena for the current thread, on destruction the previous arena is restored and all memory is released
+   class Scope {
+   public:
+      Scope(EvaluationArena& arena);
+      ~Scope();
+   private:
+      EvaluationArena& arena;
+      EvaluationArena* previous;
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+   };
+
+   /// the arena of the current thread or nullptr
+   static EvaluationArena* active() {return activeArena;}
+   /// false while no thread has an arena => the allocation of values does not need to look at the thread's arena
+   static bool anyActive() {return activeScopes.load(std::memory_order_relaxed) != 0;}
+
+   void* allocate(std::size_t size)
+   {
+      size = (size + alignment - 1) & ~(alignment - 1);
+      if(static_cast<std::size_t>(end - position) < size)
+         grow(size);
+      void* result = position;
+      position += size;
+      return result;
+   }
+   /// true if the arena is the active one of the current thread or one of the arenas it interrupted (nested scopes)
+   static bool isActive(const EvaluationArena* arena)
+   {
+      for(EvaluationArena* iter=activeArena; iter!=nullptr; iter=iter->outer)
+         if(iter == arena)
+            return true;
+      return false;
+   }
+   /// the active arena of the current thread (or one it interrupted) the memory was placed in, nullptr if it is not in one of them
+   static EvaluationArena* findOwner(const void* data);
+   /// same for a value, nullptr if it is owned by the allocator policy
+   static EvaluationArena* getOwner(const Value& value);
+
+   /// copies the value out of its arena, values not in an arena are returned unchanged
+   static std::unique_ptr<Value> promote(std::unique_ptr<Value> value, Environment& environment);
+
+private:
+   static const std::size_t alignment = 16;
+   static const std::size_t defaultChunkSize = 16 * 1024;
+
+   struct Chunk {
+      uint8_t* mem;
+      uint8_t* end;
+      Chunk* next;
+   };
+
+   void grow(std::size_t size);
+   void release();
+   bool contains(const void* data) const;
+
+   Chunk* firstChunk;
+   Chunk* currentChunk;
+   uint8_t* position;
+   uint8_t* end;
+   EvaluationArena* outer; // the arena which was active before this one, while a scope is active
+
+   static thread_local EvaluationArena* activeArena;
+   static std::atomic<uint32_t> activeScopes; // of all threads
+
+   EvaluationArena(const EvaluationArena&) = delete;
+   EvaluationArena& operator=(const EvaluationArena&) = delete;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -2,9 +2,11 @@
 #include "Utility.hpp"
 #include "Environment.hpp"
 #include "Function.hpp"
+#include "Operations.hpp"
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
 #include <list>
 #include <stack>
 #include <cassert>
@@ -18,6 +20,148 @@ using namespace std;
 //---------------------------------------------------------------------------
 namespace harriet {
 //---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// results of the shared sub trees for the evaluation of a scope
+struct SharedResults {
+   const SharedExpressionScope* scope;
+   Scalar* values;
+   bool* computed;
+};
+//---------------------------------------------------------------------------
+/// the innermost scope evaluated on this thread
+thread_local SharedResults* activeSharedResults = nullptr;
+//---------------------------------------------------------------------------
+/// activates empty results while a scope is evaluated, the ones of an enclosing evaluation are restored afterwards
+class SharedResultsFrame {
+public:
+   SharedResultsFrame(const SharedExpressionScope& scope)
+   : previous(activeSharedResults)
+   {
+      results.scope = &scope;
+      results.values = inlineValues;
+      results.computed = inlineComputed;
+      if(scope.getSharedCount() > kInlineCount) {
+         heapValues.resize(scope.getSharedCount());
+         heapComputed.reset(new bool[scope.getSharedCount()]);
+         results.values = heapValues.data();
+         results.computed = heapComputed.get();
+      }
+      fill(results.computed, results.computed + scope.getSharedCount(), false);
+      activeSharedResults = &results;
+   }
+   ~SharedResultsFrame() {activeSharedResults = previous;}
+private:
+   static const uint32_t kInlineCount = 16;
+   SharedResults results;
+   SharedResults* previous;
+   Scalar inlineValues[kInlineCount];
+   bool inlineComputed[kInlineCount];
+   vector<Scalar> heapValues;
+   unique_ptr<bool[]> heapComputed;
+};
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+auto inferBinary(harriet::VariableType& result, int) -> decltype(Operation::apply(declval<L>(), declval<R>()), bool())
+{
+   result = StaticType<decltype(Operation::apply(declval<L>(), declval<R>()))>::value;
+   return true;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+bool inferBinary(harriet::VariableType& /*result*/, long)
+{
+   return false;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L>
+bool inferRhs(harriet::VariableType rhsType, harriet::VariableType& result)
+{
+   switch(rhsType) {
+      case harriet::VariableType::TInteger: return inferBinary<Operation, L, int32_t>(result, 0);
+      case harriet::VariableType::TFloat:   return inferBinary<Operation, L, float>(result, 0);
+      case harriet::VariableType::TBool:    return inferBinary<Operation, L, bool>(result, 0);
+      case harriet::VariableType::TVector:  return inferBinary<Operation, L, Vector3<float>>(result, 0);
+      default:                                     return false;
+   }
+}
+//---------------------------------------------------------------------------
+/// result type of a binary operator on non string types, throws the same error as the evaluation would
+template<class Operation>
+harriet::VariableType inferBinaryType(harriet::VariableType lhsType, harriet::VariableType rhsType)
+{
+   harriet::VariableType result = lhsType;
+   bool valid = false;
+   switch(lhsType) {
+      case harriet::VariableType::TInteger: valid = inferRhs<Operation, int32_t>(rhsType, result); break;
+      case harriet::VariableType::TFloat:   valid = inferRhs<Operation, float>(rhsType, result); break;
+      case harriet::VariableType::TBool:    valid = inferRhs<Operation, bool>(rhsType, result); break;
+      case harriet::VariableType::TVector:  valid = inferRhs<Operation, Vector3<float>>(rhsType, result); break;
+      default:                                     break;
+   }
+   if(!valid)
+      throw harriet::Exception{"binary operator '" + string(Operation::sign()) + "' does not accept '" + harriet::typeToName(lhsType) + "' and '" + harriet::typeToName(rhsType) + "'"};
+   return result;
+}
+//---------------------------------------------------------------------------
+/// strings can only be compared with strings
+template<class Operation>
+harriet::VariableType inferComparisonType(harriet::VariableType lhsType, harriet::VariableType rhsType)
+{
+   if(lhsType==harriet::VariableType::TString && rhsType==harriet::VariableType::TString)
+      return harriet::VariableType::TBool;
+   return inferBinaryType<Operation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+auto inferUnary(harriet::VariableType& result, int) -> decltype(Operation::apply(declval<T>()), bool())
+{
+   result = StaticType<decltype(Operation::apply(declval<T>()))>::value;
+   return true;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+bool inferUnary(harriet::VariableType& /*result*/, long)
+{
+   return false;
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+harriet::VariableType inferUnaryType(harriet::VariableType type)
+{
+   harriet::VariableType result = type;
+   bool valid = false;
+   switch(type) {
+      case harriet::VariableType::TInteger: valid = inferUnary<Operation, int32_t>(result, 0); break;
+      case harriet::VariableType::TFloat:   valid = inferUnary<Operation, float>(result, 0); break;
+      case harriet::VariableType::TBool:    valid = inferUnary<Operation, bool>(result, 0); break;
+      case harriet::VariableType::TVector:  valid = inferUnary<Operation, Vector3<float>>(result, 0); break;
+      default:                                     break;
+   }
+   if(!valid)
+      throw harriet::Exception{"unary operator '" + string(Operation::sign()) + "' does not accept '" + harriet::typeToName(type) + "'"};
+   return result;
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+Scalar Expression::evaluateScalar(Environment& environment) const
+{
+   return Scalar::fromValue(*evaluate(environment));
+}
+//---------------------------------------------------------------------------
+Variable::Variable(const string& identifier, const Environment& environment)
+: identifier(identifier)
+, boundEnvironment(0)
+, boundLayoutVersion(0)
+{
+   if(!environment.resolve(identifier, slot))
+      throw harriet::Exception{"found unkown identifier: '" + identifier + "'"};
+   resultType = environment.read(slot).getResultType();
+   boundEnvironment = environment.getId();
+   boundLayoutVersion = environment.getLayoutVersion();
+}
+//---------------------------------------------------------------------------
 void Variable::print(ostream& stream) const
 {
    stream << identifier << " ";
@@ -25,7 +169,7 @@ void Variable::print(ostream& stream) const
 //---------------------------------------------------------------------------
 unique_ptr<Value> Variable::evaluate(Environment& environment) const
 {
-   const Value& result = environment.read(identifier);
+   const Value& result = isBoundTo(environment) ? environment.read(slot) : environment.read(identifier);
    switch(result.getResultType()) {
       case harriet::VariableType::TInteger: return make_unique<IntegerValue>(reinterpret_cast<const IntegerValue&>(result).result);
       case harriet::VariableType::TFloat:   return make_unique<FloatValue>(reinterpret_cast<const FloatValue&>(result).result);
@@ -36,6 +180,11 @@ unique_ptr<Value> Variable::evaluate(Environment& environment) const
    }
 }
 //---------------------------------------------------------------------------
+Scalar Variable::evaluateScalar(Environment& environment) const
+{
+   return Scalar::fromValue(isBoundTo(environment) ? environment.read(slot) : environment.read(identifier));
+}
+//---------------------------------------------------------------------------
 void IntegerValue::print(ostream& stream) const
 {
    stream << result << " ";
@@ -46,6 +195,11 @@ unique_ptr<Value> IntegerValue::evaluate(Environment& /*environment*/) const
    return make_unique<IntegerValue>(result);
 }
 //---------------------------------------------------------------------------
+Scalar IntegerValue::evaluateScalar(Environment& /*environment*/) const
+{
+   return Scalar(result);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> IntegerValue::computeAdd(const Value& rhs, const Environment& /*env*/) const
 {
    switch(rhs.getResultType()) {
@@ -200,6 +354,11 @@ unique_ptr<Value> FloatValue::evaluate(Environment& /*environment*/) const
    return make_unique<FloatValue>(result);
 }
 //---------------------------------------------------------------------------
+Scalar FloatValue::evaluateScalar(Environment& /*environment*/) const
+{
+   return Scalar(result);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> FloatValue::computeAdd(const Value& rhs, const Environment& /*env*/) const
 {
    switch(rhs.getResultType()) {
@@ -338,6 +497,11 @@ unique_ptr<Value> BoolValue::evaluate(Environment& /*environment*/) const
    return make_unique<BoolValue>(result);
 }
 //---------------------------------------------------------------------------
+Scalar BoolValue::evaluateScalar(Environment& /*environment*/) const
+{
+   return Scalar(result);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> BoolValue::computeAnd(const Value& rhs, const Environment& /*env*/) const
 {
    switch(rhs.getResultType()) {
@@ -475,6 +639,11 @@ unique_ptr<Value> VectorValue::evaluate(Environment& /*environment*/) const
    return make_unique<VectorValue>(result);
 }
 //---------------------------------------------------------------------------
+Scalar VectorValue::evaluateScalar(Environment& /*environment*/) const
+{
+   return Scalar(result);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> VectorValue::computeAdd(const Value& rhs, const Environment& /*env*/) const
 {
    switch(rhs.getResultType()) {
@@ -555,6 +724,7 @@ void UnaryOperator::print(ostream& stream) const
 //---------------------------------------------------------------------------
 void UnaryOperator::addChild(unique_ptr<Expression> child)
 {
+   resultType = inferResultType(child->getResultType());
    this->child = ::move(child);
 }
 //---------------------------------------------------------------------------
@@ -563,19 +733,45 @@ unique_ptr<Value> UnaryMinusOperator::evaluate(Environment& environment) const
    return child->evaluate(environment)->computeInv(environment);
 }
 //---------------------------------------------------------------------------
+Scalar UnaryMinusOperator::evaluateScalar(Environment& environment) const
+{
+   return child->evaluateScalar(environment).computeInv();
+}
+//---------------------------------------------------------------------------
+harriet::VariableType UnaryMinusOperator::inferResultType(harriet::VariableType childType) const
+{
+   return inferUnaryType<InvOperation>(childType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> NotOperator::evaluate(Environment& environment) const
 {
    return child->evaluate(environment)->computeNot(environment);
 }
 //---------------------------------------------------------------------------
+Scalar NotOperator::evaluateScalar(Environment& environment) const
+{
+   return child->evaluateScalar(environment).computeNot();
+}
+//---------------------------------------------------------------------------
+harriet::VariableType NotOperator::inferResultType(harriet::VariableType childType) const
+{
+   return inferUnaryType<NotOperation>(childType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> CastOperator::evaluate(Environment& environment) const
 {
    return child->evaluate(environment)->computeCast(environment, getCastType());
 }
 //---------------------------------------------------------------------------
+Scalar CastOperator::evaluateScalar(Environment& environment) const
+{
+   return child->evaluateScalar(environment).computeCast(getCastType());
+}
+//---------------------------------------------------------------------------
 void BinaryOperator::addChildren(unique_ptr<Expression> lhsChild, unique_ptr<Expression> rhsChild)
 {
    assert(lhs==nullptr && rhs==nullptr);
+   resultType = inferResultType(lhsChild->getResultType(), rhsChild->getResultType());
    lhs = ::move(lhsChild);
    rhs = ::move(rhsChild);
 }
@@ -594,48 +790,150 @@ unique_ptr<Value> AssignmentOperator::evaluate(Environment& environment) const
    if(lhs->getExpressionType() != ExpressionType::TVariable)
       throw harriet::Exception("need variable as left hand side of assignment operator");
 
-   environment.update(reinterpret_cast<Variable*>(lhs.get())->getIdentifier(), rhs->evaluate(environment));
+   auto& variable = reinterpret_cast<const Variable&>(*lhs);
+   if(variable.isBoundTo(environment))
+      environment.update(variable.getSlot(), rhs->evaluate(environment)); else
+      environment.update(variable.getIdentifier(), rhs->evaluate(environment));
    return lhs->evaluate(environment);
 }
 //---------------------------------------------------------------------------
+harriet::VariableType AssignmentOperator::inferResultType(harriet::VariableType /*lhsType*/, harriet::VariableType rhsType) const
+{
+   return rhsType; // the variable holds the value of the rhs afterwards
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> PlusOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeAdd(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar PlusOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeAdd(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType PlusOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   if(lhsType==harriet::VariableType::TString && rhsType==harriet::VariableType::TString)
+      return harriet::VariableType::TString;
+   return inferBinaryType<AddOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> MinusOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeSub(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar MinusOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeSub(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType MinusOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<SubOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> MultiplicationOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeMul(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar MultiplicationOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeMul(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType MultiplicationOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<MulOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> DivisionOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeDiv(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar DivisionOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeDiv(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType DivisionOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<DivOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> ModuloOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeMod(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar ModuloOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeMod(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType ModuloOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<ModOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> ExponentiationOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeExp(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar ExponentiationOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeExp(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType ExponentiationOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<ExpOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> AndOperator::evaluate(Environment& environment) const
 {
-   return lhs->evaluate(environment)->computeAnd(*rhs->evaluate(environment), environment);
+   auto left = lhs->evaluate(environment);
+   if(isShortCircuit() && left->getResultType()==harriet::VariableType::TBool && !reinterpret_cast<const BoolValue&>(*left).result)
+      return left;
+   return left->computeAnd(*rhs->evaluate(environment), environment);
+}
+//---------------------------------------------------------------------------
+Scalar AndOperator::evaluateScalar(Environment& environment) const
+{
+   Scalar left = lhs->evaluateScalar(environment);
+   if(isShortCircuit() && left.type==harriet::VariableType::TBool && !left.boolean)
+      return left;
+   return left.computeAnd(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType AndOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<AndOperation>(lhsType, rhsType);
 }
 //---------------------------------------------------------------------------
 unique_ptr<Value> OrOperator::evaluate(Environment& environment) const
 {
-   return lhs->evaluate(environment)->computeOr (*rhs->evaluate(environment), environment);
+   auto left = lhs->evaluate(environment);
+   if(isShortCircuit() && left->getResultType()==harriet::VariableType::TBool && reinterpret_cast<const BoolValue&>(*left).result)
+      return left;
+   return left->computeOr (*rhs->evaluate(environment), environment);
+}
+//---------------------------------------------------------------------------
+Scalar OrOperator::evaluateScalar(Environment& environment) const
+{
+   Scalar left = lhs->evaluateScalar(environment);
+   if(isShortCircuit() && left.type==harriet::VariableType::TBool && left.boolean)
+      return left;
+   return left.computeOr (rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType OrOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferBinaryType<OrOperation>(lhsType, rhsType);
 }
 //---------------------------------------------------------------------------
 unique_ptr<Value> GreaterOperator::evaluate(Environment& environment) const
@@ -643,52 +941,157 @@ unique_ptr<Value> GreaterOperator::evaluate(Environment& environment) const
    return lhs->evaluate(environment)->computeGt (*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar GreaterOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeGt (rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType GreaterOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferComparisonType<GtOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> LessOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeLt (*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar LessOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeLt (rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType LessOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferComparisonType<LtOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> GreaterEqualOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeGeq(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar GreaterEqualOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeGeq(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType GreaterEqualOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferComparisonType<GeqOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> LessEqualOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeLeq(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar LessEqualOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeLeq(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType LessEqualOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferComparisonType<LeqOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> EqualOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeEq(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
+Scalar EqualOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeEq(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType EqualOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferComparisonType<EqOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
 unique_ptr<Value> NotEqualOperator::evaluate(Environment& environment) const
 {
    return lhs->evaluate(environment)->computeNeq(*rhs->evaluate(environment), environment);
 }
 //---------------------------------------------------------------------------
-FunctionOperator::FunctionOperator(const string& functionName, uint32_t functionIdentifier, vector<unique_ptr<Expression>>& arguments)
+Scalar NotEqualOperator::evaluateScalar(Environment& environment) const
+{
+   return lhs->evaluateScalar(environment).computeNeq(rhs->evaluateScalar(environment));
+}
+//---------------------------------------------------------------------------
+harriet::VariableType NotEqualOperator::inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const
+{
+   return inferComparisonType<NeqOperation>(lhsType, rhsType);
+}
+//---------------------------------------------------------------------------
+FunctionOperator::FunctionOperator(const string& functionName, uint32_t functionIdentifier, harriet::VariableType resultType, vector<unique_ptr<Expression>>& arguments)
 : functionName(functionName)
 , functionIdentifier(functionIdentifier)
+, resultType(resultType)
+, arguments(::move(arguments))
+, boundFunction(nullptr)
+, boundEnvironment(0)
+, boundFunctionVersion(0)
+{
+}
+//---------------------------------------------------------------------------
+FunctionOperator::FunctionOperator(const Function& function, const Environment& environment, vector<unique_ptr<Expression>>& arguments)
+: functionName(function.getName())
+, functionIdentifier(function.getId())
+, resultType(function.getResultType())
 , arguments(::move(arguments))
+, boundFunction(&function)
+, boundEnvironment(environment.getId())
+, boundFunctionVersion(environment.getFunctionVersion())
 {
+   assert(environment.getFunction(functionIdentifier) == &function);
+   // checked once, the arguments keep their types as long as the call is bound (see Environment::getFunctionVersion)
+   if(this->arguments.size() != function.getArgumentCount())
+      throw harriet::Exception{"function '" + functionName + "' expects " + to_string(function.getArgumentCount()) + " arguments"};
+   for(uint32_t i=0; i<this->arguments.size(); i++)
+      function.checkArgumentType(i, this->arguments[i]->getResultType());
 }
 //---------------------------------------------------------------------------
 unique_ptr<Value> FunctionOperator::evaluate(Environment& environment) const
 {
+   // the argument types are only checked for calls falling back to the lookup by id
+   bool bound = isBoundTo(environment);
+   auto function = bound ? boundFunction : environment.getFunction(functionIdentifier);
+   if(function->isUnboxed())
+      return callUnboxed(*function, !bound, environment).toValue();
+
    // build arguments
    vector<unique_ptr<Value>> evaluetedArguments;
-   auto function = environment.getFunction(functionIdentifier);
    for(uint32_t i=0; i<arguments.size(); i++) {
       auto result = arguments[i]->evaluate(environment);
-      if(result->getResultType() != function->getArgumentType(i))
-         throw harriet::Exception{"type missmatch in function '" + function->getName() + "' for argument '" + to_string(i) + "' unable to convert '" + harriet::typeToName(result->getResultType()) + "' to '" + harriet::typeToName(function->getArgumentType(i)) + "'"};
+      if(!bound)
+         function->checkArgumentType(i, result->getResultType());
       evaluetedArguments.push_back(::move(result));
    }
 
    // call function
-   return function->execute(evaluetedArguments, environment);
+   auto result = function->execute(evaluetedArguments, environment);
+   function->checkResultType(result->getResultType());
+   return result;
+}
+//---------------------------------------------------------------------------
+Scalar FunctionOperator::evaluateScalar(Environment& environment) const
+{
+   bool bound = isBoundTo(environment);
+   auto function = bound ? boundFunction : environment.getFunction(functionIdentifier);
+   if(function->isUnboxed())
+      return callUnboxed(*function, !bound, environment);
+   return Expression::evaluateScalar(environment);
+}
+//---------------------------------------------------------------------------
+Scalar FunctionOperator::callUnboxed(const Function& function, bool checkArguments, Environment& environment) const
+{
+   Function::ScalarArguments argv(arguments.size());
+   for(uint32_t i=0; i<arguments.size(); i++)
+      argv[i] = arguments[i]->evaluateScalar(environment);
+   return function.executeCall(argv.data(), checkArguments, environment);
 }
 //---------------------------------------------------------------------------
 void FunctionOperator::print(ostream& stream) const
@@ -696,5 +1099,45 @@ void FunctionOperator::print(ostream& stream) const
    stream << " " << functionName << " id:" << functionIdentifier << endl;
 }
 //---------------------------------------------------------------------------
+unique_ptr<Value> SharedExpression::evaluate(Environment& environment) const
+{
+   // outside of an evaluation of the scope (or for strings) there is nothing to reuse
+   auto results = activeSharedResults;
+   if(results==nullptr || results->scope!=scope)
+      return child->evaluate(environment);
+   if(results->computed[index])
+      return results->values[index].toValue();
+   auto result = child->evaluate(environment);
+   if(result->getResultType() != harriet::VariableType::TString) {
+      results->values[index] = Scalar::fromValue(*result);
+      results->computed[index] = true;
+   }
+   return result;
+}
+//---------------------------------------------------------------------------
+Scalar SharedExpression::evaluateScalar(Environment& environment) const
+{
+   auto results = activeSharedResults;
+   if(results==nullptr || results->scope!=scope)
+      return child->evaluateScalar(environment);
+   if(results->computed[index])
+      return results->values[index];
+   results->values[index] = child->evaluateScalar(environment);
+   results->computed[index] = true;
+   return results->values[index];
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> SharedExpressionScope::evaluate(Environment& environment) const
+{
+   SharedResultsFrame frame(*this);
+   return child->evaluate(environment);
+}
+//---------------------------------------------------------------------------
+Scalar SharedExpressionScope::evaluateScalar(Environment& environment) const
+{
+   SharedResultsFrame frame(*this);
+   return child->evaluateScalar(environment);
+}
+//---------------------------------------------------------------------------
 } // end of namespace harriet
 //---------------------------------------------------------------------------
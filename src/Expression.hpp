@@ -2,6 +2,8 @@
 #define SCRIPTLANGUAGE_EXPRESSION_HPP_
 //---------------------------------------------------------------------------
 #include "ScriptLanguage.hpp"
+#include "Environment.hpp"
+#include "Scalar.hpp"
 #include "vector3.hpp"
 #include "GenericAllocator.hpp"
 #include <memory>
@@ -19,8 +21,9 @@ namespace harriet {
 class Environment;
 class Value;
 //---------------------------------------------------------------------------
-enum struct ExpressionType : uint8_t {TValue, TVariable, TUnaryOperator, TBinaryOperator, TOpeningPharentesis, TClosingPharentesis, TFunctionOperator};
+enum struct ExpressionType : uint8_t {TValue, TVariable, TUnaryOperator, TBinaryOperator, TOpeningPharentesis, TClosingPharentesis, TComma, TFunctionOperator, TShared, TSharedScope, TCompiled};
 enum struct Associativity : uint8_t {TLeft, TRight};
+enum struct OperatorType : uint8_t {TAssignment, TPlus, TMinus, TMultiplication, TDivision, TModulo, TExponentiation, TAnd, TOr, TGreater, TLess, TGreaterEqual, TLessEqual, TEqual, TNotEqual, TUnaryMinus, TNot, TCast};
 //---------------------------------------------------------------------------
 class Expression {
 public:
@@ -28,12 +31,18 @@ public:
 
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const = 0;
 
+   /// evaluates without boxing intermediate results, throws for strings
+   virtual Scalar evaluateScalar(Environment& environment) const;
+
    virtual ~Expression(){};
 
-protected:
    /// for shunting yard -- pharentesis and comma are ONLY used during parsing
    virtual ExpressionType getExpressionType() const = 0;
 
+   /// inferred while parsing, variables contribute the type they had at that time
+   virtual harriet::VariableType getResultType() const = 0;
+
+protected:
    /// for shunting yard -- left *,+,-,/,% right *nothing*
    virtual Associativity getAssociativity() const = 0;
 
@@ -47,22 +56,32 @@ protected:
 //---------------------------------------------------------------------------
 class Variable : public Expression {
 public:
-   Variable(const std::string& identifier) : identifier(identifier) {}
+   Variable(const std::string& identifier, harriet::VariableType resultType) : identifier(identifier), resultType(resultType), boundEnvironment(0), boundLayoutVersion(0) {}
+   Variable(const std::string& identifier, const Environment& environment); // binds the variable to its slot in the environment
    virtual ~Variable(){};
    virtual void print(std::ostream& stream) const;
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    const std::string& getIdentifier() const {return identifier;}
+   virtual harriet::VariableType getResultType() const {return resultType;}
+
+   /// the slot can be used instead of the identifier if the variable is bound to the environment
+   bool isBoundTo(const Environment& environment) const {return boundEnvironment==environment.getId() && boundLayoutVersion==environment.getLayoutVersion();}
+   const VariableSlot& getSlot() const {return slot;}
 
 protected:
    virtual uint8_t priority() const {throw;}
    virtual ExpressionType getExpressionType() const {return ExpressionType::TVariable;}
    virtual Associativity getAssociativity() const {throw;}
    std::string identifier;
+   harriet::VariableType resultType;
+   VariableSlot slot;
+   uint64_t boundEnvironment; // id of the environment the slot belongs to, 0 if unbound
+   uint64_t boundLayoutVersion;
 };
 //---------------------------------------------------------------------------
 class Value : public Expression {
 public:
-   virtual harriet::VariableType getResultType() const = 0;
 
    virtual std::unique_ptr<Value> computeAdd(const Value& rhs, const Environment& /*env*/) const {doError("+" , *this, rhs); throw;}
    virtual std::unique_ptr<Value> computeSub(const Value& rhs, const Environment& /*env*/) const {doError("-" , *this, rhs); throw;}
@@ -100,6 +119,7 @@ struct IntegerValue : public Value, GenericAllocator<IntegerValue> {
    using GenericAllocator<IntegerValue>::operator delete;
    virtual void print(std::ostream& stream) const;
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    int32_t result;
    IntegerValue(int32_t result) : result(result) {}
    virtual ~IntegerValue(){};
@@ -130,6 +150,7 @@ struct FloatValue : public Value, GenericAllocator<FloatValue> {
    using GenericAllocator<FloatValue>::operator delete;
    virtual void print(std::ostream& stream) const;
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    float result;
    FloatValue(float result) : result(result) {}
    virtual ~FloatValue(){};
@@ -158,6 +179,7 @@ struct BoolValue : public Value, GenericAllocator<BoolValue> {
    using GenericAllocator<BoolValue>::operator delete;
    virtual void print(std::ostream& stream) const;
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    bool result;
    BoolValue(bool result) : result(result) {}
    virtual ~BoolValue(){};
@@ -199,6 +221,7 @@ struct VectorValue : public Value, GenericAllocator<VectorValue> {
    using GenericAllocator<VectorValue>::operator delete;
    virtual void print(std::ostream& stream) const;
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    Vector3<float> result;
    VectorValue(const Vector3<float>& result) : result(result) {}
    virtual ~VectorValue(){};
@@ -219,37 +242,55 @@ struct VectorValue : public Value, GenericAllocator<VectorValue> {
 class UnaryOperator : public Expression {
    virtual void print(std::ostream& stream) const;
 public:
+   UnaryOperator() : resultType(harriet::VariableType::TInteger) {}
    virtual void addChild(std::unique_ptr<Expression> child);
    virtual ~UnaryOperator(){};
+   virtual OperatorType getOperatorType() const = 0;
+   virtual harriet::VariableType getResultType() const {return resultType;}
+   const Expression& getChild() const {return *child;}
 protected:
    virtual ExpressionType getExpressionType() const {return ExpressionType::TUnaryOperator;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType childType) const = 0; // throws if the operator does not accept the type
    std::unique_ptr<Expression> child;
+   harriet::VariableType resultType;
    virtual const std::string getSign() const = 0;
+   friend class ExpressionCatalog;
    friend class ExpressionParser;
+   friend class ExpressionOptimizer;
 };
 //---------------------------------------------------------------------------
 class UnaryMinusOperator : public UnaryOperator {
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
 protected:
    virtual Associativity getAssociativity() const {return Associativity::TRight;}
    virtual uint8_t priority() const {return 3;}
    virtual const std::string getSign() const {return "-";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TUnaryMinus;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType childType) const;
 };
 //---------------------------------------------------------------------------
 class NotOperator : public UnaryOperator {
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
 protected:
    virtual Associativity getAssociativity() const {return Associativity::TRight;}
    virtual uint8_t priority() const {return 3;}
    virtual const std::string getSign() const {return "!";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TNot;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType childType) const;
 };
 //---------------------------------------------------------------------------
 class CastOperator : public UnaryOperator {
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const; // uses getCastType to determin the result type
-protected:
+   virtual Scalar evaluateScalar(Environment& environment) const;
+public:
+   virtual OperatorType getOperatorType() const {return OperatorType::TCast;}
    virtual harriet::VariableType getCastType() const = 0;
+protected:
    virtual Associativity getAssociativity() const {return Associativity::TRight;}
    virtual uint8_t priority() const {return 3;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType /*childType*/) const {return getCastType();}
 };
 //---------------------------------------------------------------------------
 class IntegerCast : public CastOperator {
@@ -279,15 +320,24 @@ class VectorCast : public CastOperator {
 //---------------------------------------------------------------------------
 class BinaryOperator : public Expression {
 public:
+   BinaryOperator() : resultType(harriet::VariableType::TInteger) {}
    virtual ~BinaryOperator(){}
+   virtual OperatorType getOperatorType() const = 0;
+   virtual harriet::VariableType getResultType() const {return resultType;}
+   const Expression& getLhs() const {return *lhs;}
+   const Expression& getRhs() const {return *rhs;}
 protected:
    virtual void print(std::ostream& stream) const;
    virtual void addChildren(std::unique_ptr<Expression> lhsChild, std::unique_ptr<Expression> rhsChild);
    virtual ExpressionType getExpressionType() const {return ExpressionType::TBinaryOperator;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const = 0; // throws if the operator does not accept the types
    std::unique_ptr<Expression> lhs;
    std::unique_ptr<Expression> rhs;
+   harriet::VariableType resultType;
    virtual const std::string getSign() const = 0;
+   friend class ExpressionCatalog;
    friend class ExpressionParser;
+   friend class ExpressionOptimizer;
 };
 //---------------------------------------------------------------------------
 class AssignmentOperator : public BinaryOperator {
@@ -298,6 +348,8 @@ protected:
    virtual Associativity getAssociativity() const {return Associativity::TRight;}
    virtual uint8_t priority() const {return 16;}
    virtual const std::string getSign() const {return "=";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TAssignment;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class ArithmeticOperator : public BinaryOperator {
@@ -308,9 +360,12 @@ public:
    virtual ~PlusOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 6;}
    virtual const std::string getSign() const {return "+";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TPlus;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class MinusOperator : public ArithmeticOperator {
@@ -318,9 +373,12 @@ public:
    virtual ~MinusOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 6;}
    virtual const std::string getSign() const {return "-";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TMinus;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class MultiplicationOperator : public ArithmeticOperator {
@@ -328,9 +386,12 @@ public:
    virtual ~MultiplicationOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 5;}
    virtual const std::string getSign() const {return "*";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TMultiplication;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class DivisionOperator : public ArithmeticOperator {
@@ -338,9 +399,12 @@ public:
    virtual ~DivisionOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 5;}
    virtual const std::string getSign() const {return "/";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TDivision;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class ModuloOperator : public ArithmeticOperator {
@@ -348,9 +412,12 @@ public:
    virtual ~ModuloOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 5;}
    virtual const std::string getSign() const {return "%";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TModulo;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class ExponentiationOperator : public ArithmeticOperator {
@@ -358,12 +425,19 @@ public:
    virtual ~ExponentiationOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TRight;}
    virtual uint8_t priority() const {return 3;}
    virtual const std::string getSign() const {return "^";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TExponentiation;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class LogicOperator : public BinaryOperator {
+public:
+   /// bools short circuit (the rhs is only evaluated if the lhs does not decide the result), integers are combined bitwise. The choice is made
+   /// by the static types, a lhs which turns out not to be a bool at run time is combined with the rhs as before.
+   bool isShortCircuit() const {return resultType == harriet::VariableType::TBool;}
 };
 //---------------------------------------------------------------------------
 class AndOperator : public LogicOperator {
@@ -371,9 +445,12 @@ public:
    virtual ~AndOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 10;}
    virtual const std::string getSign() const {return "&";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TAnd;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class OrOperator : public LogicOperator {
@@ -381,9 +458,12 @@ public:
    virtual ~OrOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 12;}
    virtual const std::string getSign() const {return "|";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TOr;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class ComparisonOperator : public BinaryOperator {
@@ -396,9 +476,12 @@ public:
    virtual ~GreaterOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 8;}
    virtual const std::string getSign() const {return ">";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TGreater;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class LessOperator : public ComparisonOperator {
@@ -406,9 +489,12 @@ public:
    virtual ~LessOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 8;}
    virtual const std::string getSign() const {return "<";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TLess;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class GreaterEqualOperator : public ComparisonOperator {
@@ -416,9 +502,12 @@ public:
    virtual ~GreaterEqualOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 8;}
    virtual const std::string getSign() const {return ">=";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TGreaterEqual;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class LessEqualOperator : public ComparisonOperator {
@@ -426,9 +515,12 @@ public:
    virtual ~LessEqualOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 8;}
    virtual const std::string getSign() const {return "<=";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TLessEqual;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class EqualOperator : public ComparisonOperator {
@@ -436,9 +528,12 @@ public:
    virtual ~EqualOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 9;}
    virtual const std::string getSign() const {return "==";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TEqual;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class NotEqualOperator : public ComparisonOperator {
@@ -446,27 +541,108 @@ public:
    virtual ~NotEqualOperator(){}
 protected:
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
    virtual uint8_t priority() const {return 9;}
    virtual const std::string getSign() const {return "!=";}
+   virtual OperatorType getOperatorType() const {return OperatorType::TNotEqual;}
+   virtual harriet::VariableType inferResultType(harriet::VariableType lhsType, harriet::VariableType rhsType) const;
 };
 //---------------------------------------------------------------------------
 class FunctionOperator : public Expression { // AAA inherit from value ?
    virtual void print(std::ostream& stream) const;
 public:
-   FunctionOperator(const std::string& functionName, uint32_t functionIdentifier, std::vector<std::unique_ptr<Expression>>& arguments);
+   FunctionOperator(const std::string& functionName, uint32_t functionIdentifier, harriet::VariableType resultType, std::vector<std::unique_ptr<Expression>>& arguments);
+   FunctionOperator(const Function& function, const Environment& environment, std::vector<std::unique_ptr<Expression>>& arguments); // binds the call to the function
    virtual ~FunctionOperator(){}
+   virtual harriet::VariableType getResultType() const {return resultType;}
+   uint32_t getFunctionIdentifier() const {return functionIdentifier;}
+   const std::string& getFunctionName() const {return functionName;}
+   const std::vector<std::unique_ptr<Expression>>& getArguments() const {return arguments;}
+
+   /// the resolved function can be used instead of the lookup by id if the call is bound to the environment
+   bool isBoundTo(const Environment& environment) const {return boundEnvironment==environment.getId() && boundFunctionVersion==environment.getFunctionVersion();}
+   const Function& resolve(const Environment& environment) const {return isBoundTo(environment) ? *boundFunction : *environment.getFunction(functionIdentifier);}
+   /// the function the call was created for, nullptr if it was created unbound
+   const Function* getBoundFunction() const {return boundFunction;}
 protected:
    virtual ExpressionType getExpressionType() const {return ExpressionType::TFunctionOperator;}
    virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
    virtual uint8_t priority() const {return 0;}
    virtual Associativity getAssociativity() const {return Associativity::TLeft;}
+   Scalar callUnboxed(const Function& function, bool checkArguments, Environment& environment) const;
 
    const std::string functionName;
    const uint32_t functionIdentifier;
-   const std::vector<std::unique_ptr<Expression>> arguments;
+   const harriet::VariableType resultType;
+   std::vector<std::unique_ptr<Expression>> arguments;
+   const Function* boundFunction;
+   uint64_t boundEnvironment; // id of the environment the function was resolved in, 0 if unbound
+   uint64_t boundFunctionVersion;
 
    friend class ExpressionParser;
+   friend class ExpressionOptimizer;
+};
+//---------------------------------------------------------------------------
+class SharedExpressionScope;
+//---------------------------------------------------------------------------
+/// One occurrence of a sub tree which appears more than once in an expression (see ExpressionOptimizer::eliminateCommonSubexpressions). All
+/// occurrences point to the same node, the first one evaluated stores the result in the running evaluation of its scope, the others reuse it.
+class SharedExpression : public Expression {
+public:
+   SharedExpression(std::shared_ptr<Expression> child, uint32_t index, const SharedExpressionScope& scope) : child(std::move(child)), index(index), scope(&scope) {}
+   virtual ~SharedExpression(){}
+   virtual void print(std::ostream& stream) const {child->print(stream);}
+   virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
+   virtual harriet::VariableType getResultType() const {return child->getResultType();}
+   const Expression& getChild() const {return *child;}
+   uint32_t getIndex() const {return index;} // of the result in the scope
+protected:
+   virtual ExpressionType getExpressionType() const {return ExpressionType::TShared;}
+   virtual uint8_t priority() const {throw;}
+   virtual Associativity getAssociativity() const {throw;}
+   std::shared_ptr<Expression> child;
+   uint32_t index;
+   const SharedExpressionScope* scope;
+};
+//---------------------------------------------------------------------------
+/// Root of an expression with shared sub trees, each evaluation of the scope starts without any computed results
+class SharedExpressionScope : public Expression {
+public:
+   SharedExpressionScope() : sharedCount(0) {}
+   virtual ~SharedExpressionScope(){}
+   virtual void print(std::ostream& stream) const {child->print(stream);}
+   virtual std::unique_ptr<Value> evaluate(Environment& environment) const;
+   virtual Scalar evaluateScalar(Environment& environment) const;
+   virtual harriet::VariableType getResultType() const {return child->getResultType();}
+   const Expression& getChild() const {return *child;}
+   uint32_t getSharedCount() const {return sharedCount;}
+protected:
+   virtual ExpressionType getExpressionType() const {return ExpressionType::TSharedScope;}
+   virtual uint8_t priority() const {throw;}
+   virtual Associativity getAssociativity() const {throw;}
+   std::unique_ptr<Expression> child;
+   uint32_t sharedCount;
+   friend class ExpressionCatalog;
+   friend class ExpressionOptimizer;
+};
+//---------------------------------------------------------------------------
+/// The tree of an expression together with a compiled form of it (see ClosureExpression and BytecodeExpression). The tree is kept for printing,
+/// for the passes working on trees and for the cases the compiled form can not handle.
+class CompiledExpression : public Expression {
+public:
+   virtual ~CompiledExpression(){}
+   virtual void print(std::ostream& stream) const {tree->print(stream);}
+   virtual harriet::VariableType getResultType() const {return tree->getResultType();}
+   const Expression& getTree() const {return *tree;}
+protected:
+   explicit CompiledExpression(std::unique_ptr<Expression> tree) : tree(std::move(tree)) {}
+   virtual ExpressionType getExpressionType() const {return ExpressionType::TCompiled;}
+   virtual uint8_t priority() const {throw;}
+   virtual Associativity getAssociativity() const {throw;}
+   std::unique_ptr<Expression> tree;
 };
 //---------------------------------------------------------------------------
 } // end of namespace harriet
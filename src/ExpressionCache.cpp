@@ -0,0 +1,113 @@
+#include "ExpressionCache.hpp"
+#include "Environment.hpp"
+#include "EvaluationArena.hpp"
+#include "Expression.hpp"
+#include "Harriet.hpp"
+#include "ScriptLanguage.hpp"
+#include <cassert>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+ExpressionCache::Entry::~Entry()
+{
+}
+//---------------------------------------------------------------------------
+ExpressionCache::ExpressionCache(uint32_t capacity)
+: capacity(capacity)
+, hits(0)
+, misses(0)
+, evictions(0)
+{
+   if(capacity == 0)
+      throw harriet::Exception{"expression cache needs a capacity of at least one"};
+}
+//---------------------------------------------------------------------------
+ExpressionCache::~ExpressionCache()
+{
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> ExpressionCache::evaluate(const string& input, Environment& environment)
+{
+   return lookup(input, environment)->expression->evaluate(environment);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> ExpressionCache::evaluate(const string& input, Environment& environment, EvaluationArena& arena)
+{
+   auto entry = lookup(input, environment);
+   EvaluationArena::Scope scope(arena);
+   auto result = entry->expression->evaluate(environment);
+   return EvaluationArena::promote(::move(result), environment);
+}
+//---------------------------------------------------------------------------
+shared_ptr<const ExpressionCache::Entry> ExpressionCache::lookup(const string& input, Environment& environment)
+{
+   assert(EvaluationArena::active() == nullptr);
+   Key key{input, environment.getSignature()};
+   {
+      lock_guard<std::mutex> lock(mutex);
+      auto iter = index.find(key);
+      if(iter != index.end()) {
+         hits++;
+         entries.splice(entries.begin(), entries, iter->second);
+         return iter->second->second;
+      }
+      misses++;
+   }
+
+   // parse outside of the lock, a concurrent miss on the same key just parses twice
+   shared_ptr<Entry> entry = make_shared<Entry>();
+   entry->expression = harriet::parse(input, environment, Backend::TBytecode);
+
+   lock_guard<std::mutex> lock(mutex);
+   auto iter = index.find(key);
+   if(iter != index.end())
+      return iter->second->second;
+   entries.emplace_front(key, entry);
+   index.insert(make_pair(::move(key), entries.begin()));
+   if(entries.size() > capacity) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+      evictions++;
+   }
+   return entry;
+}
+//---------------------------------------------------------------------------
+void ExpressionCache::clear()
+{
+   lock_guard<std::mutex> lock(mutex);
+   index.clear();
+   entries.clear();
+}
+//---------------------------------------------------------------------------
+uint32_t ExpressionCache::getSize() const
+{
+   lock_guard<std::mutex> lock(mutex);
+   return entries.size();
+}
+//---------------------------------------------------------------------------
+uint64_t ExpressionCache::getHitCount() const
+{
+   lock_guard<std::mutex> lock(mutex);
+   return hits;
+}
+//---------------------------------------------------------------------------
+uint64_t ExpressionCache::getMissCount() const
+{
+   lock_guard<std::mutex> lock(mutex);
+   return misses;
+}
+//---------------------------------------------------------------------------
+uint64_t ExpressionCache::getEvictionCount() const
+{
+   lock_guard<std::mutex> lock(mutex);
+   return evictions;
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,78 @@
+#ifndef SCRIPTLANGUAGE_EXPRESSIONCACHE_HPP_
+#define SCRIPTLANGUAGE_EXPRESSIONCACHE_HPP_
+//---------------------------------------------------------------------------
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class EvaluationArena;
+class Expression;
+class Value;
+//---------------------------------------------------------------------------
+/// Bounded cache of parsed and compiled expressions, the least recently used one is evicted when the cache is full. The key is the input
+/// together with the signature of the environment (Environment::getSignature), which includes the identity of every function. So environments
+/// only share entries if they see the same function objects, e.g. through a common parent. Can be used by any number of threads, the cached
+/// expressions are only read.
+class ExpressionCache {
+public:
+   explicit ExpressionCache(uint32_t capacity = 1024);
+   ~ExpressionCache();
+
+   /// same as harriet::evaluate, a hit skips parsing and compiling
+   std::unique_ptr<Value> evaluate(const std::string& input, Environment& environment);
+   /// the cached expression outlives the arena => do not call the first version while an arena is active, but this one
+   std::unique_ptr<Value> evaluate(const std::string& input, Environment& environment, EvaluationArena& arena);
+
+   /// drops all expressions, the counters are kept
+   void clear();
+
+   uint32_t getCapacity() const {return capacity;}
+   uint32_t getSize() const;
+   uint64_t getHitCount() const;
+   uint64_t getMissCount() const;
+   uint64_t getEvictionCount() const;
+
+private:
+   struct Key {
+      std::string input;
+      uint64_t signature;
+      bool operator==(const Key& other) const {return signature==other.signature && input==other.input;}
+   };
+
+   struct KeyHash {
+      size_t operator()(const Key& key) const {return std::hash<std::string>()(key.input) ^ key.signature;}
+   };
+
+   /// shared with the evaluating threads => an evicted entry stays alive until they are done
+   struct Entry {
+      std::unique_ptr<Expression> expression; // with its bytecode if the vm can run it
+      ~Entry();
+   };
+
+   std::shared_ptr<const Entry> lookup(const std::string& input, Environment& environment);
+
+   const uint32_t capacity;
+   mutable std::mutex mutex;
+   std::list<std::pair<Key, std::shared_ptr<const Entry>>> entries; // most recently used first
+   std::unordered_map<Key, decltype(entries)::iterator, KeyHash> index;
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+
+   ExpressionCache(const ExpressionCache&) = delete;
+   ExpressionCache& operator=(const ExpressionCache&) = delete;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
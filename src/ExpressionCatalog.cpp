@@ -0,0 +1,524 @@
+#include "ExpressionCatalog.hpp"
+#include "ClosureProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include "Utility.hpp"
+#include <cstring>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HARRIET_MMAP 1
+#endif
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+const char kMagic[4] = {'H', 'R', 'T', 'C'};
+//---------------------------------------------------------------------------
+/// first byte of every node
+enum struct NodeKind : uint8_t {TInteger, TFloat, TBool, TString, TVector, TVariable, TUnary, TBinary, TCall, TShared, TSharedReference, TSharedScope};
+//---------------------------------------------------------------------------
+const uint8_t kUnaryMinus = 0, kNot = 1, kCast = 2;
+//---------------------------------------------------------------------------
+void corrupt()
+{
+   throw harriet::Exception{"catalog is corrupt"};
+}
+//---------------------------------------------------------------------------
+template<class T>
+void put(string& bytes, T value)
+{
+   for(uint32_t i=0; i<sizeof(T); i++)
+      bytes.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8*i)));
+}
+//---------------------------------------------------------------------------
+void putFloat(string& bytes, float value)
+{
+   uint32_t word;
+   memcpy(&word, &value, sizeof(word));
+   put(bytes, word);
+}
+//---------------------------------------------------------------------------
+void putString(string& bytes, const string& value)
+{
+   put<uint32_t>(bytes, value.size());
+   bytes += value;
+}
+//---------------------------------------------------------------------------
+/// bounds checked reading of the file
+struct Reader {
+   const char* position;
+   const char* end;
+
+   template<class T> T get() {
+      if(uint64_t(end-position) < sizeof(T))
+         corrupt();
+      uint64_t value = 0;
+      for(uint32_t i=0; i<sizeof(T); i++)
+         value |= static_cast<uint64_t>(static_cast<uint8_t>(*position++)) << (8*i);
+      return static_cast<T>(value);
+   }
+   float getFloat() {
+      uint32_t word = get<uint32_t>();
+      float value;
+      memcpy(&value, &word, sizeof(value));
+      return value;
+   }
+   string getString() {
+      uint32_t length = get<uint32_t>();
+      if(uint64_t(end-position) < length)
+         corrupt();
+      string result(position, length);
+      position += length;
+      return result;
+   }
+   harriet::VariableType getType() {
+      uint8_t type = get<uint8_t>();
+      if(type > static_cast<uint8_t>(harriet::VariableType::TVector))
+         corrupt();
+      return static_cast<harriet::VariableType>(type);
+   }
+};
+//---------------------------------------------------------------------------
+/// state while serializing one catalog
+struct Writer {
+   string nodes;
+   string functions;
+   uint32_t functionCount;
+   unordered_map<string, uint32_t> signatures; // name, purity and types => index in the function table
+   vector<bool> writtenShared; // of the current scope
+
+   void write(const Expression& expression, uint32_t depth) {
+      if(depth >= ExpressionCatalog::kMaxDepth)
+         throw harriet::Exception{"expression is nested too deeply to be stored in a catalog"};
+      switch(expression.getExpressionType()) {
+         case ExpressionType::TValue: {
+            auto& value = reinterpret_cast<const Value&>(expression);
+            switch(value.getResultType()) {
+               case harriet::VariableType::TInteger: put(nodes, NodeKind::TInteger); put(nodes, reinterpret_cast<const IntegerValue&>(value).result); return;
+               case harriet::VariableType::TFloat:   put(nodes, NodeKind::TFloat); putFloat(nodes, reinterpret_cast<const FloatValue&>(value).result); return;
+               case harriet::VariableType::TBool:    put(nodes, NodeKind::TBool); put<uint8_t>(nodes, reinterpret_cast<const BoolValue&>(value).result); return;
+               case harriet::VariableType::TString:  put(nodes, NodeKind::TString); putString(nodes, reinterpret_cast<const StringValue&>(value).result); return;
+               case harriet::VariableType::TVector: {
+                  auto& vector = reinterpret_cast<const VectorValue&>(value).result;
+                  put(nodes, NodeKind::TVector); putFloat(nodes, vector.x); putFloat(nodes, vector.y); putFloat(nodes, vector.z);
+                  return;
+               }
+            }
+            return;
+         }
+         case ExpressionType::TVariable: {
+            auto& variable = reinterpret_cast<const Variable&>(expression);
+            put(nodes, NodeKind::TVariable);
+            putString(nodes, variable.getIdentifier());
+            put(nodes, variable.getResultType());
+            return;
+         }
+         case ExpressionType::TUnaryOperator: {
+            auto& unary = reinterpret_cast<const UnaryOperator&>(expression);
+            put(nodes, NodeKind::TUnary);
+            switch(unary.getOperatorType()) {
+               case OperatorType::TUnaryMinus: put(nodes, kUnaryMinus); break;
+               case OperatorType::TNot:        put(nodes, kNot); break;
+               default: {
+                  // the cast type of a vector cast is string (see VectorCast) => its class tells them apart
+                  auto target = dynamic_cast<const VectorCast*>(&unary)!=nullptr ? harriet::VariableType::TVector : reinterpret_cast<const CastOperator&>(unary).getCastType();
+                  put(nodes, kCast);
+                  put(nodes, target);
+                  break;
+               }
+            }
+            return write(unary.getChild(), depth+1);
+         }
+         case ExpressionType::TBinaryOperator: {
+            auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+            put(nodes, NodeKind::TBinary);
+            put(nodes, binary.getOperatorType());
+            put(nodes, binary.getResultType());
+            write(binary.getLhs(), depth+1);
+            return write(binary.getRhs(), depth+1);
+         }
+         case ExpressionType::TFunctionOperator: {
+            // the parser cast the arguments to the types of the function => they are its signature
+            auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+            if(call.getBoundFunction() == nullptr)
+               throw harriet::Exception{"call of '" + call.getFunctionName() + "' is not bound to a function"};
+            bool pure = call.getBoundFunction()->isPure();
+            string key = call.getFunctionName() + (pure ? "[pure](" : "(") + to_string(static_cast<uint32_t>(call.getResultType()));
+            for(auto& argument : call.getArguments())
+               key += "," + to_string(static_cast<uint32_t>(argument->getResultType()));
+            auto iter = signatures.find(key);
+            if(iter == signatures.end()) {
+               iter = signatures.insert(make_pair(key, functionCount++)).first;
+               putString(functions, call.getFunctionName());
+               put<uint8_t>(functions, pure);
+               put(functions, call.getResultType());
+               put<uint8_t>(functions, call.getArguments().size());
+               for(auto& argument : call.getArguments())
+                  put(functions, argument->getResultType());
+            }
+            put(nodes, NodeKind::TCall);
+            put(nodes, iter->second);
+            put<uint8_t>(nodes, call.getArguments().size());
+            for(auto& argument : call.getArguments())
+               write(*argument, depth+1);
+            return;
+         }
+         case ExpressionType::TShared: {
+            // the first occurrence carries the sub tree, the others refer to it
+            auto& shared = reinterpret_cast<const SharedExpression&>(expression);
+            if(shared.getIndex() >= writtenShared.size())
+               writtenShared.resize(shared.getIndex()+1, false);
+            if(writtenShared[shared.getIndex()]) {
+               put(nodes, NodeKind::TSharedReference);
+               put(nodes, shared.getIndex());
+               return;
+            }
+            writtenShared[shared.getIndex()] = true;
+            put(nodes, NodeKind::TShared);
+            put(nodes, shared.getIndex());
+            return write(shared.getChild(), depth+1);
+         }
+         case ExpressionType::TSharedScope: {
+            auto& scope = reinterpret_cast<const SharedExpressionScope&>(expression);
+            auto outer = ::move(writtenShared);
+            writtenShared.clear();
+            put(nodes, NodeKind::TSharedScope);
+            put(nodes, scope.getSharedCount());
+            write(scope.getChild(), depth+1);
+            writtenShared = ::move(outer);
+            return;
+         }
+         case ExpressionType::TCompiled:
+            return write(reinterpret_cast<const CompiledExpression&>(expression).getTree(), depth);
+         default:
+            throw harriet::Exception{"unable to store expression in a catalog"};
+      }
+   }
+};
+//---------------------------------------------------------------------------
+unique_ptr<BinaryOperator> createBinary(OperatorType operatorType)
+{
+   switch(operatorType) {
+      case OperatorType::TAssignment:     return make_unique<AssignmentOperator>();
+      case OperatorType::TPlus:           return make_unique<PlusOperator>();
+      case OperatorType::TMinus:          return make_unique<MinusOperator>();
+      case OperatorType::TMultiplication: return make_unique<MultiplicationOperator>();
+      case OperatorType::TDivision:       return make_unique<DivisionOperator>();
+      case OperatorType::TModulo:         return make_unique<ModuloOperator>();
+      case OperatorType::TExponentiation: return make_unique<ExponentiationOperator>();
+      case OperatorType::TAnd:            return make_unique<AndOperator>();
+      case OperatorType::TOr:             return make_unique<OrOperator>();
+      case OperatorType::TGreater:        return make_unique<GreaterOperator>();
+      case OperatorType::TLess:           return make_unique<LessOperator>();
+      case OperatorType::TGreaterEqual:   return make_unique<GreaterEqualOperator>();
+      case OperatorType::TLessEqual:      return make_unique<LessEqualOperator>();
+      case OperatorType::TEqual:          return make_unique<EqualOperator>();
+      case OperatorType::TNotEqual:       return make_unique<NotEqualOperator>();
+      default:                            corrupt(); throw;
+   }
+}
+//---------------------------------------------------------------------------
+unique_ptr<UnaryOperator> createUnary(uint8_t kind, harriet::VariableType target)
+{
+   if(kind == kUnaryMinus)
+      return make_unique<UnaryMinusOperator>();
+   if(kind == kNot)
+      return make_unique<NotOperator>();
+   switch(target) {
+      case harriet::VariableType::TInteger: return make_unique<IntegerCast>();
+      case harriet::VariableType::TFloat:   return make_unique<FloatCast>();
+      case harriet::VariableType::TBool:    return make_unique<BoolCast>();
+      case harriet::VariableType::TString:  return make_unique<StringCast>();
+      default:                              return make_unique<VectorCast>();
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// state while loading one expression
+struct ExpressionCatalog::Loading {
+   const Environment& environment;
+   Reader reader;
+   vector<const Function*> functions; // resolved on first use
+   vector<shared_ptr<Expression>> shared; // of the current scope
+   const SharedExpressionScope* scope;
+};
+//---------------------------------------------------------------------------
+string ExpressionCatalog::serialize(const vector<pair<string, const Expression*>>& expressions)
+{
+   Writer writer;
+   writer.functionCount = 0;
+   vector<uint64_t> offsets;
+   for(auto& expression : expressions) {
+      offsets.push_back(writer.nodes.size());
+      writer.write(*expression.second, 0);
+   }
+
+   string index;
+   for(uint32_t i=0; i<expressions.size(); i++) {
+      putString(index, expressions[i].first);
+      put<uint64_t>(index, 0); // patched below, the size of the index is not known before
+   }
+   uint64_t nodesBegin = 16 + writer.functions.size() + index.size();
+   for(uint32_t i=0, position=0; i<expressions.size(); i++) {
+      position += 4 + expressions[i].first.size();
+      string offset;
+      put<uint64_t>(offset, nodesBegin + offsets[i]);
+      index.replace(position, 8, offset);
+      position += 8;
+   }
+
+   string result(kMagic, sizeof(kMagic));
+   put(result, kVersion);
+   put(result, writer.functionCount);
+   put<uint32_t>(result, expressions.size());
+   return result + writer.functions + index + writer.nodes;
+}
+//---------------------------------------------------------------------------
+void ExpressionCatalog::save(const string& path, const vector<pair<string, const Expression*>>& expressions)
+{
+   string bytes = serialize(expressions);
+   ofstream out(path, ios::binary);
+   out.write(bytes.data(), bytes.size());
+   if(!out)
+      throw harriet::Exception{"unable to write catalog '" + path + "'"};
+}
+//---------------------------------------------------------------------------
+ExpressionCatalog::ExpressionCatalog(const string& path)
+: data(nullptr)
+, dataSize(0)
+, mapping(nullptr)
+{
+#ifdef HARRIET_MMAP
+   int file = ::open(path.c_str(), O_RDONLY);
+   if(file < 0)
+      throw harriet::Exception{"unable to open catalog '" + path + "'"};
+   struct stat status;
+   if(fstat(file, &status)!=0 || status.st_size==0) {
+      close(file);
+      throw harriet::Exception{"'" + path + "' is no harriet catalog"};
+   }
+   void* memory = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+   close(file);
+   if(memory == MAP_FAILED)
+      throw harriet::Exception{"unable to map catalog '" + path + "'"};
+   mapping = memory;
+   data = static_cast<const char*>(memory);
+   dataSize = status.st_size;
+#else
+   ifstream in(path, ios::binary);
+   if(!in)
+      throw harriet::Exception{"unable to open catalog '" + path + "'"};
+   string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+   char* memory = new char[bytes.size()];
+   memcpy(memory, bytes.data(), bytes.size());
+   mapping = memory;
+   data = memory;
+   dataSize = bytes.size();
+#endif
+   try {
+      open();
+   } catch(...) {
+      release();
+      throw;
+   }
+}
+//---------------------------------------------------------------------------
+ExpressionCatalog::ExpressionCatalog(const char* data, uint64_t size)
+: data(data)
+, dataSize(size)
+, mapping(nullptr)
+{
+   open();
+}
+//---------------------------------------------------------------------------
+ExpressionCatalog::~ExpressionCatalog()
+{
+   release();
+}
+//---------------------------------------------------------------------------
+void ExpressionCatalog::release()
+{
+   if(mapping == nullptr)
+      return;
+#ifdef HARRIET_MMAP
+   munmap(mapping, dataSize);
+#else
+   delete[] static_cast<char*>(mapping);
+#endif
+   mapping = nullptr;
+}
+//---------------------------------------------------------------------------
+void ExpressionCatalog::open()
+{
+   // only the header, the function table and the index are read, the nodes when an expression is loaded
+   Reader reader{data, data+dataSize};
+   if(dataSize<sizeof(kMagic) || memcmp(data, kMagic, sizeof(kMagic))!=0)
+      throw harriet::Exception{"data is no harriet catalog"};
+   reader.position += sizeof(kMagic);
+   uint32_t version = reader.get<uint32_t>();
+   if(version != kVersion)
+      throw harriet::Exception{"catalog has version " + to_string(version) + ", expected " + to_string(kVersion)};
+
+   uint32_t functionCount = reader.get<uint32_t>();
+   uint32_t expressionCount = reader.get<uint32_t>();
+   for(uint32_t i=0; i<functionCount; i++) {
+      Signature signature;
+      signature.name = reader.getString();
+      signature.pure = reader.get<uint8_t>() != 0;
+      signature.resultType = reader.getType();
+      uint8_t argumentCount = reader.get<uint8_t>();
+      for(uint32_t j=0; j<argumentCount; j++)
+         signature.argumentTypes.push_back(reader.getType());
+      functions.push_back(::move(signature));
+   }
+   for(uint32_t i=0; i<expressionCount; i++) {
+      names.push_back(reader.getString());
+      offsets.push_back(reader.get<uint64_t>());
+      if(offsets.back() >= dataSize)
+         corrupt();
+      indices[names.back()] = i;
+   }
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionCatalog::load(const string& name, const Environment& environment) const
+{
+   auto iter = indices.find(name);
+   if(iter == indices.end())
+      throw harriet::Exception{"catalog has no expression '" + name + "'"};
+   return load(iter->second, environment);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionCatalog::load(uint32_t index, const Environment& environment) const
+{
+   if(index >= offsets.size())
+      throw harriet::Exception{"catalog has no expression " + to_string(index) + ", it has " + to_string(offsets.size())};
+   Loading loading{environment, Reader{data+offsets[index], data+dataSize}, vector<const Function*>(functions.size(), nullptr), {}, nullptr};
+   return loadNode(loading, 0);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionCatalog::loadNode(Loading& loading, uint32_t depth) const
+{
+   // the writer rejects deeper expressions => the recursion is bounded for any file
+   if(depth >= kMaxDepth)
+      corrupt();
+   auto& reader = loading.reader;
+   auto kind = static_cast<NodeKind>(reader.get<uint8_t>());
+   switch(kind) {
+      case NodeKind::TInteger:
+         return make_unique<IntegerValue>(reader.get<int32_t>());
+      case NodeKind::TFloat:
+         return make_unique<FloatValue>(reader.getFloat());
+      case NodeKind::TBool:
+         return make_unique<BoolValue>(reader.get<uint8_t>()!=0);
+      case NodeKind::TString:
+         return make_unique<StringValue>(reader.getString());
+      case NodeKind::TVector: {
+         float x = reader.getFloat(), y = reader.getFloat(), z = reader.getFloat();
+         return make_unique<VectorValue>(Vector3<float>(x, y, z));
+      }
+      case NodeKind::TVariable: {
+         string identifier = reader.getString();
+         auto type = reader.getType();
+         auto variable = make_unique<Variable>(identifier, loading.environment);
+         if(variable->getResultType() != type)
+            throw harriet::Exception{"variable '" + identifier + "' has type '" + harriet::typeToName(variable->getResultType()) + "' instead of '" + harriet::typeToName(type) + "'"};
+         return ::move(variable);
+      }
+      case NodeKind::TUnary: {
+         uint8_t operatorKind = reader.get<uint8_t>();
+         if(operatorKind > kCast)
+            corrupt();
+         auto target = operatorKind==kCast ? reader.getType() : harriet::VariableType::TInteger;
+         auto unary = createUnary(operatorKind, target);
+         unary->addChild(loadNode(loading, depth+1));
+         return ::move(unary);
+      }
+      case NodeKind::TBinary: {
+         uint8_t operatorType = reader.get<uint8_t>();
+         if(operatorType > static_cast<uint8_t>(OperatorType::TNotEqual))
+            corrupt();
+         auto resultType = reader.getType();
+         auto binary = createBinary(static_cast<OperatorType>(operatorType));
+         auto lhs = loadNode(loading, depth+1);
+         binary->addChildren(::move(lhs), loadNode(loading, depth+1));
+         if(binary->getResultType() != resultType)
+            corrupt();
+         return ::move(binary);
+      }
+      case NodeKind::TCall: {
+         uint32_t index = reader.get<uint32_t>();
+         if(index >= functions.size())
+            corrupt();
+         auto& signature = functions[index];
+         if(loading.functions[index] == nullptr) {
+            loading.environment.forEachFunction(signature.name, [&](const Function& function) {
+               bool match = function.getResultType()==signature.resultType && function.getArgumentCount()==signature.argumentTypes.size();
+               for(uint32_t i=0; match && i<signature.argumentTypes.size(); i++)
+                  match = function.getArgumentType(i)==signature.argumentTypes[i];
+               if(match && function.isPure()!=signature.pure)
+                  throw harriet::Exception{"function '" + signature.name + "' is " + (signature.pure ? "pure" : "impure") + " in the catalog but " + (function.isPure() ? "pure" : "impure") + " in the environment"};
+               if(match)
+                  loading.functions[index] = &function;
+            });
+            if(loading.functions[index] == nullptr) {
+               string types;
+               for(auto type : signature.argumentTypes)
+                  types += (types.empty() ? "" : ",") + harriet::typeToName(type);
+               throw harriet::Exception{"environment has no function '" + harriet::typeToName(signature.resultType) + " " + signature.name + "(" + types + ")'"};
+            }
+         }
+         uint8_t argumentCount = reader.get<uint8_t>();
+         if(argumentCount != signature.argumentTypes.size())
+            corrupt();
+         vector<unique_ptr<Expression>> arguments;
+         for(uint32_t i=0; i<argumentCount; i++) {
+            arguments.push_back(loadNode(loading, depth+1));
+            if(arguments.back()->getResultType() != signature.argumentTypes[i])
+               corrupt();
+         }
+         return make_unique<FunctionOperator>(*loading.functions[index], loading.environment, arguments);
+      }
+      case NodeKind::TShared:
+      case NodeKind::TSharedReference: {
+         uint32_t index = reader.get<uint32_t>();
+         if(loading.scope==nullptr || index>=loading.shared.size() || (kind==NodeKind::TShared)==(loading.shared[index]!=nullptr))
+            corrupt();
+         if(kind == NodeKind::TShared)
+            loading.shared[index] = shared_ptr<Expression>(loadNode(loading, depth+1).release());
+         return make_unique<SharedExpression>(loading.shared[index], index, *loading.scope);
+      }
+      case NodeKind::TSharedScope: {
+         auto scope = make_unique<SharedExpressionScope>();
+         scope->sharedCount = reader.get<uint32_t>();
+         if(scope->sharedCount > dataSize)
+            corrupt();
+         auto outerShared = ::move(loading.shared);
+         auto outerScope = loading.scope;
+         loading.shared.assign(scope->sharedCount, nullptr);
+         loading.scope = scope.get();
+         scope->child = loadNode(loading, depth+1);
+         loading.shared = ::move(outerShared);
+         loading.scope = outerScope;
+         return ::move(scope);
+      }
+      default:
+         corrupt();
+         throw;
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
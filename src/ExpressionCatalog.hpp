@@ -0,0 +1,80 @@
+#ifndef SCRIPTLANGUAGE_EXPRESSIONCATALOG_HPP_
+#define SCRIPTLANGUAGE_EXPRESSIONCATALOG_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class Expression;
+//---------------------------------------------------------------------------
+/// A file of named, already parsed expressions. Loading one only rebuilds its nodes: there is no lexing, no type inference from strings and
+/// no overload resolution. Variables are bound by name, functions by name and signature; both are checked against the target environment.
+///
+/// Format (little endian, strings are a uint32_t length and the bytes):
+///    header      "HRTC", uint32_t version, uint32_t function count, uint32_t expression count
+///    functions   per function: name, uint8_t pure, uint8_t result type, uint8_t argument count, uint8_t argument types
+///    index       per expression: name, uint64_t offset of its nodes from the start of the file
+///    nodes       prefix order, every node starts with its NodeKind (see ExpressionCatalog.cpp)
+/// Types and operators are stored as the values of VariableType and OperatorType, changing these enums requires a new version. Functions
+/// have to match in purity as well, the optimizer folded and shared the calls of pure ones. Nodes are nested at most kMaxDepth deep.
+class ExpressionCatalog {
+public:
+   static const uint32_t kVersion = 2;
+   static const uint32_t kMaxDepth = 4096;
+
+   /// the catalog file of the expressions
+   static std::string serialize(const std::vector<std::pair<std::string, const Expression*>>& expressions);
+   static void save(const std::string& path, const std::vector<std::pair<std::string, const Expression*>>& expressions);
+
+   /// maps the file, throws harriet::Exception if it is no catalog or has another version
+   explicit ExpressionCatalog(const std::string& path);
+   /// uses the memory, which has to outlive the catalog
+   ExpressionCatalog(const char* data, uint64_t size);
+   ~ExpressionCatalog();
+   ExpressionCatalog(const ExpressionCatalog&) = delete;
+   ExpressionCatalog& operator=(const ExpressionCatalog&) = delete;
+
+   uint32_t size() const {return names.size();}
+   const std::string& getName(uint32_t index) const {return names[index];}
+   bool contains(const std::string& name) const {return indices.count(name)!=0;}
+
+   /// builds the expression bound to the environment, throws if it is not in the catalog or a variable or function is missing or differs
+   std::unique_ptr<Expression> load(const std::string& name, const Environment& environment) const;
+   std::unique_ptr<Expression> load(uint32_t index, const Environment& environment) const;
+
+private:
+   struct Signature {
+      std::string name;
+      bool pure;
+      harriet::VariableType resultType;
+      std::vector<harriet::VariableType> argumentTypes;
+   };
+   struct Loading;
+
+   void open();
+   void release();
+   std::unique_ptr<Expression> loadNode(Loading& loading, uint32_t depth) const;
+
+   const char* data;
+   uint64_t dataSize;
+   void* mapping; // of the file, nullptr if the memory was given
+   std::vector<Signature> functions;
+   std::vector<std::string> names;
+   std::vector<uint64_t> offsets;
+   std::unordered_map<std::string, uint32_t> indices;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
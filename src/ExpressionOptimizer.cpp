@@ -0,0 +1,452 @@
+#include "ExpressionOptimizer.hpp"
+#include "Expression.hpp"
+#include "Environment.hpp"
+#include "Function.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+const uint32_t kNoSubtree = ~0u;
+//---------------------------------------------------------------------------
+bool isValue(const Expression& expression)
+{
+   return expression.getExpressionType() == ExpressionType::TValue;
+}
+//---------------------------------------------------------------------------
+/// int or float literal with the given value, -0.0 does not count as 0
+bool isNumber(const Expression& expression, int32_t number)
+{
+   if(!isValue(expression))
+      return false;
+   switch(expression.getResultType()) {
+      case harriet::VariableType::TInteger: return reinterpret_cast<const IntegerValue&>(expression).result == number;
+      case harriet::VariableType::TFloat:   return reinterpret_cast<const FloatValue&>(expression).result == number && !signbit(reinterpret_cast<const FloatValue&>(expression).result);
+      default:                                     return false;
+   }
+}
+//---------------------------------------------------------------------------
+/// x/0, INT_MIN/-1 and their modulo versions trap (Vector3::div asserts), these are left for the evaluation to fail on
+bool isHazardousDivisor(const Expression& operand)
+{
+   switch(operand.getResultType()) {
+      case harriet::VariableType::TInteger: return reinterpret_cast<const IntegerValue&>(operand).result==0 || reinterpret_cast<const IntegerValue&>(operand).result==-1;
+      case harriet::VariableType::TFloat:   return reinterpret_cast<const FloatValue&>(operand).result==0;
+      default:                                     return false;
+   }
+}
+//---------------------------------------------------------------------------
+bool mayTrap(const BinaryOperator& binary)
+{
+   if(binary.getOperatorType()!=OperatorType::TDivision && binary.getOperatorType()!=OperatorType::TModulo)
+      return false;
+   return isHazardousDivisor(binary.getLhs()) || isHazardousDivisor(binary.getRhs()); // int/vector divides the vector by the lhs
+}
+//---------------------------------------------------------------------------
+/// x op literal gives back x unchanged for int and float x if the type does not change
+bool isIdentity(const Expression& result, const Expression& operand)
+{
+   return result.getResultType()==operand.getResultType() && (operand.getResultType()==harriet::VariableType::TInteger || operand.getResultType()==harriet::VariableType::TFloat);
+}
+//---------------------------------------------------------------------------
+/// collects the variables the expression assigns to, sets impureCalls if it calls a function which is not pure (these may write any variable)
+void collectAssignments(const Expression& expression, Environment& environment, unordered_set<string>& assigned, bool& impureCalls)
+{
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TUnaryOperator:
+         return collectAssignments(reinterpret_cast<const UnaryOperator&>(expression).getChild(), environment, assigned, impureCalls);
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+         if(binary.getOperatorType() == OperatorType::TAssignment)
+            assigned.insert(reinterpret_cast<const Variable&>(binary.getLhs()).getIdentifier());
+         collectAssignments(binary.getLhs(), environment, assigned, impureCalls);
+         return collectAssignments(binary.getRhs(), environment, assigned, impureCalls);
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         impureCalls |= !environment.getFunction(call.getFunctionIdentifier())->isPure();
+         for(auto& iter : call.getArguments())
+            collectAssignments(*iter, environment, assigned, impureCalls);
+         return;
+      }
+      default:
+         return;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::optimize(unique_ptr<Expression> expression, Environment& environment)
+{
+   uint32_t eliminated = 0;
+   return eliminateCommonSubexpressions(simplify(::move(expression), environment), environment, eliminated);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::simplify(unique_ptr<Expression> expression, Environment& environment)
+{
+   unique_ptr<Expression> replacement;
+   switch(expression->getExpressionType()) {
+      case ExpressionType::TUnaryOperator:    replacement = optimizeUnary(reinterpret_cast<UnaryOperator&>(*expression), environment); break;
+      case ExpressionType::TBinaryOperator:   replacement = optimizeBinary(reinterpret_cast<BinaryOperator&>(*expression), environment); break;
+      case ExpressionType::TFunctionOperator: replacement = optimizeFunction(reinterpret_cast<FunctionOperator&>(*expression), environment); break;
+      default:                                break;
+   }
+   return replacement!=nullptr ? ::move(replacement) : ::move(expression);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::optimizeUnary(UnaryOperator& unary, Environment& environment)
+{
+   unary.child = simplify(::move(unary.child), environment);
+
+   // constant operand (includes casts of constants)
+   if(isValue(*unary.child))
+      return fold(unary, environment);
+
+   // --x and !!x
+   if(unary.getOperatorType()!=OperatorType::TCast && unary.child->getExpressionType()==ExpressionType::TUnaryOperator) {
+      auto& inner = reinterpret_cast<UnaryOperator&>(*unary.child);
+      if(inner.getOperatorType() == unary.getOperatorType())
+         return ::move(inner.child);
+   }
+   return nullptr;
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::optimizeBinary(BinaryOperator& binary, Environment& environment)
+{
+   // the lhs of an assignment has to stay a variable
+   if(binary.getOperatorType() != OperatorType::TAssignment)
+      binary.lhs = simplify(::move(binary.lhs), environment);
+   binary.rhs = simplify(::move(binary.rhs), environment);
+   if(binary.getOperatorType() == OperatorType::TAssignment)
+      return nullptr;
+
+   // constant operands
+   if(isValue(*binary.lhs) && isValue(*binary.rhs))
+      return mayTrap(binary) ? nullptr : fold(binary, environment);
+
+   // identities, x+0 is not one for floats (-0+0 is +0)
+   switch(binary.getOperatorType()) {
+      case OperatorType::TMultiplication:
+         if(isNumber(*binary.rhs, 1) && isIdentity(binary, *binary.lhs))
+            return ::move(binary.lhs);
+         if(isNumber(*binary.lhs, 1) && isIdentity(binary, *binary.rhs))
+            return ::move(binary.rhs);
+         return nullptr;
+      case OperatorType::TDivision:
+         if(isNumber(*binary.rhs, 1) && isIdentity(binary, *binary.lhs))
+            return ::move(binary.lhs);
+         return nullptr;
+      case OperatorType::TPlus:
+         if(binary.getResultType() != harriet::VariableType::TInteger)
+            return nullptr;
+         if(isNumber(*binary.rhs, 0) && isIdentity(binary, *binary.lhs))
+            return ::move(binary.lhs);
+         if(isNumber(*binary.lhs, 0) && isIdentity(binary, *binary.rhs))
+            return ::move(binary.rhs);
+         return nullptr;
+      case OperatorType::TMinus:
+         if(isNumber(*binary.rhs, 0) && isIdentity(binary, *binary.lhs))
+            return ::move(binary.lhs);
+         return nullptr;
+      default:
+         return nullptr;
+   }
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::optimizeFunction(FunctionOperator& function, Environment& environment)
+{
+   bool constantArguments = true;
+   for(auto& iter : function.arguments) {
+      iter = simplify(::move(iter), environment);
+      constantArguments &= isValue(*iter);
+   }
+
+   // only pure functions can be called ahead of time
+   if(constantArguments && environment.getFunction(function.getFunctionIdentifier())->isPure())
+      return fold(function, environment);
+   return nullptr;
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::fold(const Expression& expression, Environment& environment)
+{
+   try {
+      auto result = expression.evaluate(environment);
+      if(result->getResultType() == expression.getResultType())
+         return ::move(result);
+   } catch(harriet::Exception&) {
+      // keep the expression, evaluating it reports the error
+   }
+   return nullptr;
+}
+//---------------------------------------------------------------------------
+struct ExpressionOptimizer::Sharing {
+   struct Subtree {
+      uint32_t count; // occurrences, copies inside of shared sub trees are no longer counted
+      uint32_t size; // nodes in the tree
+      uint32_t position; // of the first occurrence in preorder, its children follow it there
+      uint32_t childCount;
+      uint32_t sameHash; // next sub tree with the same hash or kNoSubtree
+      bool pure; // may be part of a shared sub tree
+      bool worthSharing; // a pure operator or call with a non string result
+      bool shared;
+      shared_ptr<Expression> node; // set once the first occurrence is rewritten
+      uint32_t index;
+   };
+
+   /// the number of the first child of the node at the position, the next sibling of a node follows its sub tree
+   uint32_t firstChild(uint32_t position) const {return position + 1;}
+   uint32_t nextSibling(uint32_t position) const {return position + subtrees[preorder[position]].size;}
+
+   /// the copies of a shared sub tree are gone => so are the copies of everything inside of it
+   void release(uint32_t subtree, uint32_t copies)
+   {
+      subtrees[subtree].count -= copies;
+      uint32_t child = firstChild(subtrees[subtree].position);
+      for(uint32_t i=0; i<subtrees[subtree].childCount; i++, child=nextSibling(child))
+         release(preorder[child], copies);
+   }
+
+   vector<Subtree> subtrees;
+   vector<const Expression*> representatives; // first occurrence of each sub tree
+   vector<uint32_t> preorder; // number of every node of the tree
+   unordered_map<uint64_t, uint32_t> hashes; // structural hash -> first sub tree with it
+   bool repeated; // some sub tree occurs twice
+   unordered_set<string> assigned;
+   bool impureCalls; // may write any variable => no sub tree reading one is shared
+   SharedExpressionScope* scope;
+   uint32_t sharedCount;
+   uint32_t eliminated;
+};
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+uint64_t combine(uint64_t hash, uint64_t data)
+{
+   hash ^= data + 0x9e3779b97f4a7c15ull + (hash<<6) + (hash>>2);
+   return hash;
+}
+//---------------------------------------------------------------------------
+/// hash of the node's own data, the class and the children are added by the caller
+uint64_t hashPayload(const Expression& expression)
+{
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TValue: {
+         if(expression.getResultType() == harriet::VariableType::TString)
+            return hash<string>()(reinterpret_cast<const StringValue&>(expression).result);
+         Scalar value = Scalar::fromValue(reinterpret_cast<const Value&>(expression));
+         uint64_t bits = 0;
+         switch(value.type) {
+            case harriet::VariableType::TBool:   return value.boolean;
+            case harriet::VariableType::TVector: memcpy(&bits, value.vector, sizeof(bits)); return combine(bits, hash<float>()(value.vector[2]));
+            default:                             return static_cast<uint32_t>(value.integer); // same bits for floats
+         }
+      }
+      case ExpressionType::TVariable:
+         return hash<string>()(reinterpret_cast<const Variable&>(expression).getIdentifier());
+      case ExpressionType::TFunctionOperator:
+         return reinterpret_cast<const FunctionOperator&>(expression).getFunctionIdentifier();
+      default:
+         return 0;
+   }
+}
+//---------------------------------------------------------------------------
+/// same class and same own data, the children are compared by the caller
+bool samePayload(const Expression& lhs, const Expression& rhs)
+{
+   if(typeid(lhs) != typeid(rhs))
+      return false;
+   switch(lhs.getExpressionType()) {
+      case ExpressionType::TValue: {
+         if(lhs.getResultType() == harriet::VariableType::TString)
+            return reinterpret_cast<const StringValue&>(lhs).result == reinterpret_cast<const StringValue&>(rhs).result;
+         Scalar lhsValue = Scalar::fromValue(reinterpret_cast<const Value&>(lhs));
+         Scalar rhsValue = Scalar::fromValue(reinterpret_cast<const Value&>(rhs));
+         switch(lhsValue.type) {
+            case harriet::VariableType::TBool:   return lhsValue.boolean == rhsValue.boolean;
+            case harriet::VariableType::TVector: return memcmp(lhsValue.vector, rhsValue.vector, sizeof(lhsValue.vector)) == 0;
+            default:                             return lhsValue.integer == rhsValue.integer; // same bits for floats
+         }
+      }
+      case ExpressionType::TVariable:
+         return reinterpret_cast<const Variable&>(lhs).getIdentifier() == reinterpret_cast<const Variable&>(rhs).getIdentifier();
+      case ExpressionType::TFunctionOperator:
+         return reinterpret_cast<const FunctionOperator&>(lhs).getFunctionIdentifier() == reinterpret_cast<const FunctionOperator&>(rhs).getFunctionIdentifier();
+      default:
+         return true;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> ExpressionOptimizer::eliminateCommonSubexpressions(unique_ptr<Expression> expression, Environment& environment, uint32_t& eliminated)
+{
+   Sharing sharing;
+   if(expression->getExpressionType() == ExpressionType::TSharedScope)
+      return expression;
+   sharing.impureCalls = false;
+   sharing.repeated = false;
+   collectAssignments(*expression, environment, sharing.assigned, sharing.impureCalls);
+   number(*expression, environment, sharing);
+   if(!sharing.repeated)
+      return expression;
+
+   // largest sub trees first, their copies do not count for the sub trees inside of them
+   vector<uint32_t> order(sharing.subtrees.size());
+   iota(order.begin(), order.end(), 0);
+   stable_sort(order.begin(), order.end(), [&sharing](uint32_t lhs, uint32_t rhs) {return sharing.subtrees[lhs].size > sharing.subtrees[rhs].size;});
+   bool found = false;
+   for(auto iter : order) {
+      auto& subtree = sharing.subtrees[iter];
+      if(!subtree.worthSharing || subtree.count<2)
+         continue;
+      subtree.shared = true;
+      found = true;
+      uint32_t child = sharing.firstChild(subtree.position);
+      for(uint32_t i=0; i<subtree.childCount; i++, child=sharing.nextSibling(child))
+         sharing.release(sharing.preorder[child], subtree.count-1);
+   }
+   if(!found)
+      return expression;
+
+   unique_ptr<SharedExpressionScope> scope(new SharedExpressionScope());
+   sharing.scope = scope.get();
+   sharing.sharedCount = 0;
+   sharing.eliminated = 0;
+   share(expression, 0, sharing);
+   scope->child = ::move(expression);
+   scope->sharedCount = sharing.sharedCount;
+   eliminated += sharing.eliminated;
+   return ::move(scope);
+}
+//---------------------------------------------------------------------------
+uint32_t ExpressionOptimizer::number(const Expression& expression, Environment& environment, Sharing& sharing)
+{
+   // the node is identified by its class, its own data and the numbers of its children
+   uint32_t position = sharing.preorder.size();
+   sharing.preorder.push_back(kNoSubtree);
+   uint32_t childCount = 0;
+   bool pure = true;
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TValue:
+         break;
+      case ExpressionType::TVariable:
+         pure = !sharing.impureCalls && sharing.assigned.count(reinterpret_cast<const Variable&>(expression).getIdentifier())==0;
+         break;
+      case ExpressionType::TUnaryOperator:
+         number(reinterpret_cast<const UnaryOperator&>(expression).getChild(), environment, sharing);
+         childCount = 1;
+         break;
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+         pure = binary.getOperatorType() != OperatorType::TAssignment;
+         number(binary.getLhs(), environment, sharing);
+         number(binary.getRhs(), environment, sharing);
+         childCount = 2;
+         break;
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         pure = environment.getFunction(call.getFunctionIdentifier())->isPure();
+         for(auto& iter : call.getArguments())
+            number(*iter, environment, sharing);
+         childCount = call.getArguments().size();
+         break;
+      }
+      default:
+         pure = false;
+         break;
+   }
+   uint64_t hash = combine(typeid(expression).hash_code(), hashPayload(expression));
+   uint32_t size = 1;
+   uint32_t child = sharing.firstChild(position);
+   for(uint32_t i=0; i<childCount; i++, child=sharing.nextSibling(child)) {
+      auto& subtree = sharing.subtrees[sharing.preorder[child]];
+      hash = combine(hash, sharing.preorder[child]);
+      pure &= subtree.pure;
+      size += subtree.size;
+   }
+
+   // candidates with the same hash are compared node by node, their children by number
+   auto inserted = sharing.hashes.insert(make_pair(hash, static_cast<uint32_t>(sharing.subtrees.size())));
+   uint32_t result = kNoSubtree;
+   uint32_t* link = nullptr;
+   if(!inserted.second) {
+      for(uint32_t candidate=inserted.first->second; candidate!=kNoSubtree && result==kNoSubtree; candidate=sharing.subtrees[candidate].sameHash) {
+         auto& subtree = sharing.subtrees[candidate];
+         link = &subtree.sameHash;
+         if(subtree.size!=size || subtree.childCount!=childCount || !samePayload(*sharing.representatives[candidate], expression))
+            continue;
+         bool same = true;
+         uint32_t lhs = sharing.firstChild(subtree.position);
+         uint32_t rhs = sharing.firstChild(position);
+         for(uint32_t i=0; i<childCount && same; i++, lhs=sharing.nextSibling(lhs), rhs=sharing.nextSibling(rhs))
+            same = sharing.preorder[lhs] == sharing.preorder[rhs];
+         if(same)
+            result = candidate;
+      }
+   }
+   if(result == kNoSubtree) {
+      result = sharing.subtrees.size();
+      if(link != nullptr)
+         *link = result;
+      bool operation = expression.getExpressionType()==ExpressionType::TUnaryOperator || expression.getExpressionType()==ExpressionType::TBinaryOperator || expression.getExpressionType()==ExpressionType::TFunctionOperator;
+      sharing.subtrees.push_back(Sharing::Subtree{0, size, position, childCount, kNoSubtree, pure, pure && operation && expression.getResultType()!=harriet::VariableType::TString, false, nullptr, 0});
+      sharing.representatives.push_back(&expression);
+   } else {
+      sharing.repeated = true;
+   }
+   sharing.subtrees[result].count++;
+   sharing.preorder[position] = result;
+   return result;
+}
+//---------------------------------------------------------------------------
+void ExpressionOptimizer::share(unique_ptr<Expression>& expression, uint32_t position, Sharing& sharing)
+{
+   auto& subtree = sharing.subtrees[sharing.preorder[position]];
+   if(subtree.shared && subtree.node!=nullptr) {
+      sharing.eliminated += subtree.size;
+      expression = make_unique<SharedExpression>(subtree.node, subtree.index, *sharing.scope);
+      return;
+   }
+
+   uint32_t child = sharing.firstChild(position);
+   switch(expression->getExpressionType()) {
+      case ExpressionType::TUnaryOperator:
+         share(reinterpret_cast<UnaryOperator&>(*expression).child, child, sharing);
+         break;
+      case ExpressionType::TBinaryOperator:
+         share(reinterpret_cast<BinaryOperator&>(*expression).lhs, child, sharing);
+         share(reinterpret_cast<BinaryOperator&>(*expression).rhs, sharing.nextSibling(child), sharing);
+         break;
+      case ExpressionType::TFunctionOperator:
+         for(auto& iter : reinterpret_cast<FunctionOperator&>(*expression).arguments) {
+            share(iter, child, sharing);
+            child = sharing.nextSibling(child);
+         }
+         break;
+      default:
+         break;
+   }
+   if(subtree.shared) {
+      subtree.node = shared_ptr<Expression>(expression.release());
+      subtree.index = sharing.sharedCount++;
+      expression = make_unique<SharedExpression>(subtree.node, subtree.index, *sharing.scope);
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,47 @@
+#ifndef SCRIPTLANGUAGE_EXPRESSIONOPTIMIZER_HPP_
+#define SCRIPTLANGUAGE_EXPRESSIONOPTIMIZER_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "Expression.hpp"
+#include <memory>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+//---------------------------------------------------------------------------
+/// Rewrites a parsed expression into a cheaper one with the same results. Constant sub trees (including calls of pure functions) are folded
+/// into values and the identities x*1, x/1, x+0, x-0, --x and !!x are removed where the static types make them exact. Repeated sub trees are
+/// then evaluated only once.
+class ExpressionOptimizer {
+public:
+   static std::unique_ptr<Expression> optimize(std::unique_ptr<Expression> expression, Environment& environment);
+
+   /// Turns the tree into a dag: structurally identical sub trees without side effects (no assignments, no impure functions, no variables
+   /// assigned elsewhere in the expression or read next to an impure call) become one SharedExpression, computed once per evaluation. The number of nodes which are no longer
+   /// evaluated is added to eliminated.
+   static std::unique_ptr<Expression> eliminateCommonSubexpressions(std::unique_ptr<Expression> expression, Environment& environment, uint32_t& eliminated);
+
+private:
+   static std::unique_ptr<Expression> simplify(std::unique_ptr<Expression> expression, Environment& environment);
+
+   /// return the replacement for the node or nullptr if the (optimized) node stays
+   static std::unique_ptr<Expression> optimizeUnary(UnaryOperator& unary, Environment& environment);
+   static std::unique_ptr<Expression> optimizeBinary(BinaryOperator& binary, Environment& environment);
+   static std::unique_ptr<Expression> optimizeFunction(FunctionOperator& function, Environment& environment);
+
+   /// evaluate the expression now, nullptr if it fails (the error is then raised again by the real evaluation)
+   static std::unique_ptr<Expression> fold(const Expression& expression, Environment& environment);
+
+   /// numbering of the sub trees (identical ones get the same number) and the rewrite into shared expressions
+   struct Sharing;
+   static uint32_t number(const Expression& expression, Environment& environment, Sharing& sharing);
+   static void share(std::unique_ptr<Expression>& expression, uint32_t position, Sharing& sharing);
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -3,8 +3,8 @@
 #include "Utility.hpp"
 #include "Environment.hpp"
 #include "Function.hpp"
+#include "Tokenizer.hpp"
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <list>
 #include <stack>
@@ -20,17 +20,35 @@ using namespace std;
 namespace harriet {
 //---------------------------------------------------------------------------
 struct OpeningPharentesis : public Expression {
-   virtual void print(ostream& stream) const {stream << " ( ";}
+   OpeningPharentesis() : outputDepth(0), separatorCount(0) {}
+   OpeningPharentesis(const string& functionName) : functionName(functionName), outputDepth(0), separatorCount(0) {}
+   virtual void print(ostream& stream) const {stream << " " << functionName << "( ";}
    virtual uint8_t priority() const {return 0;}
    virtual ExpressionType getExpressionType() const {return ExpressionType::TOpeningPharentesis;}
+   virtual harriet::VariableType getResultType() const {throw;}
    virtual Associativity getAssociativity() const {throw;}
    virtual unique_ptr<Value> evaluate(Environment& /*environment*/) const {throw;}
+   bool isFunctionCall() const {return !functionName.empty();}
+
+   const string functionName; // only set if the parenthesis opens the argument list of a function
+   uint32_t outputDepth; // size of the output stack when the parenthesis was opened
+   uint32_t separatorCount; // number of ',' seen so far
 };
 //---------------------------------------------------------------------------
 struct ClosingPharentesis : public Expression {
    virtual void print(ostream& stream) const {stream << " ) ";}
    virtual uint8_t priority() const {throw;}
    virtual ExpressionType getExpressionType() const {return ExpressionType::TClosingPharentesis;}
+   virtual harriet::VariableType getResultType() const {throw;}
+   virtual Associativity getAssociativity() const {throw;}
+   virtual unique_ptr<Value> evaluate(Environment& /*environment*/) const {throw;}
+};
+//---------------------------------------------------------------------------
+struct Comma : public Expression {
+   virtual void print(ostream& stream) const {stream << " , ";}
+   virtual uint8_t priority() const {throw;}
+   virtual ExpressionType getExpressionType() const {return ExpressionType::TComma;}
+   virtual harriet::VariableType getResultType() const {throw;}
    virtual Associativity getAssociativity() const {throw;}
    virtual unique_ptr<Value> evaluate(Environment& /*environment*/) const {throw;}
 };
@@ -38,22 +56,20 @@ struct ClosingPharentesis : public Expression {
 unique_ptr<Expression> ExpressionParser::parse(const string& inputString, Environment& environment)
 {
    // set up data
-   istringstream input(inputString);
+   Tokenizer tokens(inputString);
    stack<unique_ptr<Expression>> outputStack;
    stack<unique_ptr<Expression>> operatorStack;
-   harriet::skipWhiteSpace(input);
    ExpressionType lastExpressionType = ExpressionType::TOpeningPharentesis; // needed for not context free operators
 
    // parse input and build PRN on the fly
-   while(input.good()) {
+   while(true) {
       // get next token
-      auto token = parseSingleExpression(input, lastExpressionType, environment);
+      auto token = parseSingleExpression(tokens, lastExpressionType, environment);
       if(token==nullptr)
          break;
       if(token->getExpressionType()==lastExpressionType && lastExpressionType==ExpressionType::TValue)
          throw harriet::Exception("missing operator");
       lastExpressionType = token->getExpressionType();
-      harriet::skipWhiteSpace(input);
 
       // shunting yard algorithm -- proces tokens
       switch(token->getExpressionType()) {
@@ -74,20 +90,42 @@ unique_ptr<Expression> ExpressionParser::parse(const string& inputString, Enviro
             operatorStack.push(::move(token));
             continue;
          case ExpressionType::TOpeningPharentesis:
+            reinterpret_cast<OpeningPharentesis&>(*token).outputDepth = outputStack.size();
             operatorStack.push(::move(token));
             continue;
-         case ExpressionType::TClosingPharentesis:
-            while(true) {
-               // get top operator
-               if(operatorStack.empty())
-                  throw harriet::Exception{"parenthesis missmatch: missing '('"};
-               auto stackToken = ::move(operatorStack.top());
-               operatorStack.pop();
-               if(stackToken->getExpressionType() == ExpressionType::TOpeningPharentesis)
-                  break; else
-                  pushToOutput(outputStack, ::move(stackToken));
+         case ExpressionType::TComma: {
+            // finish the current argument, the function call stays on the stack
+            auto call = popUntilOpeningPharentesis(outputStack, operatorStack);
+            if(call==nullptr || !call->isFunctionCall())
+               throw harriet::Exception{"found ',' outside of a function call"};
+            if(outputStack.size() != call->outputDepth+call->separatorCount+1)
+               throw harriet::Exception{"in function '" + call->functionName + "': found empty argument"};
+            call->separatorCount++;
+            continue;
+         }
+         case ExpressionType::TClosingPharentesis: {
+            auto parenthesis = popUntilOpeningPharentesis(outputStack, operatorStack);
+            if(parenthesis == nullptr)
+               throw harriet::Exception{"parenthesis missmatch: missing '('"};
+            if(parenthesis->isFunctionCall()) {
+               // all arguments are on top of the output stack
+               uint32_t argumentCount = outputStack.size() - parenthesis->outputDepth;
+               if(argumentCount!=parenthesis->separatorCount+1 && (argumentCount!=0 || parenthesis->separatorCount!=0))
+                  throw harriet::Exception{"in function '" + parenthesis->functionName + "': found empty argument"};
+               vector<unique_ptr<Expression>> arguments(argumentCount);
+               for(uint32_t i=argumentCount; i>0; i--) {
+                  arguments[i-1] = ::move(outputStack.top());
+                  outputStack.pop();
+               }
+               outputStack.push(createFunctionCall(parenthesis->functionName, arguments, environment));
             }
+            operatorStack.pop();
             continue;
+         }
+         case ExpressionType::TShared:
+         case ExpressionType::TSharedScope:
+         case ExpressionType::TCompiled:
+            throw harriet::Exception{"unreachable"}; // only created after parsing
       }
    }
 
@@ -104,94 +142,81 @@ unique_ptr<Expression> ExpressionParser::parse(const string& inputString, Enviro
    return ::move(outputStack.top());
 }
 //---------------------------------------------------------------------------
-unique_ptr<Expression> ExpressionParser::parseSingleExpression(istream& input, ExpressionType lastExpression, Environment& environment)
+unique_ptr<Expression> ExpressionParser::parseSingleExpression(Tokenizer& tokens, ExpressionType lastExpression, Environment& environment)
 {
    // read
-   harriet::skipWhiteSpace(input);
-   char a = input.get();
-   if(!input.good())
-      return nullptr;
+   Token token = tokens.next();
+   switch(token.type) {
+      case TokenType::TEnd:                 return nullptr;
 
-   // other single letter operators
-   if(a == '(') return make_unique<OpeningPharentesis>();
-   if(a == ')') return make_unique<ClosingPharentesis>();
-   if(a == '+') return make_unique<PlusOperator>();
-   if(a == '-') { if(lastExpression==ExpressionType::TBinaryOperator || lastExpression==ExpressionType::TUnaryOperator || lastExpression==ExpressionType::TOpeningPharentesis) return make_unique<UnaryMinusOperator>(); else return make_unique<MinusOperator>(); }
-   if(a == '*') return make_unique<MultiplicationOperator>();
-   if(a == '/') return make_unique<DivisionOperator>();
-   if(a == '%') return make_unique<ModuloOperator>();
-   if(a == '^') return make_unique<ExponentiationOperator>();
-   if(a == '&') return make_unique<AndOperator>();
-   if(a == '|') return make_unique<OrOperator>();
-   if(a=='>' && input.peek()!='=') return make_unique<GreaterOperator>();
-   if(a=='<' && input.peek()!='=') return make_unique<LessOperator>();
-   if(a=='!' && input.peek()!='=') return make_unique<NotOperator>();
-   if(a=='=' && input.peek()!='=') return make_unique<AssignmentOperator>();
+      // operators
+      case TokenType::TOpeningPharentesis:  return make_unique<OpeningPharentesis>();
+      case TokenType::TClosingPharentesis:  return make_unique<ClosingPharentesis>();
+      case TokenType::TPlus:                return make_unique<PlusOperator>();
+      case TokenType::TMinus:               if(lastExpression==ExpressionType::TBinaryOperator || lastExpression==ExpressionType::TUnaryOperator || lastExpression==ExpressionType::TOpeningPharentesis || lastExpression==ExpressionType::TComma) return make_unique<UnaryMinusOperator>(); else return make_unique<MinusOperator>();
+      case TokenType::TAsterisk:            return make_unique<MultiplicationOperator>();
+      case TokenType::TSlash:               return make_unique<DivisionOperator>();
+      case TokenType::TPercent:             return make_unique<ModuloOperator>();
+      case TokenType::TCaret:               return make_unique<ExponentiationOperator>();
+      case TokenType::TAmpersand:           return make_unique<AndOperator>();
+      case TokenType::TPipe:                return make_unique<OrOperator>();
+      case TokenType::TGreater:             return make_unique<GreaterOperator>();
+      case TokenType::TLess:                return make_unique<LessOperator>();
+      case TokenType::TExclamation:         return make_unique<NotOperator>();
+      case TokenType::TAssign:              return make_unique<AssignmentOperator>();
+      case TokenType::TEqual:               return make_unique<EqualOperator>();
+      case TokenType::TGreaterEqual:        return make_unique<GreaterEqualOperator>();
+      case TokenType::TLessEqual:           return make_unique<LessEqualOperator>();
+      case TokenType::TNotEqual:            return make_unique<NotEqualOperator>();
+      case TokenType::TComma:               return make_unique<Comma>();
 
-   // check for string
-   char b = input.get();
-   if(a=='"') {
-      string result;
-      while(b!='"' && a!='\\') {
-         if(!input.good())
-            throw harriet::Exception{"unterminated string expression"};
-         result.push_back(b);
-         a = b;
-         b = input.get();
-      }
-      return make_unique<StringValue>(result);
-   }
+      // literals
+      case TokenType::TInteger:             return make_unique<IntegerValue>(token.integer);
+      case TokenType::TFloat:               return make_unique<FloatValue>(token.floating);
+      case TokenType::TString:              return make_unique<StringValue>(tokens.getString(token));
 
-   // check for two signed letters
-   if(input.good()) {
-      if(a=='=' && b=='=') return make_unique<EqualOperator>();
-      if(a=='>' && b=='=') return make_unique<GreaterEqualOperator>();
-      if(a=='<' && b=='=') return make_unique<LessEqualOperator>();
-      if(a=='!' && b=='=') return make_unique<NotEqualOperator>();
-      input.unget();
-   } else {
-      input.clear();
+      // names
+      case TokenType::TIdentifier:          break;
    }
 
-   // check for a number
-   input.unget();
-   if(isdigit(a)) {
-      int32_t intNum;
-      input >> intNum;
-      if(input.peek()=='.' && input.good()) {
-         float floatNum;
-         input >> floatNum;
-         return make_unique<FloatValue>(floatNum+intNum);
-      } else {
-         return make_unique<IntegerValue>(intNum);
-      }
-      throw harriet::Exception{"unable to parse expression as number"};
-   }
+   // try bool
+   if(tokens.textEquals(token, harriet::kTrue)) return make_unique<BoolValue>(true);
+   if(tokens.textEquals(token, harriet::kFalse)) return make_unique<BoolValue>(false);
 
-   // read the name
-   string word = harriet::parseIdentifier(input);
-   if(isalpha(a)) {
-      // try bool
-      if(word == harriet::kTrue) return make_unique<BoolValue>(true);
-      if(word == harriet::kFalse) return make_unique<BoolValue>(false);
+   // try cast
+   if(tokens.textEquals(token, harriet::kCastName))
+      return parseCast(tokens);
 
-      // try cast
-      if(word == harriet::kCastName)
-         return parseCast(input);
+   string word = tokens.getText(token);
+   if(harriet::isKeyword(word))
+      throw harriet::Exception{"the keyword '" + word + "' can not be used as an identifier"};
 
-      // try function
-      if(environment.hasFunction(word))
-         return parseFunctionHeader(word, input, environment);
+   // try function, the arguments are parsed as part of the surrounding expression
+   if(environment.hasFunction(word)) {
+      if(tokens.next().type != TokenType::TOpeningPharentesis)
+         throw harriet::Exception{"expected opening parentesis '(' after function identifier: '" + word + "'"};
+      return make_unique<OpeningPharentesis>(word);
+   }
 
-      // try variable
-      if(environment.isInAnyScope(word))
-         return make_unique<Variable>(word);
+   // try variable
+   if(environment.isInAnyScope(word))
+      return make_unique<Variable>(word, environment);
 
-      // error
-      throw harriet::Exception{"found unkown identifier: '" + word + "'"};
+   // error
+   throw harriet::Exception{"found unkown identifier: '" + word + "'"};
+}
+//---------------------------------------------------------------------------
+OpeningPharentesis* ExpressionParser::popUntilOpeningPharentesis(stack<unique_ptr<Expression>>& outputStack, stack<unique_ptr<Expression>>& operatorStack)
+{
+   while(true) {
+      if(operatorStack.empty())
+         return nullptr;
+      if(operatorStack.top()->getExpressionType() == ExpressionType::TOpeningPharentesis)
+         return reinterpret_cast<OpeningPharentesis*>(operatorStack.top().get());
+      auto stackToken = ::move(operatorStack.top());
+      operatorStack.pop();
+      pushToOutput(outputStack, ::move(stackToken));
    }
-
-   throw harriet::Exception{"unable to parse expression, invaild sign '" + string(1, a) + "'"};
 }
 //---------------------------------------------------------------------------
 void ExpressionParser::pushToOutput(stack<unique_ptr<Expression>>& workStack, unique_ptr<Expression> element) // AAA split
@@ -223,16 +248,19 @@ void ExpressionParser::pushToOutput(stack<unique_ptr<Expression>>& workStack, un
    }
 }
 //---------------------------------------------------------------------------
-unique_ptr<CastOperator> ExpressionParser::parseCast(istream& input)
+unique_ptr<CastOperator> ExpressionParser::parseCast(Tokenizer& tokens)
 {
    // extract '<', read type and extract '>'
-   char a = input.get();
-   if(a!='<')
-      throw harriet::Exception{string("invalid cast syntax, expected '<' got '") + a + "'. usage: cast<type> value"};
-   harriet::VariableType type = harriet::nameToType(harriet::readOnlyAlpha(input));
-   a = input.get();
-   if(a!='>')
-      throw harriet::Exception{string("invalid cast syntax, expected '>' got '") + a + "'. usage: cast<type> value"};
+   Token token = tokens.next();
+   if(token.type != TokenType::TLess)
+      throw harriet::Exception{"invalid cast syntax, expected '<' got '" + tokens.getText(token) + "'. usage: cast<type> value"};
+   token = tokens.next();
+   if(token.type != TokenType::TIdentifier)
+      throw harriet::Exception{"invalid cast syntax, expected type got '" + tokens.getText(token) + "'. usage: cast<type> value"};
+   harriet::VariableType type = harriet::nameToType(tokens.getText(token));
+   token = tokens.next();
+   if(token.type != TokenType::TGreater)
+      throw harriet::Exception{"invalid cast syntax, expected '>' got '" + tokens.getText(token) + "'. usage: cast<type> value"};
 
    // create cast operator
    switch(type) {
@@ -245,40 +273,25 @@ unique_ptr<CastOperator> ExpressionParser::parseCast(istream& input)
    }
 }
 //---------------------------------------------------------------------------
-unique_ptr<FunctionOperator> ExpressionParser::parseFunctionHeader(const string& functionName, istream& input, Environment& environment)
+unique_ptr<FunctionOperator> ExpressionParser::createFunctionCall(const string& functionName, vector<unique_ptr<Expression>>& arguments, Environment& environment)
 {
-   // parse arguments and get functions
-   auto splittedArguments = splitFunctionArguments(input, functionName);
-   auto possibleFunctions = environment.getFunction(functionName);
-   vector<unique_ptr<Expression>> arguments;
-
-   // check for 0 argument function
-   if(splittedArguments.size()==1 && splittedArguments[0].size()==0)
-      for(auto iter : possibleFunctions)
-         if(iter->getArgumentCount()==0)
-            return make_unique<FunctionOperator>(iter->getName(), iter->getId(), arguments);
+   // candidates with a matching number of arguments
+   vector<const Function*> possibleFunctions;
+   environment.forEachFunction(functionName, [&](const Function& function) {
+      if(function.getArgumentCount() == arguments.size())
+         possibleFunctions.push_back(&function);
+   });
 
-   // convert argument strings to expressions
-   for(auto& iter : splittedArguments)
-      if(iter.size()==0)
-         throw harriet::Exception{"in function '" + functionName + "': found empty argument"}; else
-         arguments.push_back(parse(iter, environment));
-
-   // evaluate arguments to access the type
-   vector<unique_ptr<Value>> evaluatedArguments;
-   for(auto& iter : arguments)
-      evaluatedArguments.push_back(iter->evaluate(environment));
-
-   // find matching function
-   for(uint32_t i=0; i<evaluatedArguments.size(); i++) {
+   // find matching function, the static argument types are known from parsing
+   for(uint32_t i=0; i<arguments.size(); i++) {
       // search matches for argument i
       vector<const Function*> simpleMatches; // matching patterns without cast
       vector<const Function*> castMatches; // matching patterns with cast
       for(auto function : possibleFunctions)
-         if(function->getArgumentCount() == evaluatedArguments.size()) {
-            if(function->getArgumentType(i) == evaluatedArguments[i]->getResultType())
+         if(function->getArgumentCount() == arguments.size()) {
+            if(function->getArgumentType(i) == arguments[i]->getResultType())
                simpleMatches.push_back(function);
-            else if(harriet::isImplicitCastPossible(function->getArgumentType(i), evaluatedArguments[i]->getResultType()))
+            else if(harriet::isImplicitCastPossible(function->getArgumentType(i), arguments[i]->getResultType()))
                castMatches.push_back(function);
          }
 
@@ -294,18 +307,19 @@ unique_ptr<FunctionOperator> ExpressionParser::parseFunctionHeader(const string&
    // possibleFunctions contains now all callable functions -- should be exactly one
    if(possibleFunctions.size() == 1) {
       // created needed casts
-      for(uint32_t i=0; i<evaluatedArguments.size(); i++)
-         if(possibleFunctions[0]->getArgumentType(i) != evaluatedArguments[i]->getResultType())
+      for(uint32_t i=0; i<arguments.size(); i++)
+         if(possibleFunctions[0]->getArgumentType(i) != arguments[i]->getResultType())
             arguments[i] = harriet::createCast(::move(arguments[i]), possibleFunctions[0]->getArgumentType(i));
 
       // create function
-      return make_unique<FunctionOperator>(possibleFunctions[0]->getName(), possibleFunctions[0]->getId(), arguments);
+      return make_unique<FunctionOperator>(*possibleFunctions[0], environment, arguments);
    }
 
    // no unique possible funciton => epic error msg
    string error = (possibleFunctions.size()==0?"no matching function for call to ":"ambiguous function call to ") + functionName + "(";
-   for(uint32_t i=0; i<evaluatedArguments.size(); i++)
-      error += harriet::typeToName(evaluatedArguments[i]->getResultType()) + (i+1==evaluatedArguments.size()?")":",");
+   for(uint32_t i=0; i<arguments.size(); i++)
+      error += harriet::typeToName(arguments[i]->getResultType()) + (i+1==arguments.size()?"":",");
+   error += ")";
    error += "\ncandidates are: \n";
    if(possibleFunctions.size() == 0)
       possibleFunctions = environment.getFunction(functionName);
@@ -314,45 +328,5 @@ unique_ptr<FunctionOperator> ExpressionParser::parseFunctionHeader(const string&
    throw harriet::Exception{error};
 }
 //---------------------------------------------------------------------------
-vector<string> ExpressionParser::splitFunctionArguments(istream& is, const string& functionName)
-{
-   // begin
-   harriet::skipWhiteSpace(is);
-   if(is.get() != '(')
-      throw harriet::Exception{"expected opening parentesis '(' after function identifier: '" + functionName + "'"};
-
-   // init
-   int32_t parenthesisCount = 1;
-   vector<string> result;
-   string buffer;
-   harriet::skipWhiteSpace(is);
-
-   // read
-   do {
-      char a = is.get();
-      if(a=='(') parenthesisCount++;
-      if(a==')') parenthesisCount--;
-      if(parenthesisCount < 0) throw harriet::Exception{"expected '(' before ')'"};
-
-      // check if finished
-      if(parenthesisCount==0) {
-         result.push_back(buffer);
-         return result;
-      }
-
-      // check if an argument is finished
-      if(a==',' && parenthesisCount==1) {
-         result.push_back(buffer);
-         buffer = "";
-         harriet::skipWhiteSpace(is);
-      } else {
-         buffer.push_back(a);
-      }
-   } while(is.good());
-
-   // should not be reached
-   throw harriet::Exception{"expected closing parentesis ')' after function identifier: '" + functionName + "'"};
-}
-//---------------------------------------------------------------------------
 } // end of namespace harriet
 //---------------------------------------------------------------------------
@@ -5,7 +5,6 @@
 #include "Expression.hpp"
 #include <memory>
 #include <string>
-#include <ios>
 #include <stack>
 #include <vector>
 //---------------------------------------------------------------------------
@@ -16,6 +15,8 @@
 namespace harriet {
 //---------------------------------------------------------------------------
 class Environment;
+class Tokenizer;
+struct OpeningPharentesis;
 //---------------------------------------------------------------------------
 class ExpressionParser {
 public:
@@ -24,17 +25,19 @@ public:
 
 protected:
    /// get next token
-   static std::unique_ptr<Expression> parseSingleExpression(std::istream& input, ExpressionType lastExpression, Environment& environment);
+   static std::unique_ptr<Expression> parseSingleExpression(Tokenizer& tokens, ExpressionType lastExpression, Environment& environment);
+
+   /// move operators to the output until the innermost '(' is on top of the operator stack, nullptr if there is none
+   static OpeningPharentesis* popUntilOpeningPharentesis(std::stack<std::unique_ptr<Expression>>& outputStack, std::stack<std::unique_ptr<Expression>>& operatorStack);
 
    /// append token to output
    static void pushToOutput(std::stack<std::unique_ptr<Expression>>& workStack, std::unique_ptr<Expression> element);
 
    /// cast parsing
-   static std::unique_ptr<CastOperator> parseCast(std::istream& is);
+   static std::unique_ptr<CastOperator> parseCast(Tokenizer& tokens);
 
-   /// function call parsing
-   static std::unique_ptr<FunctionOperator> parseFunctionHeader(const std::string& functionName, std::istream& is, Environment& environment);
-   static std::vector<std::string> splitFunctionArguments(std::istream& is, const std::string& functionName);
+   /// function call parsing, picks the overload matching the already parsed arguments
+   static std::unique_ptr<FunctionOperator> createFunctionCall(const std::string& functionName, std::vector<std::unique_ptr<Expression>>& arguments, Environment& environment);
 };
 //---------------------------------------------------------------------------
 } // end of namespace harriet
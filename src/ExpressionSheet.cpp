@@ -0,0 +1,243 @@
+#include "ExpressionSheet.hpp"
+#include "ClosureProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include "Harriet.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+void addOnce(vector<string>& identifiers, const string& identifier)
+{
+   if(find(identifiers.begin(), identifiers.end(), identifier) == identifiers.end())
+      identifiers.push_back(identifier);
+}
+//---------------------------------------------------------------------------
+/// variables read and assigned by the expression, impure calls make it volatile
+void collectDependencies(const Expression& expression, const Environment& environment, vector<string>& reads, vector<string>& writes, bool& isVolatile)
+{
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TVariable:
+         return addOnce(reads, reinterpret_cast<const Variable&>(expression).getIdentifier());
+      case ExpressionType::TUnaryOperator:
+         return collectDependencies(reinterpret_cast<const UnaryOperator&>(expression).getChild(), environment, reads, writes, isVolatile);
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+         if(binary.getOperatorType()==OperatorType::TAssignment && binary.getLhs().getExpressionType()==ExpressionType::TVariable)
+            addOnce(writes, reinterpret_cast<const Variable&>(binary.getLhs()).getIdentifier()); else
+            collectDependencies(binary.getLhs(), environment, reads, writes, isVolatile);
+         return collectDependencies(binary.getRhs(), environment, reads, writes, isVolatile);
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         isVolatile |= !call.resolve(environment).isPure();
+         for(auto& argument : call.getArguments())
+            collectDependencies(*argument, environment, reads, writes, isVolatile);
+         return;
+      }
+      case ExpressionType::TShared:
+         return collectDependencies(reinterpret_cast<const SharedExpression&>(expression).getChild(), environment, reads, writes, isVolatile);
+      case ExpressionType::TSharedScope:
+         return collectDependencies(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), environment, reads, writes, isVolatile);
+      case ExpressionType::TCompiled:
+         return collectDependencies(reinterpret_cast<const CompiledExpression&>(expression).getTree(), environment, reads, writes, isVolatile);
+      default:
+         return;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+ExpressionSheet::ExpressionSheet(Environment& environment)
+: environment(environment)
+{
+}
+//---------------------------------------------------------------------------
+ExpressionSheet::~ExpressionSheet()
+{
+}
+//---------------------------------------------------------------------------
+void ExpressionSheet::add(const string& name, unique_ptr<Expression> expression)
+{
+   if(formulaIndex.count(name) != 0)
+      throw harriet::Exception{"formula '" + name + "' is already defined"};
+
+   auto formula = make_unique<Formula>();
+   formula->name = name;
+   formula->isVolatile = false;
+   formula->dirty = false;
+   collectDependencies(*expression, environment, formula->reads, formula->writes, formula->isVolatile);
+   formula->expression = ::move(expression);
+   for(auto& write : formula->writes) {
+      if(find(formula->reads.begin(), formula->reads.end(), write) != formula->reads.end())
+         throw harriet::Exception{"formula '" + name + "' depends on itself through variable '" + write + "'"};
+      auto writer = writers.find(write);
+      if(writer != writers.end())
+         throw harriet::Exception{"variable '" + write + "' is already assigned by formula '" + formulas[writer->second]->name + "'"};
+   }
+
+   // cycle <=> a formula depending on the new one assigns a variable the new one reads
+   vector<uint32_t> stack;
+   vector<bool> visited(formulas.size(), false);
+   auto pushReaders = [&](const string& variable) {
+      auto iter = readers.find(variable);
+      if(iter != readers.end())
+         stack.insert(stack.end(), iter->second.begin(), iter->second.end());
+   };
+   for(auto& write : formula->writes)
+      pushReaders(write);
+   while(!stack.empty()) {
+      uint32_t current = stack.back();
+      stack.pop_back();
+      if(visited[current])
+         continue;
+      visited[current] = true;
+      for(auto& write : formulas[current]->writes) {
+         if(find(formula->reads.begin(), formula->reads.end(), write) != formula->reads.end())
+            throw harriet::Exception{"formula '" + name + "' depends on itself through variable '" + write + "'"};
+         pushReaders(write);
+      }
+   }
+
+   // register
+   uint32_t index = formulas.size();
+   for(auto& read : formula->reads)
+      readers[read].push_back(index);
+   for(auto& write : formula->writes)
+      writers[write] = index;
+   if(formula->isVolatile)
+      volatiles.push_back(index);
+   formulaIndex[name] = index;
+   formulas.push_back(::move(formula));
+   mark(index);
+}
+//---------------------------------------------------------------------------
+void ExpressionSheet::add(const string& name, const string& input)
+{
+   add(name, harriet::parse(input, environment));
+}
+//---------------------------------------------------------------------------
+void ExpressionSheet::set(const string& identifier, unique_ptr<Value> value)
+{
+   environment.update(identifier, ::move(value));
+   invalidate(identifier);
+}
+//---------------------------------------------------------------------------
+void ExpressionSheet::invalidate(const string& identifier)
+{
+   auto iter = readers.find(identifier);
+   if(iter != readers.end())
+      for(auto reader : iter->second)
+         mark(reader);
+}
+//---------------------------------------------------------------------------
+uint32_t ExpressionSheet::recompute()
+{
+   for(auto formula : volatiles)
+      mark(formula);
+
+   // mark everything depending on the marked formulas, the dirty ones are the formulas to evaluate
+   vector<uint32_t> dirty;
+   while(!marked.empty()) {
+      uint32_t current = marked.back();
+      marked.pop_back();
+      dirty.push_back(current);
+      for(auto& write : formulas[current]->writes) {
+         auto iter = readers.find(write);
+         if(iter != readers.end())
+            for(auto reader : iter->second)
+               mark(reader);
+      }
+   }
+
+   // topological order among the dirty formulas, ties are broken by the order they were added in
+   priority_queue<uint32_t, vector<uint32_t>, greater<uint32_t>> ready;
+   for(auto current : dirty) {
+      auto& formula = *formulas[current];
+      formula.waiting = 0;
+      for(auto& read : formula.reads) {
+         auto writer = writers.find(read);
+         formula.waiting += writer!=writers.end() && formulas[writer->second]->dirty;
+      }
+      if(formula.waiting == 0)
+         ready.push(current);
+   }
+
+   while(!ready.empty()) {
+      auto& formula = *formulas[ready.top()];
+      ready.pop();
+      try {
+         formula.result = formula.expression->evaluate(environment);
+         formula.failure = nullptr;
+      } catch(...) {
+         formula.result = nullptr;
+         formula.failure = current_exception();
+      }
+      formula.dirty = false;
+      for(auto& write : formula.writes) {
+         auto iter = readers.find(write);
+         if(iter != readers.end())
+            for(auto reader : iter->second)
+               if(--formulas[reader]->waiting == 0)
+                  ready.push(reader);
+      }
+   }
+   return dirty.size();
+}
+//---------------------------------------------------------------------------
+uint32_t ExpressionSheet::update(const string& identifier, unique_ptr<Value> value)
+{
+   set(identifier, ::move(value));
+   return recompute();
+}
+//---------------------------------------------------------------------------
+const Value& ExpressionSheet::getResult(const string& name) const
+{
+   auto& formula = getFormula(name);
+   if(formula.failure != nullptr)
+      rethrow_exception(formula.failure);
+   if(formula.result == nullptr)
+      throw harriet::Exception{"formula '" + name + "' was not computed yet"};
+   return *formula.result;
+}
+//---------------------------------------------------------------------------
+const vector<string>& ExpressionSheet::getReads(const string& name) const
+{
+   return getFormula(name).reads;
+}
+//---------------------------------------------------------------------------
+const vector<string>& ExpressionSheet::getWrites(const string& name) const
+{
+   return getFormula(name).writes;
+}
+//---------------------------------------------------------------------------
+const ExpressionSheet::Formula& ExpressionSheet::getFormula(const string& name) const
+{
+   auto iter = formulaIndex.find(name);
+   if(iter == formulaIndex.end())
+      throw harriet::Exception{"unknown formula '" + name + "'"};
+   return *formulas[iter->second];
+}
+//---------------------------------------------------------------------------
+void ExpressionSheet::mark(uint32_t formula)
+{
+   if(formulas[formula]->dirty)
+      return;
+   formulas[formula]->dirty = true;
+   marked.push_back(formula);
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
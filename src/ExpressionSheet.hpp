@@ -0,0 +1,85 @@
+#ifndef SCRIPTLANGUAGE_EXPRESSIONSHEET_HPP_
+#define SCRIPTLANGUAGE_EXPRESSIONSHEET_HPP_
+//---------------------------------------------------------------------------
+#include <exception>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class Expression;
+class Value;
+//---------------------------------------------------------------------------
+/// Named formulas kept live over one environment, like the cells of a spreadsheet. Each formula records the variables it reads and the ones
+/// it assigns (a = b = c writes a and b and reads c). A formula assigning a variable comes before all formulas reading it. Updating a
+/// variable re-evaluates only the formulas depending on it, directly or through assignments, in that order; the others keep their results.
+///
+/// Each variable can be assigned by one formula only and cycles are rejected, also a formula reading a variable it assigns (a = a + 1). So
+/// the results only depend on the inputs, not on how often they were computed. Calls of impure functions may depend on anything, formulas
+/// containing them are re-evaluated on every recompute. Pure functions are assumed not to read variables.
+class ExpressionSheet {
+public:
+   explicit ExpressionSheet(Environment& environment);
+   ~ExpressionSheet();
+   ExpressionSheet(const ExpressionSheet&) = delete;
+   ExpressionSheet& operator=(const ExpressionSheet&) = delete;
+
+   /// the expression has to be parsed in the environment of the sheet, it is evaluated on the next recompute
+   /// throws harriet::Exception (leaving the sheet unchanged) if the name is taken, a variable is already assigned or it closes a cycle
+   void add(const std::string& name, std::unique_ptr<Expression> expression);
+   /// parses the input in the environment of the sheet
+   void add(const std::string& name, const std::string& input);
+
+   /// updates the variable in the environment and marks the formulas reading it, recompute evaluates them (use for several updates at once)
+   void set(const std::string& identifier, std::unique_ptr<Value> value);
+   /// marks the formulas reading the variable, for variables updated directly in the environment
+   void invalidate(const std::string& identifier);
+   /// evaluates all marked formulas and the ones depending on them, returns the number of evaluated formulas
+   uint32_t recompute();
+   /// set and recompute
+   uint32_t update(const std::string& identifier, std::unique_ptr<Value> value);
+
+   /// the result of the formula as of the last recompute, rethrows the exception if its evaluation failed
+   const Value& getResult(const std::string& name) const;
+   bool contains(const std::string& name) const {return formulaIndex.count(name)!=0;}
+   uint32_t size() const {return formulas.size();}
+   /// variables read and assigned by the formula
+   const std::vector<std::string>& getReads(const std::string& name) const;
+   const std::vector<std::string>& getWrites(const std::string& name) const;
+
+private:
+   struct Formula {
+      std::string name;
+      std::unique_ptr<Expression> expression;
+      std::vector<std::string> reads;
+      std::vector<std::string> writes;
+      bool isVolatile; // calls an impure function
+      bool dirty;
+      uint32_t waiting; // dirty formulas assigning a variable it reads, during recompute
+      std::unique_ptr<Value> result; // nullptr before the first evaluation and if it failed
+      std::exception_ptr failure;
+   };
+
+   const Formula& getFormula(const std::string& name) const;
+   void mark(uint32_t formula);
+
+   Environment& environment;
+   std::vector<std::unique_ptr<Formula>> formulas; // in the order they were added
+   std::unordered_map<std::string, uint32_t> formulaIndex; // name -> index in formulas
+   std::unordered_map<std::string, std::vector<uint32_t>> readers; // variable -> formulas reading it
+   std::unordered_map<std::string, uint32_t> writers; // variable -> formula assigning it
+   std::vector<uint32_t> volatiles; // formulas calling impure functions
+   std::vector<uint32_t> marked; // dirty formulas whose dependents are not yet marked
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -2,7 +2,12 @@
 #include "Expression.hpp"
 #include "Environment.hpp"
 #include "Utility.hpp"
+#include <atomic>
 #include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 //---------------------------------------------------------------------------
 // Harriet Script Language
 // Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
@@ -12,16 +17,201 @@ using namespace std;
 //---------------------------------------------------------------------------
 namespace harriet {
 //---------------------------------------------------------------------------
-Function::Function(const string& name, uint32_t id, function<unique_ptr<Value>(vector<unique_ptr<Value>>&, Environment&)> func, vector<harriet::VariableType> argumentTypes, harriet::VariableType resultType)
+namespace {
+//---------------------------------------------------------------------------
+atomic<uint64_t> nextFunctionSerial(1);
+/// memos are split into up to this many shards, calls with different arguments rarely wait for each other; small ones are split less as
+/// the arguments do not spread evenly over the shards
+const uint32_t kMaxMemoShardCount = 16;
+const uint32_t kMinMemoShardCapacity = 64;
+//---------------------------------------------------------------------------
+/// the memo key is the type and the bits of every argument, keys of up to three vectors or eight other scalars are kept without allocating
+class MemoKey {
+public:
+   MemoKey() : size(0), hashValue(14695981039346656037ull) {}
+
+   void append(const void* data, uint32_t count)
+   {
+      auto bytes = static_cast<const char*>(data);
+      for(uint32_t i=0; i<count; i++)
+         hashValue = (hashValue ^ static_cast<uint8_t>(bytes[i])) * 1099511628211ull; // fnv-1a
+      if(size+count <= kInlineSize) {
+         memcpy(inlineBytes+size, bytes, count);
+      } else {
+         if(size <= kInlineSize)
+            overflow.assign(inlineBytes, size);
+         overflow.append(bytes, count);
+      }
+      size += count;
+   }
+
+   uint64_t hash() const {return hashValue;}
+   bool operator==(const MemoKey& other) const {return size==other.size && hashValue==other.hashValue && memcmp(data(), other.data(), size)==0;}
+
+private:
+   const char* data() const {return size<=kInlineSize ? inlineBytes : overflow.data();}
+
+   static const uint32_t kInlineSize = 40;
+   uint32_t size;
+   uint64_t hashValue;
+   char inlineBytes[kInlineSize];
+   string overflow; // the whole key if it is longer than kInlineSize
+};
+//---------------------------------------------------------------------------
+struct MemoKeyHash {
+   size_t operator()(const MemoKey& key) const {return key.hash();}
+};
+//---------------------------------------------------------------------------
+void appendKey(MemoKey& key, const Scalar& argument)
+{
+   char type = static_cast<char>(argument.type);
+   key.append(&type, 1);
+   switch(argument.type) {
+      case harriet::VariableType::TInteger: key.append(&argument.integer, sizeof(argument.integer)); break;
+      case harriet::VariableType::TFloat:   key.append(&argument.floating, sizeof(argument.floating)); break;
+      case harriet::VariableType::TBool:    key.append(&argument.boolean, sizeof(argument.boolean)); break;
+      case harriet::VariableType::TVector:  key.append(argument.vector, sizeof(argument.vector)); break;
+      default:                                     throw harriet::Exception{"unreachable"};
+   }
+}
+//---------------------------------------------------------------------------
+void appendKey(MemoKey& key, const Value& argument)
+{
+   if(argument.getResultType() != harriet::VariableType::TString)
+      return appendKey(key, Scalar::fromValue(argument));
+   auto& text = reinterpret_cast<const StringValue&>(argument).result;
+   char type = static_cast<char>(harriet::VariableType::TString);
+   uint32_t length = text.size();
+   key.append(&type, 1);
+   key.append(&length, sizeof(length));
+   key.append(text.data(), length);
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+struct Function::Memo {
+   /// strings can not be represented as scalar, their text is stored instead and the type of the scalar is TString
+   struct Result {
+      Scalar scalar;
+      string text;
+   };
+   struct Entry {
+      MemoKey key;
+      Result result;
+      bool referenced; // since the clock hand passed it
+   };
+   /// part of the table with its own lock, evicts with the clock algorithm so that a hit does not reorder anything
+   struct Shard {
+      std::mutex mutex;
+      vector<Entry> entries; // at most capacity
+      unordered_map<MemoKey, uint32_t, MemoKeyHash> index; // key -> position in entries
+      uint32_t capacity;
+      uint32_t hand;
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t evictions;
+   };
+
+   explicit Memo(uint32_t capacity)
+   : shardCount(max(1u, min(capacity/kMinMemoShardCapacity, kMaxMemoShardCount)))
+   , shards(new Shard[shardCount])
+   {
+      for(uint32_t i=0; i<shardCount; i++) {
+         shards[i].capacity = capacity/shardCount + (i<capacity%shardCount);
+         shards[i].hand = 0;
+         shards[i].hits = shards[i].misses = shards[i].evictions = 0;
+      }
+   }
+
+   /// the low bits of the hash pick the bucket in the index, the high ones the shard
+   Shard& getShard(const MemoKey& key) {return shards[(key.hash()>>48) % shardCount];}
+
+   bool find(const MemoKey& key, Result& result)
+   {
+      auto& shard = getShard(key);
+      lock_guard<std::mutex> lock(shard.mutex);
+      auto iter = shard.index.find(key);
+      if(iter == shard.index.end()) {
+         shard.misses++;
+         return false;
+      }
+      shard.hits++;
+      auto& entry = shard.entries[iter->second];
+      entry.referenced = true;
+      result = entry.result;
+      return true;
+   }
+
+   void insert(MemoKey key, Result result)
+   {
+      auto& shard = getShard(key);
+      lock_guard<std::mutex> lock(shard.mutex);
+      if(shard.index.count(key) != 0)
+         return; // computed concurrently by another thread
+      uint32_t position = shard.entries.size();
+      if(position < shard.capacity) {
+         shard.entries.push_back(Entry{key, ::move(result), false});
+      } else {
+         // the first entry not referenced since the hand passed it the last time
+         while(shard.entries[shard.hand].referenced) {
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand+1) % shard.capacity;
+         }
+         position = shard.hand;
+         shard.hand = (shard.hand+1) % shard.capacity;
+         shard.index.erase(shard.entries[position].key);
+         shard.entries[position] = Entry{key, ::move(result), false};
+         shard.evictions++;
+      }
+      shard.index.insert(make_pair(::move(key), position));
+   }
+
+   MemoStatistics getStatistics()
+   {
+      MemoStatistics result{0, 0, 0, 0};
+      for(uint32_t i=0; i<shardCount; i++) {
+         lock_guard<std::mutex> lock(shards[i].mutex);
+         result.hits += shards[i].hits;
+         result.misses += shards[i].misses;
+         result.evictions += shards[i].evictions;
+         result.size += shards[i].entries.size();
+      }
+      return result;
+   }
+
+   const uint32_t shardCount;
+   unique_ptr<Shard[]> shards;
+};
+//---------------------------------------------------------------------------
+Function::Function(const string& name, uint32_t id, function<unique_ptr<Value>(vector<unique_ptr<Value>>&, Environment&)> func, vector<harriet::VariableType> argumentTypes, harriet::VariableType resultType, bool pure)
 : name(name)
 , id(id)
+, serial(nextFunctionSerial++)
 , func(func)
 , resultType(resultType)
+, pure(pure)
 {
    for(auto iter : argumentTypes)
       arguments.push_back(make_pair(iter, string("")));
 }
 //---------------------------------------------------------------------------
+Function::Function(const string& name, uint32_t id, ScalarCallback scalarFunc, vector<harriet::VariableType> argumentTypes, harriet::VariableType resultType, bool pure)
+: name(name)
+, id(id)
+, serial(nextFunctionSerial++)
+, scalarFunc(scalarFunc)
+, resultType(resultType)
+, pure(pure)
+{
+   for(auto iter : argumentTypes) {
+      if(iter == harriet::VariableType::TString)
+         throw harriet::Exception{"function '" + name + "' without boxing can not take a string"};
+      arguments.push_back(make_pair(iter, string("")));
+   }
+   if(resultType == harriet::VariableType::TString)
+      throw harriet::Exception{"function '" + name + "' without boxing can not return a string"};
+}
+//---------------------------------------------------------------------------
 Function::~Function()
 {
 }
@@ -30,7 +220,104 @@ unique_ptr<Value> Function::execute(vector<unique_ptr<Value>>& argv, Environment
 {
    // execute build in function
    assert(argv.size() == arguments.size());
-   return func(argv, env);
+   if(memo == nullptr)
+      return call(argv, env);
+
+   MemoKey key;
+   for(auto& iter : argv)
+      appendKey(key, *iter);
+   Memo::Result result;
+   if(memo->find(key, result)) {
+      if(result.scalar.type == harriet::VariableType::TString)
+         return make_unique<StringValue>(result.text);
+      return result.scalar.toValue();
+   }
+   auto value = call(argv, env);
+   if(value->getResultType() == harriet::VariableType::TString) {
+      result.scalar.type = harriet::VariableType::TString;
+      result.text = reinterpret_cast<const StringValue&>(*value).result;
+   } else {
+      result.scalar = Scalar::fromValue(*value);
+   }
+   memo->insert(::move(key), ::move(result));
+   return value;
+}
+//---------------------------------------------------------------------------
+Scalar Function::executeScalar(const Scalar* argv, Environment& env) const
+{
+   if(memo == nullptr)
+      return callScalar(argv, env);
+
+   MemoKey key;
+   for(uint32_t i=0; i<arguments.size(); i++)
+      appendKey(key, argv[i]);
+   Memo::Result result;
+   if(memo->find(key, result)) {
+      if(result.scalar.type == harriet::VariableType::TString)
+         return Scalar::fromValue(StringValue(result.text)); // fails the same way as the call
+      return result.scalar;
+   }
+   result.scalar = callScalar(argv, env);
+   memo->insert(::move(key), result);
+   return result.scalar;
+}
+//---------------------------------------------------------------------------
+Scalar Function::executeCall(const Scalar* argv, bool checkArguments, Environment& env) const
+{
+   if(checkArguments)
+      for(uint32_t i=0; i<arguments.size(); i++)
+         checkArgumentType(i, argv[i].type);
+   Scalar result = executeScalar(argv, env);
+   checkResultType(result.type);
+   return result;
+}
+//---------------------------------------------------------------------------
+void Function::checkArgumentType(uint32_t index, harriet::VariableType type) const
+{
+   if(type != getArgumentType(index))
+      throw harriet::Exception{"type missmatch in function '" + name + "' for argument '" + to_string(index) + "' unable to convert '" + harriet::typeToName(type) + "' to '" + harriet::typeToName(getArgumentType(index)) + "'"};
+}
+//---------------------------------------------------------------------------
+void Function::checkResultType(harriet::VariableType type) const
+{
+   if(type != resultType)
+      throw harriet::Exception{"function '" + name + "' returned '" + harriet::typeToName(type) + "' instead of '" + harriet::typeToName(resultType) + "'"};
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> Function::call(vector<unique_ptr<Value>>& argv, Environment& env) const
+{
+   if(func)
+      return func(argv, env);
+   vector<Scalar> unboxed;
+   for(auto& iter : argv)
+      unboxed.push_back(Scalar::fromValue(*iter));
+   return scalarFunc(unboxed.data(), env).toValue();
+}
+//---------------------------------------------------------------------------
+Scalar Function::callScalar(const Scalar* argv, Environment& env) const
+{
+   if(scalarFunc)
+      return scalarFunc(argv, env);
+   vector<unique_ptr<Value>> boxed;
+   for(uint32_t i=0; i<arguments.size(); i++)
+      boxed.push_back(argv[i].toValue());
+   return Scalar::fromValue(*func(boxed, env));
+}
+//---------------------------------------------------------------------------
+void Function::memoize(uint32_t capacity)
+{
+   if(!pure)
+      throw harriet::Exception{"function '" + name + "' is not pure and can not be memoized"};
+   if(capacity == 0)
+      throw harriet::Exception{"memo of function '" + name + "' needs a capacity of at least one"};
+   memo = make_unique<Memo>(capacity);
+}
+//---------------------------------------------------------------------------
+Function::MemoStatistics Function::getMemoStatistics() const
+{
+   if(memo == nullptr)
+      return MemoStatistics{0, 0, 0, 0};
+   return memo->getStatistics();
 }
 //---------------------------------------------------------------------------
 harriet::VariableType Function::getResultType() const
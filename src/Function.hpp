@@ -2,7 +2,10 @@
 #define SCRIPTLANGUAGE_FUNCTION_HPP_
 //---------------------------------------------------------------------------
 #include "ScriptLanguage.hpp"
+#include "Scalar.hpp"
+#include <functional>
 #include <memory>
+#include <type_traits>
 #include <vector>
 #include <string>
 //---------------------------------------------------------------------------
@@ -15,15 +18,94 @@ namespace harriet {
 class Environment;
 class Value;
 //---------------------------------------------------------------------------
+/// The c++ types of native functions and their script types
+template<class T> struct NativeType;
+template<> struct NativeType<int32_t> {
+   static harriet::VariableType type() {return harriet::VariableType::TInteger;}
+   static int32_t unbox(const Scalar& value) {return value.integer;}
+};
+template<> struct NativeType<float> {
+   static harriet::VariableType type() {return harriet::VariableType::TFloat;}
+   static float unbox(const Scalar& value) {return value.floating;}
+};
+template<> struct NativeType<bool> {
+   static harriet::VariableType type() {return harriet::VariableType::TBool;}
+   static bool unbox(const Scalar& value) {return value.boolean;}
+};
+template<> struct NativeType<Vector3<float>> {
+   static harriet::VariableType type() {return harriet::VariableType::TVector;}
+   static Vector3<float> unbox(const Scalar& value) {return value.getVector();}
+};
+//---------------------------------------------------------------------------
+template<unsigned... I> struct NativeIndices {};
+template<unsigned N, unsigned... I> struct MakeNativeIndices : MakeNativeIndices<N-1, N-1, I...> {};
+template<unsigned... I> struct MakeNativeIndices<0, I...> {typedef NativeIndices<I...> type;};
+//---------------------------------------------------------------------------
+/// Argument and result types of a function pointer or lambda
+template<class Callable> struct NativeSignature : NativeSignature<decltype(&Callable::operator())> {};
+template<class R, class... A> struct NativeSignature<R(*)(A...)> {
+   typedef R Result;
+   typedef typename MakeNativeIndices<sizeof...(A)>::type Indices;
+   static std::vector<harriet::VariableType> argumentTypes() {return std::vector<harriet::VariableType>{NativeType<typename std::decay<A>::type>::type()...};}
+   template<class Callable, unsigned... I>
+   static Scalar call(Callable& callable, const Scalar* argv, NativeIndices<I...>) {return Scalar(callable(NativeType<typename std::decay<A>::type>::unbox(argv[I])...));}
+};
+template<class C, class R, class... A> struct NativeSignature<R(C::*)(A...)> : NativeSignature<R(*)(A...)> {};
+template<class C, class R, class... A> struct NativeSignature<R(C::*)(A...) const> : NativeSignature<R(*)(A...)> {};
+//---------------------------------------------------------------------------
 class Function {
 public:
-   /// ctor for build in function
-   Function(const std::string& name, uint32_t id, std::function<std::unique_ptr<Value>(std::vector<std::unique_ptr<Value>>&, Environment&)> func, std::vector<harriet::VariableType> argumentTypes, harriet::VariableType resultType);
+   /// unboxed calling convention: argv holds one scalar per argument, their types are checked by the caller
+   typedef std::function<Scalar(const Scalar* argv, Environment& env)> ScalarCallback;
+
+   /// argv of one unboxed call, short argument lists are kept on the machine stack
+   class ScalarArguments {
+   public:
+      explicit ScalarArguments(uint32_t count) : argv(count<=kInlineCount ? inlineArguments : (heapArguments.resize(count), heapArguments.data())) {}
+      ScalarArguments(const ScalarArguments&) = delete;
+      ScalarArguments& operator=(const ScalarArguments&) = delete;
+      Scalar& operator[](uint32_t index) {return argv[index];}
+      const Scalar* data() const {return argv;}
+   private:
+      static const uint32_t kInlineCount = 8;
+      Scalar inlineArguments[kInlineCount];
+      std::vector<Scalar> heapArguments;
+      Scalar* argv;
+   };
+
+   /// ctor for build in function, a pure function depends only on its arguments and has no side effects (calls with constant arguments are folded)
+   Function(const std::string& name, uint32_t id, std::function<std::unique_ptr<Value>(std::vector<std::unique_ptr<Value>>&, Environment&)> func, std::vector<harriet::VariableType> argumentTypes, harriet::VariableType resultType, bool pure = false);
+   /// ctor for build in function without boxing, strings can not be passed this way
+   Function(const std::string& name, uint32_t id, ScalarCallback func, std::vector<harriet::VariableType> argumentTypes, harriet::VariableType resultType, bool pure = false);
+   /// wraps a c++ function or lambda, the argument and result types are taken from its signature (int32_t, float, bool or Vector3<float>)
+   template<class Callable>
+   static std::unique_ptr<Function> fromNative(const std::string& name, uint32_t id, Callable callable, bool pure = false);
    /// dtor
    ~Function();
 
    /// run function
    std::unique_ptr<Value> execute(std::vector<std::unique_ptr<Value>>& argv, Environment& env) const;
+   /// run function on unboxed arguments, the values are only boxed if the function was not created with a ScalarCallback
+   Scalar executeScalar(const Scalar* argv, Environment& env) const;
+   bool isUnboxed() const {return scalarFunc != nullptr;}
+   /// executeScalar for a call site: the argument types are compared with the parameters only if checkArguments is set (calls check them
+   /// once when they are bound to the function), the result type always; both throw harriet::Exception
+   Scalar executeCall(const Scalar* argv, bool checkArguments, Environment& env) const;
+   /// throw harriet::Exception unless the type is the one of the parameter / the result
+   void checkArgumentType(uint32_t index, harriet::VariableType type) const;
+   void checkResultType(harriet::VariableType type) const;
+
+   /// Answers calls with the same arguments from a table of at most capacity results, only possible for pure functions. The table is shared
+   /// by all threads calling the function, it is split into shards by the arguments, each with its own lock and evicting the entry not
+   /// used for the longest time among its own (clock algorithm, an approximation of least recently used).
+   void memoize(uint32_t capacity);
+   struct MemoStatistics {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t evictions;
+      uint32_t size;
+   };
+   MemoStatistics getMemoStatistics() const;
 
    /// access properties
    harriet::VariableType getResultType() const;
@@ -31,18 +113,37 @@ public:
    harriet::VariableType getArgumentType(uint32_t index) const;
    const std::string& getName() const;
    uint32_t getId() const {return id;}
+   /// unique among all functions ever created, tells apart functions with the same name, id and types but another implementation
+   uint64_t getSerial() const {return serial;}
+   bool isPure() const {return pure;}
 
    /// helper
    const std::string getFunctionHeader() const;
 
 private:
+   struct Memo;
+   std::unique_ptr<Value> call(std::vector<std::unique_ptr<Value>>& argv, Environment& env) const;
+   Scalar callScalar(const Scalar* argv, Environment& env) const;
+
    const std::string name;
    const uint32_t id;
+   const uint64_t serial;
    std::function<std::unique_ptr<Value>(std::vector<std::unique_ptr<Value>>&, Environment&)> func;
+   ScalarCallback scalarFunc; // one of the two is set
    std::vector<std::pair<harriet::VariableType, std::string>> arguments;
    harriet::VariableType resultType;
+   bool pure;
+   std::unique_ptr<Memo> memo; // nullptr if not memoized
 };
 //---------------------------------------------------------------------------
+template<class Callable>
+std::unique_ptr<Function> Function::fromNative(const std::string& name, uint32_t id, Callable callable, bool pure)
+{
+   typedef NativeSignature<Callable> Signature;
+   ScalarCallback thunk = [callable](const Scalar* argv, Environment& /*env*/) mutable {return Signature::call(callable, argv, typename Signature::Indices());};
+   return std::unique_ptr<Function>(new Function(name, id, thunk, Signature::argumentTypes(), NativeType<typename Signature::Result>::type(), pure));
+}
+//---------------------------------------------------------------------------
 } // end of namespace harriet
 //---------------------------------------------------------------------------
 #endif
@@ -2,6 +2,7 @@
 #define SCRIPTLANGUAGE_GENERICALLOCATORPOLICIES_HPP
 //---------------------------------------------------------------------------
 #include "GenericAllocatorPolicies.hpp"
+#include "EvaluationArena.hpp"
 #include <stdint.h>
 #include <cassert>
 //---------------------------------------------------------------------------
@@ -13,7 +14,7 @@ namespace harriet {
 //---------------------------------------------------------------------------
 /// host class => a customizable allocator
 template<class T, // class which should be allocated
-         template <class Type> class Allocator = FreeListPolicy> // how should the memory be managed
+         template <class Type> class Allocator = DefaultAllocatorPolicy> // how should the memory be managed
 class GenericAllocator : public Allocator<T> {
 public:
 
@@ -25,17 +26,27 @@ protected:
    ~GenericAllocator() {} // protected so no one can delete the derived class by the base pointer
 };
 //---------------------------------------------------------------------------
-/// new operator of host class, combining the policies
+/// new operator of host class, combining the policies (an active evaluation arena takes precedence, the thread's arena is only looked at
+/// while some thread uses one)
 template<class T, template <class> class Allocator>
 void* GenericAllocator<T, Allocator>::operator new(std::size_t size) throw(std::bad_alloc)
 {
+   if(EvaluationArena::anyActive()) {
+      EvaluationArena* arena = EvaluationArena::active();
+      if(arena != nullptr)
+         return arena->allocate(size);
+   }
    return Allocator<T>::allocate(size);
 }
 //---------------------------------------------------------------------------
-/// delete operator of host class, combining the policies
+/// delete operator of host class, memory of an arena is only released with the arena
 template<class T, template <class Type> class Allocator>
 void GenericAllocator<T, Allocator>::operator delete(void* data, std::size_t size) throw()
 {
+   if(data == nullptr)
+      return;
+   if(EvaluationArena::anyActive() && EvaluationArena::findOwner(data)!=nullptr)
+      return;
    Allocator<T>::deallocate(data, size);
 }
 //---------------------------------------------------------------------------
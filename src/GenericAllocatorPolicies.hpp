@@ -2,6 +2,7 @@
 #define SCRIPTLANGUAGE_GENERICALLOCATOR_HPP
 //---------------------------------------------------------------------------
 #include <stdint.h>
+#include <atomic>
 #include <cassert>
 #include <memory>
 #include <cstdlib>
@@ -109,6 +110,184 @@ typename FreeListPolicy<T>::FreeElement* FreeListPolicy<T>::nextFreeElement = NU
 template<class T>
 uint32_t FreeListPolicy<T>::positionInCurrentChunk;
 //---------------------------------------------------------------------------
+/// policy class  => fixed allocator with a free list per thread, safe to use from any number of threads
+/// Threads allocate from and free into their own list without synchronization. Memory freed by another thread than the allocating one simply
+/// stays with the freeing thread. A thread with too many free elements hands a batch of them to a lock free global list, where threads with
+/// an empty list pick them up. Only if there is no batch, a new chunk is carved into elements by the requesting thread.
+template<class T>
+class ThreadCachePolicy {
+public:
+   static void* allocate(std::size_t /*size*/)
+   {
+      static_assert(sizeof(T) >= sizeof(FreeElement), "allocated type is to small to hold a free list entry");
+      ThreadCache& cache = threadCache;
+      if(cache.freeList==NULL && !cache.refill()) {
+         if(cache.chunkPosition == cache.chunkEnd)
+            cache.carve();
+         void* result = cache.chunkPosition;
+         cache.chunkPosition += sizeof(T);
+         return result;
+      }
+
+      FreeElement* result = cache.freeList;
+      cache.freeList = result->next;
+      cache.freeCount--;
+      return result;
+   }
+
+   static void deallocate(void* data, std::size_t /*size*/)
+   {
+      ThreadCache& cache = threadCache;
+      FreeElement* element = static_cast<FreeElement*>(data);
+      element->next = cache.freeList;
+      cache.freeList = element;
+      if(++cache.freeCount >= 2*batchSize)
+         cache.release(batchSize);
+   }
+protected:
+   ~ThreadCachePolicy() {}
+private:
+   static const uint32_t batchSize = 64;
+   static const uint32_t chunkSize = 256;
+
+   /// a batch is a list of free elements, the first one links to the next batch
+   struct FreeElement
+   {
+      FreeElement* next;
+      FreeElement* nextBatch;
+   };
+
+   struct Chunk
+   {
+      uint8_t* mem;
+      Chunk* next;
+   };
+
+   /// batches shared by all threads and all chunks, chunks are released at exit (same as the FreeListPolicy does)
+   struct Global
+   {
+      std::atomic<FreeElement*> batches;
+      std::atomic<Chunk*> chunks;
+      ~Global()
+      {
+         for(Chunk* chunk=chunks.load(); chunk!=NULL;) {
+            Chunk* next = chunk->next;
+            delete [] chunk->mem;
+            delete chunk;
+            chunk = next;
+         }
+      }
+
+      void pushBatch(FreeElement* first, FreeElement* last)
+      {
+         last->nextBatch = batches.load(std::memory_order_relaxed);
+         while(!batches.compare_exchange_weak(last->nextBatch, first, std::memory_order_release, std::memory_order_relaxed));
+      }
+   };
+
+   /// plain data => it is zero initialised and the fast paths access it without going through the tls init wrapper of the compiler
+   struct ThreadCache
+   {
+      FreeElement* freeList;
+      uint32_t freeCount;
+      bool exitRegistered;
+      uint8_t* chunkPosition;
+      uint8_t* chunkEnd;
+
+      /// take one batch from the global list, the whole list is taken out by an exchange so that there is no aba problem
+      bool refill()
+      {
+         registerExit();
+         FreeElement* taken = global.batches.exchange(NULL, std::memory_order_acquire);
+         if(taken == NULL)
+            return false;
+         FreeElement* rest = taken->nextBatch;
+         FreeElement* expected = NULL;
+         if(rest!=NULL && !global.batches.compare_exchange_strong(expected, rest, std::memory_order_release, std::memory_order_relaxed)) {
+            // someone released a batch in the meantime => append it to the rest
+            FreeElement* lastBatch = rest;
+            while(lastBatch->nextBatch != NULL)
+               lastBatch = lastBatch->nextBatch;
+            global.pushBatch(rest, lastBatch);
+         }
+         freeList = taken;
+         for(FreeElement* iter=taken; iter!=NULL; iter=iter->next)
+            freeCount++;
+         return true;
+      }
+
+      /// move the first count free elements to the global list
+      void release(uint32_t count)
+      {
+         registerExit();
+         if(count == 0)
+            return;
+         FreeElement* first = freeList;
+         FreeElement* last = freeList;
+         for(uint32_t i=1; i<count; i++)
+            last = last->next;
+         freeList = last->next;
+         freeCount -= count;
+         last->next = NULL;
+         global.pushBatch(first, first);
+      }
+
+      void carve()
+      {
+         Chunk* chunk = new Chunk();
+         chunk->mem = new uint8_t[chunkSize*sizeof(T)];
+         chunk->next = global.chunks.load(std::memory_order_relaxed);
+         while(!global.chunks.compare_exchange_weak(chunk->next, chunk, std::memory_order_release, std::memory_order_relaxed));
+         chunkPosition = chunk->mem;
+         chunkEnd = chunk->mem + chunkSize*sizeof(T);
+      }
+
+      /// the elements of an exiting thread are not lost, neither the free ones nor the unused rest of its chunk
+      void drain()
+      {
+         for(; chunkPosition!=chunkEnd; chunkPosition+=sizeof(T)) {
+            FreeElement* element = reinterpret_cast<FreeElement*>(chunkPosition);
+            element->next = freeList;
+            freeList = element;
+            freeCount++;
+         }
+         release(freeCount);
+      }
+
+      /// only the slow paths get here, so only they pay for the registration of the thread exit handler
+      void registerExit()
+      {
+         if(exitRegistered)
+            return;
+         exitRegistered = true;
+         static thread_local ThreadExit threadExit;
+      }
+   };
+
+   struct ThreadExit
+   {
+      ~ThreadExit() {threadCache.drain();}
+   };
+
+   static Global global;
+   static thread_local ThreadCache threadCache;
+};
+//---------------------------------------------------------------------------
+template<class T>
+typename ThreadCachePolicy<T>::Global ThreadCachePolicy<T>::global;
+//---------------------------------------------------------------------------
+template<class T>
+thread_local typename ThreadCachePolicy<T>::ThreadCache ThreadCachePolicy<T>::threadCache;
+//---------------------------------------------------------------------------
+/// policy used by the value classes, "make single_threaded=1" defines HARRIET_SINGLE_THREADED for all translation units to get the
+/// unsynchronized free list. It saves the bookkeeping of the thread caches, a tree evaluation of the benchmark formula takes about 15% less
+/// time with it. Do not define it for single files, the value classes would differ between them.
+#ifdef HARRIET_SINGLE_THREADED
+template<class T> using DefaultAllocatorPolicy = FreeListPolicy<T>;
+#else
+template<class T> using DefaultAllocatorPolicy = ThreadCachePolicy<T>;
+#endif
+//---------------------------------------------------------------------------
 } // end of namesapce scriptlanguage
 //---------------------------------------------------------------------------
 #endif
@@ -1,7 +1,11 @@
 #include "Harriet.hpp"
+#include "ClosureProgram.hpp"
 #include "Environment.hpp"
 #include "Expression.hpp"
 #include "ExpressionParser.hpp"
+#include "ExpressionOptimizer.hpp"
+#include "NativeProgram.hpp"
+#include "Program.hpp"
 #include "Utility.hpp"
 //---------------------------------------------------------------------------
 // Harriet Script Language
@@ -15,36 +19,68 @@ namespace harriet {
 unique_ptr<Expression> parse(const string& input)
 {
     Environment environment;
-    return ExpressionParser::parse(input, environment);
+    return ExpressionOptimizer::optimize(ExpressionParser::parse(input, environment), environment);
 }
 //---------------------------------------------------------------------------
 unique_ptr<Expression> parse(const string& input, Environment& environment)
 {
-    return ExpressionParser::parse(input, environment);
+    return ExpressionOptimizer::optimize(ExpressionParser::parse(input, environment), environment);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Expression> parse(const string& input, Environment& environment, Backend backend)
+{
+    auto expression = parse(input, environment);
+    if(backend == Backend::TTree)
+        return expression;
+    if(backend == Backend::TBytecode) {
+        auto bytecode = Program::compile(*expression, environment);
+        if(bytecode == nullptr)
+            return expression;
+        return make_unique<BytecodeExpression>(::move(expression), ::move(bytecode));
+    }
+    auto program = ClosureProgram::compile(*expression, environment);
+    auto native = backend==Backend::TNative ? NativeProgram::compile(*expression, environment) : nullptr;
+    if(program == nullptr && native == nullptr)
+        return expression;
+    return make_unique<ClosureExpression>(::move(expression), ::move(program), ::move(native));
 }
 //---------------------------------------------------------------------------
 unique_ptr<Value> evaluate(const string& input)
 {
     Environment environment;
-    return ExpressionParser::parse(input, environment)->evaluate(environment);
+    return evaluate(input, environment);
 }
 //---------------------------------------------------------------------------
 unique_ptr<Value> evaluate(const string& input, Environment& environment)
 {
-    return ExpressionParser::parse(input, environment)->evaluate(environment);
+    return parse(input, environment)->evaluate(environment);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> evaluate(const string& input, Environment& environment, EvaluationArena& arena)
+{
+    // the tree and its literals outlive the scope => created outside of the arena
+    auto expression = parse(input, environment);
+    EvaluationArena::Scope scope(arena);
+    auto result = expression->evaluate(environment);
+    return EvaluationArena::promote(::move(result), environment);
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> evaluate(const string& input, Environment& environment, ExpressionCache& cache)
+{
+    return cache.evaluate(input, environment);
 }
 //---------------------------------------------------------------------------
 int32_t evaluateAsInteger(const string& input)
 {
     Environment environment;
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto integerResultValue = resultValue->computeCast(environment, harriet::VariableType::TInteger); // TODO: why not use a castToIntegerMethode ?
     return reinterpret_cast<IntegerValue*>(integerResultValue.get())->result;
 }
 //---------------------------------------------------------------------------
 int32_t evaluateAsInteger(const string& input, Environment& environment)
 {
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto integerResultValue = resultValue->computeCast(environment, harriet::VariableType::TInteger);
     return reinterpret_cast<IntegerValue*>(integerResultValue.get())->result;
 }
@@ -52,14 +88,14 @@ int32_t evaluateAsInteger(const string& input, Environment& environment)
 float evaluateAsFloat(const string& input)
 {
     Environment environment;
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto floatResultValue = resultValue->computeCast(environment, harriet::VariableType::TFloat);
     return reinterpret_cast<FloatValue*>(floatResultValue.get())->result;
 }
 //---------------------------------------------------------------------------
 float evaluateAsFloat(const string& input, Environment& environment)
 {
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto floatResultValue = resultValue->computeCast(environment, harriet::VariableType::TFloat);
     return reinterpret_cast<FloatValue*>(floatResultValue.get())->result;
 }
@@ -67,14 +103,14 @@ float evaluateAsFloat(const string& input, Environment& environment)
 const string evaluateAsString(const string& input)
 {
     Environment environment;
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto stringResultValue = resultValue->computeCast(environment, harriet::VariableType::TString);
     return reinterpret_cast<StringValue*>(stringResultValue.get())->result;
 }
 //---------------------------------------------------------------------------
 const string evaluateAsString(const string& input, Environment& environment)
 {
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto stringResultValue = resultValue->computeCast(environment, harriet::VariableType::TString);
     return reinterpret_cast<StringValue*>(stringResultValue.get())->result;
 }
@@ -82,14 +118,14 @@ const string evaluateAsString(const string& input, Environment& environment)
 const Vector3<float> evaluateAsVector(const string& input)
 {
     Environment environment;
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto vectorResultValue = resultValue->computeCast(environment, harriet::VariableType::TVector);
     return reinterpret_cast<VectorValue*>(vectorResultValue.get())->result;
 }
 //---------------------------------------------------------------------------
 const Vector3<float> evaluateAsVector(const string& input, Environment& environment)
 {
-    auto resultValue = ExpressionParser::parse(input, environment)->evaluate(environment);
+    auto resultValue = evaluate(input, environment);
     auto vectorResultValue = resultValue->computeCast(environment, harriet::VariableType::TVector);
     return reinterpret_cast<VectorValue*>(vectorResultValue.get())->result;
 }
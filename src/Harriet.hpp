@@ -1,5 +1,10 @@
+#ifndef SCRIPTLANGUAGE_HARRIET_HPP_
+#define SCRIPTLANGUAGE_HARRIET_HPP_
+//---------------------------------------------------------------------------
 #include "Expression.hpp"
 #include "Environment.hpp"
+#include "EvaluationArena.hpp"
+#include "ExpressionCache.hpp"
 #include <memory>
 //---------------------------------------------------------------------------
 // Harriet Script Language
@@ -12,9 +17,20 @@ namespace harriet {
 std::unique_ptr<Expression> parse(const std::string& input);
 std::unique_ptr<Expression> parse(const std::string& input, Environment& environment);
 
-/// Parses the input and directly evaluates it.
+/// How a parsed expression is evaluated: by walking the tree, by the stack vm (see Program), by a chain of closures specialised for the static
+/// types (see ClosureProgram) or by x86-64 code (see NativeProgram). Expressions the native code can not handle run as closures, the ones
+/// closures or the vm can not handle as trees.
+enum struct Backend : uint8_t {TTree, TBytecode, TClosures, TNative};
+std::unique_ptr<Expression> parse(const std::string& input, Environment& environment, Backend backend);
+
+/// Parses the input and directly evaluates it. The tree is walked once, nothing is compiled for a single evaluation (keep the result of parse
+/// with a Backend or use an ExpressionCache for expressions evaluated repeatedly).
 std::unique_ptr<Value> evaluate(const std::string& input);
 std::unique_ptr<Value> evaluate(const std::string& input, Environment& environment);
+/// Same, but the temporaries of the evaluation are placed in the arena. Only the result is copied out of it.
+std::unique_ptr<Value> evaluate(const std::string& input, Environment& environment, EvaluationArena& arena);
+/// Same, but the parsed expression is taken from the cache if the input was evaluated in an equal environment before.
+std::unique_ptr<Value> evaluate(const std::string& input, Environment& environment, ExpressionCache& cache);
 
 /// Parses the input and directly evaluates it as an integer.
 int32_t evaluateAsInteger(const std::string& input);
@@ -34,3 +50,4 @@ const Vector3<float> evaluateAsVector(const std::string& input, Environment& env
 //---------------------------------------------------------------------------
 } // end of namespace harriet
 //---------------------------------------------------------------------------
+#endif
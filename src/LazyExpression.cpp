@@ -0,0 +1,207 @@
+#include "LazyExpression.hpp"
+#include "ClosureProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include "Harriet.hpp"
+#include "Scalar.hpp"
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+LazyExpression::LazyExpression(unique_ptr<Expression> expression, Environment& environment)
+: expression(::move(expression))
+, environment(environment)
+, computeCount(0)
+{
+   build();
+}
+//---------------------------------------------------------------------------
+LazyExpression::LazyExpression(const string& input, Environment& environment)
+: expression(harriet::parse(input, environment))
+, environment(environment)
+, computeCount(0)
+{
+   build();
+}
+//---------------------------------------------------------------------------
+LazyExpression::~LazyExpression()
+{
+}
+//---------------------------------------------------------------------------
+const Value& LazyExpression::get()
+{
+   return force(nodes[expression.get()]);
+}
+//---------------------------------------------------------------------------
+const Value& LazyExpression::get(const Expression& node)
+{
+   auto iter = nodes.find(&node);
+   if(iter == nodes.end())
+      throw harriet::Exception{"expression is not a node of the lazy expression"};
+   return force(iter->second);
+}
+//---------------------------------------------------------------------------
+void LazyExpression::build()
+{
+   build(*expression);
+}
+//---------------------------------------------------------------------------
+uint32_t LazyExpression::build(const Expression& node)
+{
+   // wrappers are computed by the thunk of their child, all occurrences of a shared sub tree use the same one
+   switch(node.getExpressionType()) {
+      case ExpressionType::TShared: {
+         auto& child = reinterpret_cast<const SharedExpression&>(node).getChild();
+         auto iter = nodes.find(&child);
+         return nodes[&node] = iter!=nodes.end() ? iter->second : build(child);
+      }
+      case ExpressionType::TSharedScope:
+         return nodes[&node] = build(reinterpret_cast<const SharedExpressionScope&>(node).getChild());
+      case ExpressionType::TCompiled:
+         return nodes[&node] = build(reinterpret_cast<const CompiledExpression&>(node).getTree());
+      default:
+         break;
+   }
+
+   Thunk thunk{&node, {}, true, 0, nullptr, nullptr};
+   switch(node.getExpressionType()) {
+      case ExpressionType::TValue:
+         thunk.value = &reinterpret_cast<const Value&>(node);
+         break;
+      case ExpressionType::TUnaryOperator:
+         thunk.children.push_back(build(reinterpret_cast<const UnaryOperator&>(node).getChild()));
+         break;
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(node);
+         if(binary.getOperatorType() == OperatorType::TAssignment)
+            thunk.memoized = false; else
+            thunk.children.push_back(build(binary.getLhs()));
+         thunk.children.push_back(build(binary.getRhs()));
+         break;
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(node);
+         thunk.memoized = call.resolve(environment).isPure();
+         for(auto& argument : call.getArguments())
+            thunk.children.push_back(build(*argument));
+         break;
+      }
+      default:
+         break;
+   }
+   for(auto child : thunk.children)
+      thunk.memoized &= thunks[child].memoized;
+
+   uint32_t index = thunks.size();
+   thunks.push_back(::move(thunk));
+   return nodes[&node] = index;
+}
+//---------------------------------------------------------------------------
+const Value& LazyExpression::force(uint32_t index)
+{
+   // literals have no result of their own and are always up to date
+   auto& thunk = thunks[index];
+   uint64_t epoch = environment.getEpoch();
+   if(thunk.value!=nullptr && (thunk.result==nullptr || (thunk.memoized && thunk.epoch==epoch)))
+      return *thunk.value;
+
+   // a memoized node does not change the environment => its result belongs to the epoch it started in
+   thunk.result = compute(thunk);
+   thunk.value = thunk.result.get();
+   thunk.epoch = epoch;
+   computeCount++;
+   return *thunk.value;
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> LazyExpression::compute(const Thunk& thunk)
+{
+   auto& node = *thunk.node;
+   switch(node.getExpressionType()) {
+      case ExpressionType::TVariable:
+         return node.evaluate(environment);
+      case ExpressionType::TUnaryOperator: {
+         auto& unary = reinterpret_cast<const UnaryOperator&>(node);
+         auto& child = force(thunk.children[0]);
+         switch(unary.getOperatorType()) {
+            case OperatorType::TUnaryMinus: return child.computeInv(environment);
+            case OperatorType::TNot:        return child.computeNot(environment);
+            case OperatorType::TCast:       return child.computeCast(environment, reinterpret_cast<const CastOperator&>(unary).getCastType());
+            default:                        throw harriet::Exception{"unknown unary operator"};
+         }
+      }
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(node);
+         if(binary.getOperatorType() == OperatorType::TAssignment) {
+            if(binary.getLhs().getExpressionType() != ExpressionType::TVariable)
+               throw harriet::Exception("need variable as left hand side of assignment operator");
+            auto& variable = reinterpret_cast<const Variable&>(binary.getLhs());
+            auto value = force(thunk.children[0]).evaluate(environment);
+            if(variable.isBoundTo(environment))
+               environment.update(variable.getSlot(), ::move(value)); else
+               environment.update(variable.getIdentifier(), ::move(value));
+            return variable.evaluate(environment);
+         }
+
+         // the rhs of a node which is not memoized may change the epoch and thus recompute a shared lhs => keep a copy
+         const Value* lhs = &force(thunk.children[0]);
+         unique_ptr<Value> copy;
+         if(!thunk.memoized) {
+            copy = lhs->evaluate(environment);
+            lhs = copy.get();
+         }
+         bool logic = binary.getOperatorType()==OperatorType::TAnd || binary.getOperatorType()==OperatorType::TOr;
+         if(logic && reinterpret_cast<const LogicOperator&>(binary).isShortCircuit() && lhs->getResultType()==harriet::VariableType::TBool && reinterpret_cast<const BoolValue&>(*lhs).result==(binary.getOperatorType()==OperatorType::TOr))
+            return lhs->evaluate(environment);
+
+         auto& rhs = force(thunk.children[1]);
+         switch(binary.getOperatorType()) {
+            case OperatorType::TPlus:           return lhs->computeAdd(rhs, environment);
+            case OperatorType::TMinus:          return lhs->computeSub(rhs, environment);
+            case OperatorType::TMultiplication: return lhs->computeMul(rhs, environment);
+            case OperatorType::TDivision:       return lhs->computeDiv(rhs, environment);
+            case OperatorType::TModulo:         return lhs->computeMod(rhs, environment);
+            case OperatorType::TExponentiation: return lhs->computeExp(rhs, environment);
+            case OperatorType::TAnd:            return lhs->computeAnd(rhs, environment);
+            case OperatorType::TOr:             return lhs->computeOr (rhs, environment);
+            case OperatorType::TGreater:        return lhs->computeGt (rhs, environment);
+            case OperatorType::TLess:           return lhs->computeLt (rhs, environment);
+            case OperatorType::TGreaterEqual:   return lhs->computeGeq(rhs, environment);
+            case OperatorType::TLessEqual:      return lhs->computeLeq(rhs, environment);
+            case OperatorType::TEqual:          return lhs->computeEq (rhs, environment);
+            case OperatorType::TNotEqual:       return lhs->computeNeq(rhs, environment);
+            default:                            throw harriet::Exception{"unknown binary operator"};
+         }
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(node);
+         bool bound = call.isBoundTo(environment);
+         auto& function = call.resolve(environment);
+         if(function.isUnboxed()) {
+            Function::ScalarArguments argv(thunk.children.size());
+            for(uint32_t i=0; i<thunk.children.size(); i++)
+               argv[i] = Scalar::fromValue(force(thunk.children[i]));
+            return function.executeCall(argv.data(), !bound, environment).toValue();
+         }
+         vector<unique_ptr<Value>> arguments;
+         for(uint32_t i=0; i<thunk.children.size(); i++) {
+            arguments.push_back(force(thunk.children[i]).evaluate(environment));
+            if(!bound)
+               function.checkArgumentType(i, arguments.back()->getResultType());
+         }
+         auto result = function.execute(arguments, environment);
+         function.checkResultType(result->getResultType());
+         return result;
+      }
+      default:
+         throw harriet::Exception{"unable to evaluate expression lazily"};
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,69 @@
+#ifndef SCRIPTLANGUAGE_LAZYEXPRESSION_HPP_
+#define SCRIPTLANGUAGE_LAZYEXPRESSION_HPP_
+//---------------------------------------------------------------------------
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class Expression;
+class Value;
+//---------------------------------------------------------------------------
+/// An expression evaluated on demand. Every node of the tree becomes a thunk, which is computed when its value is requested and then kept
+/// until the epoch of the environment changes (Environment::getEpoch). Nodes nobody asks for are never computed, a node asked for several
+/// times in one epoch (through get, a shared sub tree or another consumer) is computed once.
+///
+/// Assignments and calls of impure functions change the environment or depend on more than it, they and the nodes above them are computed
+/// on every request (like by Expression::evaluate). Their other sub trees are still kept.
+class LazyExpression {
+public:
+   /// the expression has to be parsed in the environment
+   LazyExpression(std::unique_ptr<Expression> expression, Environment& environment);
+   /// parses the input in the environment
+   LazyExpression(const std::string& input, Environment& environment);
+   ~LazyExpression();
+   LazyExpression(const LazyExpression&) = delete;
+   LazyExpression& operator=(const LazyExpression&) = delete;
+
+   /// the value of the expression in the current epoch, stays valid until the expression is computed again
+   const Value& get();
+   /// the value of a node of the expression (e.g. the condition of a guard), throws harriet::Exception for other expressions
+   const Value& get(const Expression& node);
+
+   const Expression& getExpression() const {return *expression;}
+   /// number of computed nodes since the construction
+   uint64_t getComputeCount() const {return computeCount;}
+
+private:
+   struct Thunk {
+      const Expression* node;
+      std::vector<uint32_t> children;
+      bool memoized; // false for assignments, impure calls and nodes above them
+      uint64_t epoch; // in which the value was computed
+      std::unique_ptr<Value> result;
+      const Value* value; // result or the node itself for literals, nullptr if not yet computed
+   };
+
+   void build();
+   uint32_t build(const Expression& node);
+   const Value& force(uint32_t thunk);
+   std::unique_ptr<Value> compute(const Thunk& thunk);
+
+   std::unique_ptr<Expression> expression;
+   Environment& environment;
+   std::vector<Thunk> thunks;
+   std::unordered_map<const Expression*, uint32_t> nodes; // node of the expression -> thunk computing it
+   uint64_t computeCount;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,541 @@
+#include "NativeProgram.hpp"
+#include "ClosureProgram.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Function.hpp"
+#include "Operations.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define HARRIET_NATIVE 1
+#endif
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+/// a function call of the generated code, the arguments are passed on the machine stack
+struct NativeCall {
+   const FunctionOperator& call;
+   vector<harriet::VariableType> argumentTypes;
+   harriet::VariableType resultType;
+};
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+template<class T> NativeWord toWord(T value) {NativeWord word = 0; memcpy(&word, &value, sizeof(T)); return word;}
+template<> NativeWord toWord(bool value) {return value;}
+template<class T> T fromWord(NativeWord word) {T value; memcpy(&value, &word, sizeof(T)); return value;}
+template<> bool fromWord(NativeWord word) {return word!=0;}
+//---------------------------------------------------------------------------
+Scalar toScalar(NativeWord word, harriet::VariableType type)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return Scalar(fromWord<int32_t>(word));
+      case harriet::VariableType::TFloat:   return Scalar(fromWord<float>(word));
+      default:                              return Scalar(fromWord<bool>(word));
+   }
+}
+//---------------------------------------------------------------------------
+NativeWord toWord(const Scalar& value)
+{
+   switch(value.type) {
+      case harriet::VariableType::TInteger: return toWord(value.integer);
+      case harriet::VariableType::TFloat:   return toWord(value.floating);
+      default:                              return toWord(value.boolean);
+   }
+}
+//---------------------------------------------------------------------------
+bool isWord(harriet::VariableType type)
+{
+   return type==harriet::VariableType::TInteger || type==harriet::VariableType::TFloat || type==harriet::VariableType::TBool;
+}
+//---------------------------------------------------------------------------
+const Value& readVariable(const Variable& variable, const Environment& environment)
+{
+   return variable.isBoundTo(environment) ? environment.read(variable.getSlot()) : environment.read(variable.getIdentifier());
+}
+//---------------------------------------------------------------------------
+/// called by the generated code, the argument i is the (count-1-i)th word pushed; must not throw
+NativeWord callFunction(const NativeCall* native, const uint64_t* stack, NativeContext* context)
+{
+   try {
+      // the argument types are only checked if the function may have been replaced since compiling (see FunctionOperator::callUnboxed)
+      bool bound = native->call.isBoundTo(*context->environment);
+      auto& function = native->call.resolve(*context->environment);
+      uint32_t count = native->argumentTypes.size();
+      Function::ScalarArguments argv(count);
+      for(uint32_t i=0; i<count; i++)
+         argv[i] = toScalar(static_cast<NativeWord>(stack[count-1-i]), native->argumentTypes[i]);
+      Scalar result = function.executeCall(argv.data(), !bound, *context->environment);
+      if(result.type != native->resultType)
+         throw harriet::Exception{"function '" + function.getName() + "' returned '" + harriet::typeToName(result.type) + "' instead of '" + harriet::typeToName(native->resultType) + "'"};
+      return toWord(result);
+   } catch(...) {
+      context->failure = current_exception();
+      context->failed = true;
+      return 0;
+   }
+}
+//---------------------------------------------------------------------------
+/// the exponentiation has no instruction, the generated code calls these
+template<class L, class R>
+NativeWord exponentiate(NativeWord lhs, NativeWord rhs)
+{
+   return toWord(ExpOperation::apply(fromWord<L>(lhs), fromWord<R>(rhs)));
+}
+//---------------------------------------------------------------------------
+/// Emits the few x86-64 instructions the compiler needs. Values are computed in eax, the lhs of a binary operator is popped into eax and its
+/// rhs moved to ecx. Floats are moved into xmm0 (lhs) and xmm1 (rhs) for computing. rbx points to the variables, r12 to the context and
+/// r13 to the frame, the shared results are stored below it.
+class Assembler {
+public:
+   vector<uint8_t> code;
+   uint32_t depth = 0; // words pushed since the frame, the stack has to be 16 byte aligned for calls
+
+   void emit(initializer_list<uint8_t> bytes) {code.insert(code.end(), bytes);}
+   void emit32(uint32_t value) {for(uint32_t i=0; i<4; i++) code.push_back(value >> (8*i));}
+   void emit64(uint64_t value) {for(uint32_t i=0; i<8; i++) code.push_back(value >> (8*i));}
+
+   void prologue() {emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xE5, 0x48, 0x81, 0xEC}); frameSize = code.size(); emit32(0);} // push rbx; push r12; push r13; mov rbx, rdi; mov r12, rsi; mov r13, rsp; sub rsp, frame
+   void setFrameSize(uint32_t bytes) {for(uint32_t i=0; i<4; i++) code[frameSize+i] = bytes >> (8*i);}
+   void epilogue() {emit({0x4C, 0x89, 0xEC, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});} // mov rsp, r13; pop r13; pop r12; pop rbx; ret
+
+   void loadConstant(NativeWord value) {emit({0xB8}); emit32(value);} // mov eax, imm32
+   void loadVariable(uint32_t index) {emit({0x8B, 0x83}); emit32(4*index);} // mov eax, [rbx+4*index]
+   void loadShared(uint32_t index) {emit({0x41, 0x8B, 0x85}); emit32(-8*(index+1));} // mov eax, [r13-8*(index+1)]
+   void storeShared(uint32_t index) {emit({0x41, 0x89, 0x85}); emit32(-8*(index+1));} // mov [r13-8*(index+1)], eax
+   void push() {emit({0x50}); depth++;}
+   void popOperands() {emit({0x89, 0xC1, 0x58}); depth--;} // mov ecx, eax; pop rax
+
+   /// integer and bool
+   void add() {emit({0x01, 0xC8});}
+   void sub() {emit({0x29, 0xC8});}
+   void mul() {emit({0x0F, 0xAF, 0xC1});}
+   void div() {emit({0x99, 0xF7, 0xF9});} // cdq; idiv ecx
+   void bitAnd() {emit({0x21, 0xC8});}
+   void bitOr() {emit({0x09, 0xC8});}
+   void negate() {emit({0xF7, 0xD8});}
+   void flip(uint32_t mask) {emit({0x35}); emit32(mask);} // xor eax, imm32
+   void compare() {emit({0x39, 0xC8});} // cmp eax, ecx
+   void test() {emit({0x85, 0xC0});} // test eax, eax
+   void testRhs() {emit({0x85, 0xC9});} // test ecx, ecx
+   void remainder() {emit({0x89, 0xD0});} // mov eax, edx
+   void zero() {emit({0x31, 0xC0});}
+   void setFlag(uint8_t condition) {emit({0x0F, condition, 0xC0, 0x0F, 0xB6, 0xC0});} // setcc al; movzx eax, al
+   void setFlags(uint8_t condition, uint8_t parity, uint8_t combine) {emit({0x0F, condition, 0xC0, 0x0F, parity, 0xC1, combine, 0xC8, 0x0F, 0xB6, 0xC0});} // setcc al; setp/np cl; and/or al, cl; movzx eax, al
+
+   /// float
+   void toFloat(bool lhsInteger, bool rhsInteger) {
+      if(lhsInteger) emit({0xF3, 0x0F, 0x2A, 0xC0}); else emit({0x66, 0x0F, 0x6E, 0xC0}); // cvtsi2ss xmm0, eax / movd xmm0, eax
+      if(rhsInteger) emit({0xF3, 0x0F, 0x2A, 0xC9}); else emit({0x66, 0x0F, 0x6E, 0xC9}); // cvtsi2ss xmm1, ecx / movd xmm1, ecx
+   }
+   void fromFloat() {emit({0x66, 0x0F, 0x7E, 0xC0});} // movd eax, xmm0
+   void floatOperation(uint8_t opcode) {emit({0xF3, 0x0F, opcode, 0xC1});} // addss/subss/mulss/divss xmm0, xmm1
+   void compareFloat(bool swapped) {emit({0x0F, 0x2E, uint8_t(swapped ? 0xC8 : 0xC1)});} // ucomiss xmm0, xmm1 / xmm1, xmm0
+   void floatToBool() {emit({0x66, 0x0F, 0x6E, 0xC0, 0x0F, 0x57, 0xC9, 0x0F, 0x2E, 0xC1});} // movd xmm0, eax; xorps xmm1, xmm1; ucomiss xmm0, xmm1
+   void integerToFloat() {emit({0xF3, 0x0F, 0x2A, 0xC0}); fromFloat();}
+   void floatToInteger() {emit({0x66, 0x0F, 0x6E, 0xC0, 0xF3, 0x0F, 0x2C, 0xC0});} // movd xmm0, eax; cvttss2si eax, xmm0
+   void remainderToFloat() {emit({0xF3, 0x0F, 0x2A, 0xC2}); fromFloat();} // cvtsi2ss xmm0, edx
+
+   /// control flow, jumps return the position of their offset which is patched by bind
+   uint32_t jump(uint8_t condition) {if(condition) emit({0x0F, condition}); else emit({0xE9}); emit32(0); return code.size()-4;}
+   void bind(uint32_t position) {uint32_t offset = code.size() - (position+4); for(uint32_t i=0; i<4; i++) code[position+i] = offset >> (8*i);}
+
+   /// calls with the arguments in edi and esi or in rdi, rsi (the pushed words) and rdx
+   void passOperands() {emit({0x89, 0xC7, 0x89, 0xCE});} // mov edi, eax; mov esi, ecx
+   void passCall(const NativeCall* call) {emit({0x48, 0x89, 0xE6, 0x48, 0xBF}); emit64(reinterpret_cast<uint64_t>(call)); emit({0x4C, 0x89, 0xE2});} // mov rsi, rsp; mov rdi, call; mov rdx, r12
+   void call(const void* target) {
+      bool pad = depth%2==1;
+      if(pad) emit({0x48, 0x83, 0xEC, 0x08});
+      emit({0x48, 0xB8}); emit64(reinterpret_cast<uint64_t>(target)); emit({0xFF, 0xD0}); // mov rax, target; call rax
+      if(pad) emit({0x48, 0x83, 0xC4, 0x08});
+   }
+   void drop(uint32_t count) {if(count) {emit({0x48, 0x81, 0xC4}); emit32(8*count); depth-=count;}} // add rsp, 8*count
+   uint32_t jumpIfFailed() {emit({0x41, 0x80, 0x3C, 0x24, 0x00}); return jump(0x85);} // cmp byte [r12], 0; jne
+
+private:
+   uint32_t frameSize = 0;
+};
+//---------------------------------------------------------------------------
+/// condition codes of setcc (0x0F 0x90+cc) and jcc (0x0F 0x80+cc)
+const uint8_t kEqual = 0x94, kNotEqual = 0x95, kAbove = 0x97, kAboveEqual = 0x93, kParity = 0x9A, kNoParity = 0x9B, kLess = 0x9C, kGreaterEqual = 0x9D, kGreater = 0x9F;
+const uint8_t kJumpZero = 0x84, kJumpNotZero = 0x85;
+const uint8_t kAndFlags = 0x20, kOrFlags = 0x08;
+//---------------------------------------------------------------------------
+/// state while compiling one expression
+struct Compilation {
+   Environment& environment;
+   Assembler assembler;
+   vector<const Variable*> variables;
+   vector<unique_ptr<NativeCall>> calls;
+   vector<bool> compiledShared; // shared sub trees whose result is stored in the frame at this point of the code
+   vector<uint32_t> exits; // jumps taken if a function failed
+};
+//---------------------------------------------------------------------------
+bool compileNode(const Expression& expression, Compilation& compilation);
+//---------------------------------------------------------------------------
+bool compileUnary(const UnaryOperator& unary, Compilation& compilation)
+{
+   auto& assembler = compilation.assembler;
+   auto childType = unary.getChild().getResultType();
+   if(!compileNode(unary.getChild(), compilation))
+      return false;
+
+   switch(unary.getOperatorType()) {
+      case OperatorType::TUnaryMinus:
+         if(childType == harriet::VariableType::TInteger) {assembler.negate(); return true;}
+         if(childType == harriet::VariableType::TFloat) {assembler.flip(0x80000000); return true;}
+         return false;
+      case OperatorType::TNot:
+         if(childType != harriet::VariableType::TBool)
+            return false;
+         assembler.flip(1);
+         return true;
+      case OperatorType::TCast: {
+         auto target = reinterpret_cast<const CastOperator&>(unary).getCastType();
+         if(!isWord(target))
+            return false;
+         if(target == harriet::VariableType::TFloat && childType != harriet::VariableType::TFloat) {
+            assembler.integerToFloat(); // bools are 0 or 1
+         } else if(target == harriet::VariableType::TInteger && childType == harriet::VariableType::TFloat) {
+            assembler.floatToInteger();
+         } else if(target == harriet::VariableType::TBool && childType == harriet::VariableType::TInteger) {
+            assembler.test();
+            assembler.setFlag(kNotEqual);
+         } else if(target == harriet::VariableType::TBool && childType == harriet::VariableType::TFloat) {
+            assembler.floatToBool();
+            assembler.setFlags(kNotEqual, kParity, kOrFlags); // NaN != 0
+         }
+         return true;
+      }
+      default:
+         return false;
+   }
+}
+//---------------------------------------------------------------------------
+bool compileComparison(OperatorType operatorType, harriet::VariableType lhs, harriet::VariableType rhs, Assembler& assembler)
+{
+   if(lhs==harriet::VariableType::TBool || rhs==harriet::VariableType::TBool) {
+      if(lhs != rhs || (operatorType!=OperatorType::TEqual && operatorType!=OperatorType::TNotEqual))
+         return false;
+      assembler.compare();
+      assembler.setFlag(operatorType==OperatorType::TEqual ? kEqual : kNotEqual);
+      return true;
+   }
+
+   if(lhs==harriet::VariableType::TInteger && rhs==harriet::VariableType::TInteger) {
+      assembler.compare();
+      switch(operatorType) {
+         case OperatorType::TGreater:      assembler.setFlag(kGreater); return true;
+         case OperatorType::TLess:         assembler.setFlag(kLess); return true;
+         case OperatorType::TGreaterEqual: assembler.setFlag(kGreaterEqual); return true;
+         case OperatorType::TLessEqual:    assembler.setFlag(kGreaterEqual); return true; // sic, see IntegerValue::computeLeq
+         case OperatorType::TEqual:        assembler.setFlag(kEqual); return true;
+         default:                          assembler.setFlag(kNotEqual); return true;
+      }
+   }
+
+   // ucomiss sets the carry and zero flag for unordered operands => above and above equal are false for NaN
+   assembler.toFloat(lhs==harriet::VariableType::TInteger, rhs==harriet::VariableType::TInteger);
+   switch(operatorType) {
+      case OperatorType::TGreater:      assembler.compareFloat(false); assembler.setFlag(kAbove); return true;
+      case OperatorType::TLess:         assembler.compareFloat(true); assembler.setFlag(kAbove); return true;
+      case OperatorType::TGreaterEqual: assembler.compareFloat(false); assembler.setFlag(kAboveEqual); return true;
+      case OperatorType::TLessEqual:    assembler.compareFloat(rhs==harriet::VariableType::TFloat); assembler.setFlag(kAboveEqual); return true; // sic, float <= int is >=, see FloatValue::computeLeq
+      case OperatorType::TEqual:        assembler.compareFloat(false); assembler.setFlags(kEqual, kNoParity, kAndFlags); return true;
+      default:                          assembler.compareFloat(false); assembler.setFlags(kNotEqual, kParity, kOrFlags); return true;
+   }
+}
+//---------------------------------------------------------------------------
+bool compileArithmetic(OperatorType operatorType, harriet::VariableType lhs, harriet::VariableType rhs, Assembler& assembler)
+{
+   if(lhs==harriet::VariableType::TBool || rhs==harriet::VariableType::TBool)
+      return false;
+
+   if(lhs==harriet::VariableType::TInteger && rhs==harriet::VariableType::TInteger) {
+      switch(operatorType) {
+         case OperatorType::TPlus:           assembler.add(); return true;
+         case OperatorType::TMinus:          assembler.sub(); return true;
+         case OperatorType::TMultiplication: assembler.mul(); return true;
+         case OperatorType::TDivision:       assembler.div(); return true;
+         default: {
+            // x % 0 is 0, see IntegerValue::computeMod
+            assembler.testRhs();
+            uint32_t byZero = assembler.jump(kJumpZero);
+            assembler.div();
+            assembler.remainder();
+            uint32_t done = assembler.jump(0);
+            assembler.bind(byZero);
+            assembler.zero();
+            assembler.bind(done);
+            return true;
+         }
+      }
+   }
+
+   if(operatorType == OperatorType::TModulo) {
+      if(lhs!=harriet::VariableType::TFloat || rhs!=harriet::VariableType::TInteger)
+         return false;
+      assembler.floatToInteger();
+      assembler.div();
+      assembler.remainderToFloat();
+      return true;
+   }
+
+   assembler.toFloat(lhs==harriet::VariableType::TInteger, rhs==harriet::VariableType::TInteger);
+   switch(operatorType) {
+      case OperatorType::TPlus:           assembler.floatOperation(0x58); break;
+      case OperatorType::TMinus:          assembler.floatOperation(0x5C); break;
+      case OperatorType::TMultiplication: assembler.floatOperation(0x59); break;
+      default:                            assembler.floatOperation(0x5E); break;
+   }
+   assembler.fromFloat();
+   return true;
+}
+//---------------------------------------------------------------------------
+const void* exponentiation(harriet::VariableType lhs, harriet::VariableType rhs)
+{
+   bool integerLhs = lhs==harriet::VariableType::TInteger;
+   if(rhs == harriet::VariableType::TInteger)
+      return integerLhs ? reinterpret_cast<const void*>(&exponentiate<int32_t, int32_t>) : reinterpret_cast<const void*>(&exponentiate<float, int32_t>);
+   return integerLhs ? reinterpret_cast<const void*>(&exponentiate<int32_t, float>) : reinterpret_cast<const void*>(&exponentiate<float, float>);
+}
+//---------------------------------------------------------------------------
+bool compileBinary(const BinaryOperator& binary, Compilation& compilation)
+{
+   auto& assembler = compilation.assembler;
+   auto operatorType = binary.getOperatorType();
+   if(operatorType == OperatorType::TAssignment)
+      return false; // the static types of the variables would change
+   auto lhs = binary.getLhs().getResultType();
+   auto rhs = binary.getRhs().getResultType();
+
+   // the short circuit of bools: the lhs stays in eax if it decides the result
+   bool logic = operatorType==OperatorType::TAnd || operatorType==OperatorType::TOr;
+   if(logic && reinterpret_cast<const LogicOperator&>(binary).isShortCircuit() && lhs==harriet::VariableType::TBool && rhs==harriet::VariableType::TBool) {
+      if(!compileNode(binary.getLhs(), compilation))
+         return false;
+      assembler.test();
+      uint32_t decided = assembler.jump(operatorType==OperatorType::TAnd ? kJumpZero : kJumpNotZero);
+      auto compiledShared = compilation.compiledShared; // the rhs may not run
+      if(!compileNode(binary.getRhs(), compilation))
+         return false;
+      compilation.compiledShared = ::move(compiledShared);
+      assembler.bind(decided);
+      return true;
+   }
+
+   if(!compileNode(binary.getLhs(), compilation))
+      return false;
+   assembler.push();
+   if(!compileNode(binary.getRhs(), compilation))
+      return false;
+   assembler.popOperands();
+
+   switch(operatorType) {
+      case OperatorType::TPlus:
+      case OperatorType::TMinus:
+      case OperatorType::TMultiplication:
+      case OperatorType::TDivision:
+      case OperatorType::TModulo:
+         return compileArithmetic(operatorType, lhs, rhs, assembler);
+      case OperatorType::TExponentiation:
+         if(lhs==harriet::VariableType::TBool || rhs==harriet::VariableType::TBool)
+            return false;
+         assembler.passOperands();
+         assembler.call(exponentiation(lhs, rhs));
+         return true;
+      case OperatorType::TAnd:
+      case OperatorType::TOr:
+         if(lhs!=rhs || lhs==harriet::VariableType::TFloat)
+            return false;
+         if(operatorType == OperatorType::TAnd)
+            assembler.bitAnd(); else
+            assembler.bitOr();
+         return true;
+      case OperatorType::TGreater:
+      case OperatorType::TLess:
+      case OperatorType::TGreaterEqual:
+      case OperatorType::TLessEqual:
+      case OperatorType::TEqual:
+      case OperatorType::TNotEqual:
+         return compileComparison(operatorType, lhs, rhs, assembler);
+      default:
+         return false;
+   }
+}
+//---------------------------------------------------------------------------
+bool compileCall(const FunctionOperator& call, Compilation& compilation)
+{
+   auto& assembler = compilation.assembler;
+   auto function = compilation.environment.getFunction(call.getFunctionIdentifier());
+   if(!function->isPure())
+      return false; // could change the variables, which are read before the code runs
+
+   unique_ptr<NativeCall> native(new NativeCall{call, {}, function->getResultType()});
+   for(uint32_t i=0; i<call.getArguments().size(); i++) {
+      auto& argument = *call.getArguments()[i];
+      if(argument.getResultType()!=function->getArgumentType(i) || !compileNode(argument, compilation))
+         return false;
+      native->argumentTypes.push_back(argument.getResultType());
+      assembler.push();
+   }
+
+   assembler.passCall(native.get());
+   assembler.call(reinterpret_cast<const void*>(&callFunction));
+   assembler.drop(native->argumentTypes.size());
+   compilation.exits.push_back(assembler.jumpIfFailed());
+   compilation.calls.push_back(::move(native));
+   return true;
+}
+//---------------------------------------------------------------------------
+bool compileNode(const Expression& expression, Compilation& compilation)
+{
+   auto& assembler = compilation.assembler;
+   if(!isWord(expression.getResultType()))
+      return false;
+
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TValue:
+         assembler.loadConstant(toWord(Scalar::fromValue(reinterpret_cast<const Value&>(expression))));
+         return true;
+      case ExpressionType::TVariable: {
+         auto& variable = reinterpret_cast<const Variable&>(expression);
+         auto& variables = compilation.variables;
+         auto iter = find_if(variables.begin(), variables.end(), [&variable](const Variable* other) {return other->getIdentifier()==variable.getIdentifier();});
+         if(iter == variables.end())
+            iter = variables.insert(variables.end(), &variable);
+         assembler.loadVariable(iter - variables.begin());
+         return true;
+      }
+      case ExpressionType::TUnaryOperator: {
+         auto& unary = reinterpret_cast<const UnaryOperator&>(expression);
+         return compileUnary(unary, compilation);
+      }
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+         return compileBinary(binary, compilation);
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         return compileCall(call, compilation);
+      }
+      case ExpressionType::TShared: {
+         // the first occurrence in the code computes the result, the later ones load it
+         auto& shared = reinterpret_cast<const SharedExpression&>(expression);
+         if(shared.getIndex() >= compilation.compiledShared.size())
+            compilation.compiledShared.resize(shared.getIndex()+1, false);
+         if(compilation.compiledShared[shared.getIndex()]) {
+            assembler.loadShared(shared.getIndex());
+            return true;
+         }
+         if(!compileNode(shared.getChild(), compilation))
+            return false;
+         assembler.storeShared(shared.getIndex());
+         compilation.compiledShared[shared.getIndex()] = true;
+         return true;
+      }
+      case ExpressionType::TSharedScope:
+         return compileNode(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), compilation);
+      case ExpressionType::TCompiled:
+         return compileNode(reinterpret_cast<const CompiledExpression&>(expression).getTree(), compilation);
+      default:
+         return false;
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+NativeProgram::NativeProgram()
+: function(nullptr)
+, code(nullptr)
+, codeSize(0)
+, resultType(harriet::VariableType::TInteger)
+{
+}
+//---------------------------------------------------------------------------
+NativeProgram::~NativeProgram()
+{
+#ifdef HARRIET_NATIVE
+   if(code != nullptr)
+      munmap(code, codeSize);
+#endif
+}
+//---------------------------------------------------------------------------
+unique_ptr<NativeProgram> NativeProgram::compile(const Expression& expression, Environment& environment)
+{
+#ifdef HARRIET_NATIVE
+   Compilation compilation{environment, Assembler(), {}, {}, {}, {}};
+   auto& assembler = compilation.assembler;
+   assembler.prologue();
+   if(!compileNode(expression, compilation))
+      return nullptr;
+   for(auto exit : compilation.exits)
+      assembler.bind(exit);
+   assembler.epilogue();
+   assembler.setFrameSize((compilation.compiledShared.size()*8 + 15) / 16 * 16);
+
+   // written before the pages become executable, they are never writable and executable at the same time
+   uint64_t size = assembler.code.size();
+   void* code = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if(code == MAP_FAILED)
+      return nullptr;
+   memcpy(code, assembler.code.data(), size);
+   if(mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(code, size);
+      return nullptr;
+   }
+
+   unique_ptr<NativeProgram> program(new NativeProgram());
+   program->code = code;
+   program->codeSize = size;
+   program->function = reinterpret_cast<NativeFunction>(code);
+   for(auto variable : compilation.variables) {
+      program->variables.push_back(variable->getIdentifier());
+      program->variableTypes.push_back(variable->getResultType());
+   }
+   program->bindings = ::move(compilation.variables);
+   program->calls = ::move(compilation.calls);
+   program->resultType = expression.getResultType();
+   return program;
+#else
+   (void) expression;
+   (void) environment;
+   return nullptr;
+#endif
+}
+//---------------------------------------------------------------------------
+bool NativeProgram::execute(Environment& environment, Scalar& result) const
+{
+   const uint32_t kInlineVariableCount = 16;
+   NativeWord inlineWords[kInlineVariableCount];
+   vector<NativeWord> heapWords;
+   NativeWord* words = inlineWords;
+   if(bindings.size() > kInlineVariableCount) {
+      heapWords.resize(bindings.size());
+      words = heapWords.data();
+   }
+   for(uint32_t i=0; i<bindings.size(); i++) {
+      auto& value = readVariable(*bindings[i], environment);
+      if(value.getResultType() != variableTypes[i])
+         return false;
+      words[i] = toWord(Scalar::fromValue(value));
+   }
+
+   NativeContext context{false, &environment, nullptr};
+   NativeWord word = function(words, &context);
+   if(context.failed)
+      rethrow_exception(context.failure);
+   result = toScalar(word, resultType);
+   return true;
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,72 @@
+#ifndef SCRIPTLANGUAGE_NATIVEPROGRAM_HPP_
+#define SCRIPTLANGUAGE_NATIVEPROGRAM_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "Scalar.hpp"
+#include <exception>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class Expression;
+class Variable;
+struct NativeCall;
+//---------------------------------------------------------------------------
+/// The bits of an int32_t, a float or a bool (0 or 1), the only value type of native code.
+typedef uint32_t NativeWord;
+//---------------------------------------------------------------------------
+/// State of one call of native code. Exceptions of called functions can not unwind through the generated code, they are stored here and the
+/// code returns early.
+struct NativeContext {
+   bool failed; // first member, tested by the generated code
+   Environment* environment;
+   std::exception_ptr failure;
+};
+//---------------------------------------------------------------------------
+/// Reads one word per variable (in the order of NativeProgram::getVariables) and returns the result word.
+typedef NativeWord (*NativeFunction)(const NativeWord* variables, NativeContext* context);
+//---------------------------------------------------------------------------
+/// An expression translated into x86-64 machine code. Ints, floats and bools live in general purpose registers, every node computes exactly
+/// what the compute methods of IntegerValue, FloatValue and BoolValue compute (including the traps of an integer division by zero). Pure
+/// function calls and the exponentiation call back into C++. The code is placed in its own mmap'ed pages, no compiler is needed at run time.
+/// The expression has to outlive the program.
+class NativeProgram {
+public:
+   /// returns nullptr if the expression contains anything but ints, floats and bools, assignments or functions which are not pure, or if
+   /// this is not an x86-64 machine; use the closures or the tree in this case
+   static std::unique_ptr<NativeProgram> compile(const Expression& expression, Environment& environment);
+   ~NativeProgram();
+
+   /// the generated code, the variables passed to it need the static types
+   NativeFunction getFunction() const {return function;}
+   const std::vector<std::string>& getVariables() const {return variables;}
+   harriet::VariableType getVariableType(uint32_t index) const {return variableTypes[index];}
+   harriet::VariableType getResultType() const {return resultType;}
+
+   /// false if a variable does not have the type it had while compiling, nothing is evaluated in this case
+   bool execute(Environment& environment, Scalar& result) const;
+
+private:
+   NativeProgram();
+
+   NativeFunction function;
+   void* code;
+   uint64_t codeSize;
+   std::vector<std::string> variables;
+   std::vector<harriet::VariableType> variableTypes;
+   std::vector<const Variable*> bindings; // to read the variables from an environment
+   std::vector<std::unique_ptr<NativeCall>> calls; // addresses are embedded in the code
+   harriet::VariableType resultType;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,204 @@
+#ifndef SCRIPTLANGUAGE_OPERATIONS_HPP_
+#define SCRIPTLANGUAGE_OPERATIONS_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "vector3.hpp"
+#include <cmath>
+#include <stdint.h>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+/// Typed versions of the Value::compute* methods for all non string types. Each operation is an overload set, a missing overload means the
+/// operator does not accept this combination of types. The catch all template is deleted so that no implicit conversion (bool->int) sneaks in.
+/// The results are exactly the ones of the corresponding compute method in Expression.cpp (including its oddities), keep them in sync.
+//---------------------------------------------------------------------------
+/// maps the c++ types used by the operations back to the script types
+template<class T> struct StaticType;
+template<> struct StaticType<int32_t> {static const harriet::VariableType value = harriet::VariableType::TInteger;};
+template<> struct StaticType<float> {static const harriet::VariableType value = harriet::VariableType::TFloat;};
+template<> struct StaticType<bool> {static const harriet::VariableType value = harriet::VariableType::TBool;};
+template<> struct StaticType<Vector3<float>> {static const harriet::VariableType value = harriet::VariableType::TVector;};
+//---------------------------------------------------------------------------
+struct AddOperation {
+   static const char* sign() {return "+";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return l + r;}
+   static float apply(int32_t l, float r) {return l + r;}
+   static Vector3<float> apply(int32_t l, const Vector3<float>& r) {return Vector3<float>(r.x).add(l);}
+   static float apply(float l, int32_t r) {return l + r;}
+   static float apply(float l, float r) {return l + r;}
+   static Vector3<float> apply(float l, const Vector3<float>& r) {return Vector3<float>(r.x).add(l);}
+   static Vector3<float> apply(const Vector3<float>& l, int32_t r) {return Vector3<float>(l).add(r);}
+   static Vector3<float> apply(const Vector3<float>& l, float r) {return Vector3<float>(l).add(r);}
+   static Vector3<float> apply(const Vector3<float>& l, const Vector3<float>& r) {return l + r;}
+};
+//---------------------------------------------------------------------------
+struct SubOperation {
+   static const char* sign() {return "-";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return l - r;}
+   static float apply(int32_t l, float r) {return l - r;}
+   static Vector3<float> apply(int32_t l, const Vector3<float>& r) {return Vector3<float>(r.x).sub(l);}
+   static float apply(float l, int32_t r) {return l - r;}
+   static float apply(float l, float r) {return l - r;}
+   static Vector3<float> apply(float l, const Vector3<float>& r) {return Vector3<float>(r.x).sub(l);}
+   static Vector3<float> apply(const Vector3<float>& l, int32_t r) {return Vector3<float>(l).sub(r);}
+   static Vector3<float> apply(const Vector3<float>& l, float r) {return Vector3<float>(l).sub(r);}
+   static Vector3<float> apply(const Vector3<float>& l, const Vector3<float>& r) {return l - r;}
+};
+//---------------------------------------------------------------------------
+struct MulOperation {
+   static const char* sign() {return "*";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return l * r;}
+   static float apply(int32_t l, float r) {return l * r;}
+   static Vector3<float> apply(int32_t l, const Vector3<float>& r) {return Vector3<float>(r.x).mul(l);}
+   static float apply(float l, int32_t r) {return l * r;}
+   static float apply(float l, float r) {return l * r;}
+   static Vector3<float> apply(float l, const Vector3<float>& r) {return Vector3<float>(r.x).mul(l);}
+   static Vector3<float> apply(const Vector3<float>& l, int32_t r) {return Vector3<float>(l).mul(r);}
+   static Vector3<float> apply(const Vector3<float>& l, float r) {return Vector3<float>(l).mul(r);}
+};
+//---------------------------------------------------------------------------
+struct DivOperation {
+   static const char* sign() {return "/";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return l / r;}
+   static float apply(int32_t l, float r) {return l / r;}
+   static Vector3<float> apply(int32_t l, const Vector3<float>& r) {return Vector3<float>(r.x).div(l);}
+   static float apply(float l, int32_t r) {return l / r;}
+   static float apply(float l, float r) {return l / r;}
+   static Vector3<float> apply(float l, const Vector3<float>& r) {return Vector3<float>(r.x).div(l);}
+   static Vector3<float> apply(const Vector3<float>& l, int32_t r) {return Vector3<float>(l).div(r);}
+   static Vector3<float> apply(const Vector3<float>& l, float r) {return Vector3<float>(l).div(r);}
+};
+//---------------------------------------------------------------------------
+struct ModOperation {
+   static const char* sign() {return "%";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return r==0 ? 0 : l % r;}
+   static float apply(float l, int32_t r) {return static_cast<int32_t>(l) % r;}
+};
+//---------------------------------------------------------------------------
+struct ExpOperation {
+   static const char* sign() {return "^";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return static_cast<int32_t>(std::pow(l, r));}
+   static int32_t apply(int32_t l, float r) {return static_cast<float>(std::pow(l, r));}
+   static int32_t apply(float l, int32_t r) {return static_cast<float>(std::pow(l, r));}
+   static int32_t apply(float l, float r) {return static_cast<float>(std::pow(l, r));}
+};
+//---------------------------------------------------------------------------
+struct AndOperation {
+   static const char* sign() {return "&";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return l & r;}
+   static bool apply(bool l, bool r) {return l & r;}
+};
+//---------------------------------------------------------------------------
+struct OrOperation {
+   static const char* sign() {return "|";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static int32_t apply(int32_t l, int32_t r) {return l | r;}
+   static bool apply(bool l, bool r) {return l | r;}
+};
+//---------------------------------------------------------------------------
+struct GtOperation {
+   static const char* sign() {return ">";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static bool apply(int32_t l, int32_t r) {return l > r;}
+   static bool apply(int32_t l, float r) {return l > r;}
+   static bool apply(float l, int32_t r) {return l > r;}
+   static bool apply(float l, float r) {return l > r;}
+};
+//---------------------------------------------------------------------------
+struct LtOperation {
+   static const char* sign() {return "<";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static bool apply(int32_t l, int32_t r) {return l < r;}
+   static bool apply(int32_t l, float r) {return l < r;}
+   static bool apply(float l, int32_t r) {return l < r;}
+   static bool apply(float l, float r) {return l < r;}
+};
+//---------------------------------------------------------------------------
+struct GeqOperation {
+   static const char* sign() {return ">=";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static bool apply(int32_t l, int32_t r) {return l >= r;}
+   static bool apply(int32_t l, float r) {return l >= r;}
+   static bool apply(float l, int32_t r) {return l >= r;}
+   static bool apply(float l, float r) {return l >= r;}
+};
+//---------------------------------------------------------------------------
+struct LeqOperation {
+   static const char* sign() {return "<=";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static bool apply(int32_t l, int32_t r) {return l >= r;} // sic, see IntegerValue::computeLeq
+   static bool apply(int32_t l, float r) {return l <= r;}
+   static bool apply(float l, int32_t r) {return l >= r;} // sic, see FloatValue::computeLeq
+   static bool apply(float l, float r) {return l <= r;}
+};
+//---------------------------------------------------------------------------
+struct EqOperation {
+   static const char* sign() {return "==";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static bool apply(int32_t l, int32_t r) {return l == r;}
+   static bool apply(int32_t l, float r) {return l == r;}
+   static bool apply(float l, int32_t r) {return l == r;}
+   static bool apply(float l, float r) {return l == r;}
+   static bool apply(bool l, bool r) {return l == r;}
+   static bool apply(const Vector3<float>& l, const Vector3<float>& r) {return l == r;}
+};
+//---------------------------------------------------------------------------
+struct NeqOperation {
+   static const char* sign() {return "!=";}
+   template<class L, class R> static void apply(L, R) = delete;
+   static bool apply(int32_t l, int32_t r) {return l != r;}
+   static bool apply(int32_t l, float r) {return l != r;}
+   static bool apply(float l, int32_t r) {return l != r;}
+   static bool apply(float l, float r) {return l != r;}
+   static bool apply(bool l, bool r) {return l != r;}
+   static bool apply(const Vector3<float>& l, const Vector3<float>& r) {return l != r;}
+};
+//---------------------------------------------------------------------------
+struct InvOperation {
+   static const char* sign() {return "-";}
+   template<class T> static void apply(T) = delete;
+   static int32_t apply(int32_t v) {return -v;}
+   static float apply(float v) {return -v;}
+   static Vector3<float> apply(const Vector3<float>& v) {return Vector3<float>(v).inverse();}
+};
+//---------------------------------------------------------------------------
+struct NotOperation {
+   static const char* sign() {return "!";}
+   template<class T> static void apply(T) = delete;
+   static bool apply(bool v) {return !v;}
+};
+//---------------------------------------------------------------------------
+/// casts between the non string types, see *Value::computeCast
+struct CastOperation {
+   static int32_t toInteger(int32_t v) {return v;}
+   static int32_t toInteger(float v) {return v;}
+   static int32_t toInteger(bool v) {return v;}
+   static int32_t toInteger(const Vector3<float>& v) {return v.x;}
+   static float toFloat(int32_t v) {return v;}
+   static float toFloat(float v) {return v;}
+   static float toFloat(bool v) {return v;}
+   static float toFloat(const Vector3<float>& v) {return v.x;}
+   static bool toBool(int32_t v) {return v!=0;}
+   static bool toBool(float v) {return v!=0;}
+   static bool toBool(bool v) {return v;}
+   static bool toBool(const Vector3<float>& v) {return v.x!=0;}
+   static Vector3<float> toVector(int32_t v) {return Vector3<float>(v, v, v);}
+   static Vector3<float> toVector(float v) {return Vector3<float>(v, v, v);}
+   static Vector3<float> toVector(bool v) {return Vector3<float>(v, v, v);}
+   static Vector3<float> toVector(const Vector3<float>& v) {return v;}
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,116 @@
+#include "ParallelBatchExecutor.hpp"
+#include "Environment.hpp"
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// rows per morsel, large enough to hide the synchronization and small enough to balance the load
+const uint64_t kMorselSize = 16 * 1024;
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+ParallelBatchExecutor::ParallelBatchExecutor(uint32_t threadCount)
+: generation(0)
+, running(0)
+, shutdown(false)
+, job{nullptr, nullptr, Column(static_cast<const int32_t*>(nullptr)), 0, nullptr}
+, failed(false)
+{
+   threadCount = max(1u, threadCount);
+   for(uint32_t i=0; i<threadCount; i++)
+      workers.push_back(unique_ptr<Worker>(new Worker()));
+   for(uint32_t i=1; i<threadCount; i++)
+      threads.push_back(thread(&ParallelBatchExecutor::run, this, i));
+}
+//---------------------------------------------------------------------------
+ParallelBatchExecutor::~ParallelBatchExecutor()
+{
+   {
+      lock_guard<std::mutex> lock(mutex);
+      shutdown = true;
+   }
+   wakeUp.notify_all();
+   for(auto& iter : threads)
+      iter.join();
+}
+//---------------------------------------------------------------------------
+void ParallelBatchExecutor::execute(const BatchProgram& program, const vector<Column>& columns, Column result, uint64_t rowCount, Environment& environment)
+{
+   lock_guard<std::mutex> serial(executeMutex);
+   if(threads.empty() || !program.isParallelizable() || rowCount<=kMorselSize) {
+      program.execute(columns, result, 0, rowCount, workers[0]->scratch, environment);
+      return;
+   }
+
+   // hand out the morsels, the job is published to the threads by the mutex
+   uint64_t morselCount = (rowCount + kMorselSize - 1) / kMorselSize;
+   for(uint32_t i=0; i<workers.size(); i++) {
+      workers[i]->nextMorsel = morselCount * i / workers.size();
+      workers[i]->endMorsel = morselCount * (i+1) / workers.size();
+   }
+   job = Job{&program, &columns, result, rowCount, &environment};
+   failed = false;
+   failure = nullptr;
+   {
+      lock_guard<std::mutex> lock(mutex);
+      running = threads.size();
+      generation++;
+   }
+   wakeUp.notify_all();
+
+   work(0);
+   {
+      unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [this] {return running == 0;});
+   }
+   if(failure != nullptr)
+      rethrow_exception(failure);
+}
+//---------------------------------------------------------------------------
+void ParallelBatchExecutor::run(uint32_t worker)
+{
+   uint64_t finishedGeneration = 0;
+   while(true) {
+      {
+         unique_lock<std::mutex> lock(mutex);
+         wakeUp.wait(lock, [&] {return shutdown || generation!=finishedGeneration;});
+         if(shutdown)
+            return;
+         finishedGeneration = generation;
+      }
+      work(worker);
+      {
+         lock_guard<std::mutex> lock(mutex);
+         if(--running == 0)
+            done.notify_one();
+      }
+   }
+}
+//---------------------------------------------------------------------------
+void ParallelBatchExecutor::work(uint32_t worker)
+{
+   // own morsels first, then steal from the others
+   auto& scratch = workers[worker]->scratch;
+   try {
+      for(uint32_t i=0; i<workers.size(); i++) {
+         Worker& victim = *workers[(worker+i) % workers.size()];
+         for(uint64_t morsel=victim.nextMorsel++; morsel<victim.endMorsel && !failed; morsel=victim.nextMorsel++)
+            job.program->execute(*job.columns, job.result, morsel*kMorselSize, min(job.rowCount, (morsel+1)*kMorselSize), scratch, *job.environment);
+      }
+   } catch(...) {
+      lock_guard<std::mutex> lock(mutex);
+      if(failure == nullptr)
+         failure = current_exception();
+      failed = true;
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
@@ -0,0 +1,75 @@
+#ifndef SCRIPTLANGUAGE_PARALLELBATCHEXECUTOR_HPP_
+#define SCRIPTLANGUAGE_PARALLELBATCHEXECUTOR_HPP_
+//---------------------------------------------------------------------------
+#include "BatchProgram.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+//---------------------------------------------------------------------------
+/// Evaluates a batch program with a pool of threads. The rows are cut into morsels, every worker starts on an equal share of them and steals
+/// morsels of the other workers once its own share is done. The program is only read, each worker has its own scratch.
+class ParallelBatchExecutor {
+public:
+   /// the calling thread of execute is one of the workers => threadCount-1 threads are started
+   explicit ParallelBatchExecutor(uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency()));
+   ~ParallelBatchExecutor();
+
+   /// same result as program.execute, programs which are not parallelizable run on the calling thread only
+   void execute(const BatchProgram& program, const std::vector<Column>& columns, Column result, uint64_t rowCount, Environment& environment);
+
+   uint32_t getThreadCount() const {return workers.size();}
+
+private:
+   struct Worker {
+      std::atomic<uint64_t> nextMorsel; // shared with the thieves
+      uint64_t endMorsel;
+      BatchProgram::Scratch scratch;
+   };
+
+   /// the execute call the workers are working on
+   struct Job {
+      const BatchProgram* program;
+      const std::vector<Column>* columns;
+      Column result;
+      uint64_t rowCount;
+      Environment* environment;
+   };
+
+   void run(uint32_t worker);
+   void work(uint32_t worker);
+
+   std::vector<std::unique_ptr<Worker>> workers;
+   std::vector<std::thread> threads;
+
+   std::mutex executeMutex; // one execute at a time
+   std::mutex mutex;
+   std::condition_variable wakeUp;
+   std::condition_variable done;
+   uint64_t generation; // incremented for every job
+   uint32_t running; // threads still working on the job
+   bool shutdown;
+
+   Job job;
+   std::atomic<bool> failed;
+   std::exception_ptr failure;
+
+   ParallelBatchExecutor(const ParallelBatchExecutor&) = delete;
+   ParallelBatchExecutor& operator=(const ParallelBatchExecutor&) = delete;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,295 @@
+#include "Program.hpp"
+#include "Expression.hpp"
+#include "Environment.hpp"
+#include "Function.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+#include <cassert>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// programs with a deeper stack fall back to a heap allocated stack
+const uint32_t kInlineStackSize = 32;
+//---------------------------------------------------------------------------
+const char* opcodeName(uint32_t opcode)
+{
+   static const char* names[] = {"push_constant", "load_variable", "store_variable", "add", "sub", "mul", "div", "mod", "exp", "and", "or", "gt", "lt", "geq", "leq", "eq", "neq", "inv", "not", "cast", "call", "jump_if_false", "jump_if_true", "store_shared", "load_shared"};
+   return names[opcode];
+}
+//---------------------------------------------------------------------------
+bool isShortCircuit(const BinaryOperator& binary)
+{
+   return (binary.getOperatorType()==OperatorType::TAnd || binary.getOperatorType()==OperatorType::TOr) && reinterpret_cast<const LogicOperator&>(binary).isShortCircuit();
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+Program::Program()
+: boundEnvironment(0)
+, boundLayoutVersion(0)
+, boundFunctionVersion(0)
+, stackSize(0)
+, sharedBase(0)
+{
+}
+//---------------------------------------------------------------------------
+Program::~Program()
+{
+}
+//---------------------------------------------------------------------------
+unique_ptr<Program> Program::compile(const Expression& expression, Environment& environment)
+{
+   unique_ptr<Program> program(new Program());
+   program->boundEnvironment = environment.getId();
+   program->boundLayoutVersion = environment.getLayoutVersion();
+   program->boundFunctionVersion = environment.getFunctionVersion();
+   if(!program->compileNode(expression, environment, 0))
+      return nullptr;
+   program->sharedBase = program->stackSize;
+   program->stackSize += program->compiledShared.size();
+   return program;
+}
+//---------------------------------------------------------------------------
+bool Program::compileNode(const Expression& expression, Environment& environment, uint32_t depth)
+{
+   stackSize = max(stackSize, depth+1);
+
+   switch(expression.getExpressionType()) {
+      case ExpressionType::TValue: {
+         auto& value = reinterpret_cast<const Value&>(expression);
+         if(value.getResultType() == harriet::VariableType::TString)
+            return false;
+         code.push_back(Instruction{Opcode::TPushConstant, static_cast<uint32_t>(constants.size())});
+         constants.push_back(Scalar::fromValue(value));
+         return true;
+      }
+      case ExpressionType::TVariable: {
+         auto& identifier = reinterpret_cast<const Variable&>(expression).getIdentifier();
+         if(environment.read(identifier).getResultType() == harriet::VariableType::TString)
+            return false;
+         code.push_back(Instruction{Opcode::TLoadVariable, addVariable(identifier, environment)});
+         return true;
+      }
+      case ExpressionType::TUnaryOperator: {
+         auto& unary = reinterpret_cast<const UnaryOperator&>(expression);
+         if(!compileNode(unary.getChild(), environment, depth))
+            return false;
+         switch(unary.getOperatorType()) {
+            case OperatorType::TUnaryMinus: code.push_back(Instruction{Opcode::TInv, 0}); return true;
+            case OperatorType::TNot:        code.push_back(Instruction{Opcode::TNot, 0}); return true;
+            case OperatorType::TCast: {
+               auto type = reinterpret_cast<const CastOperator&>(unary).getCastType();
+               if(type == harriet::VariableType::TString)
+                  return false;
+               code.push_back(Instruction{Opcode::TCast, static_cast<uint32_t>(type)});
+               return true;
+            }
+            default: return false;
+         }
+      }
+      case ExpressionType::TBinaryOperator: {
+         auto& binary = reinterpret_cast<const BinaryOperator&>(expression);
+
+         // assignment: evaluate rhs, store it and read the variable again (same as the tree does)
+         if(binary.getOperatorType() == OperatorType::TAssignment) {
+            if(binary.getLhs().getExpressionType() != ExpressionType::TVariable)
+               return false;
+            auto& identifier = reinterpret_cast<const Variable&>(binary.getLhs()).getIdentifier();
+            if(!compileNode(binary.getRhs(), environment, depth))
+               return false;
+            code.push_back(Instruction{Opcode::TStoreVariable, addVariable(identifier, environment)});
+            code.push_back(Instruction{Opcode::TLoadVariable, addVariable(identifier, environment)});
+            return true;
+         }
+
+         // short circuit: a deciding bool lhs stays on the stack as the result, otherwise the rhs is combined with it
+         if(isShortCircuit(binary)) {
+            if(!compileNode(binary.getLhs(), environment, depth))
+               return false;
+            uint32_t jump = code.size();
+            code.push_back(Instruction{binary.getOperatorType()==OperatorType::TAnd ? Opcode::TJumpIfFalse : Opcode::TJumpIfTrue, 0});
+            auto compiledBefore = compiledShared; // the rhs may be skipped
+            if(!compileNode(binary.getRhs(), environment, depth+1))
+               return false;
+            compiledShared = ::move(compiledBefore);
+            code.push_back(Instruction{binary.getOperatorType()==OperatorType::TAnd ? Opcode::TAnd : Opcode::TOr, 0});
+            code[jump].operand = code.size();
+            return true;
+         }
+
+         if(!compileNode(binary.getLhs(), environment, depth) || !compileNode(binary.getRhs(), environment, depth+1))
+            return false;
+         Opcode opcode;
+         switch(binary.getOperatorType()) {
+            case OperatorType::TPlus:           opcode = Opcode::TAdd; break;
+            case OperatorType::TMinus:          opcode = Opcode::TSub; break;
+            case OperatorType::TMultiplication: opcode = Opcode::TMul; break;
+            case OperatorType::TDivision:       opcode = Opcode::TDiv; break;
+            case OperatorType::TModulo:         opcode = Opcode::TMod; break;
+            case OperatorType::TExponentiation: opcode = Opcode::TExp; break;
+            case OperatorType::TAnd:            opcode = Opcode::TAnd; break;
+            case OperatorType::TOr:             opcode = Opcode::TOr;  break;
+            case OperatorType::TGreater:        opcode = Opcode::TGt;  break;
+            case OperatorType::TLess:           opcode = Opcode::TLt;  break;
+            case OperatorType::TGreaterEqual:   opcode = Opcode::TGeq; break;
+            case OperatorType::TLessEqual:      opcode = Opcode::TLeq; break;
+            case OperatorType::TEqual:          opcode = Opcode::TEq;  break;
+            case OperatorType::TNotEqual:       opcode = Opcode::TNeq; break;
+            default:                            return false;
+         }
+         code.push_back(Instruction{opcode, 0});
+         return true;
+      }
+      case ExpressionType::TFunctionOperator: {
+         auto& call = reinterpret_cast<const FunctionOperator&>(expression);
+         auto function = environment.getFunction(call.getFunctionIdentifier());
+         if(function->getResultType() == harriet::VariableType::TString)
+            return false;
+         // the argument types are checked here once, execute only checks them if the function may have been replaced
+         for(uint32_t i=0; i<call.getArguments().size(); i++) {
+            auto& argument = *call.getArguments()[i];
+            if(function->getArgumentType(i)==harriet::VariableType::TString || argument.getResultType()!=function->getArgumentType(i) || !compileNode(argument, environment, depth+i))
+               return false;
+         }
+         code.push_back(Instruction{Opcode::TCall, static_cast<uint32_t>(functions.size())});
+         functions.push_back(call.getFunctionIdentifier());
+         boundFunctions.push_back(function);
+         return true;
+      }
+      case ExpressionType::TSharedScope:
+         return compileNode(reinterpret_cast<const SharedExpressionScope&>(expression).getChild(), environment, depth);
+      case ExpressionType::TCompiled:
+         return compileNode(reinterpret_cast<const CompiledExpression&>(expression).getTree(), environment, depth);
+      case ExpressionType::TShared: {
+         // the first occurrence computes the sub tree and keeps a copy, the others load it
+         auto& shared = reinterpret_cast<const SharedExpression&>(expression);
+         if(shared.getIndex() >= compiledShared.size())
+            compiledShared.resize(shared.getIndex()+1, false);
+         if(compiledShared[shared.getIndex()]) {
+            code.push_back(Instruction{Opcode::TLoadShared, shared.getIndex()});
+            return true;
+         }
+         if(!compileNode(shared.getChild(), environment, depth))
+            return false;
+         code.push_back(Instruction{Opcode::TStoreShared, shared.getIndex()});
+         compiledShared[shared.getIndex()] = true;
+         return true;
+      }
+      default:
+         return false;
+   }
+}
+//---------------------------------------------------------------------------
+uint32_t Program::addVariable(const string& identifier, const Environment& environment)
+{
+   for(uint32_t i=0; i<variables.size(); i++)
+      if(variables[i].identifier == identifier)
+         return i;
+   VariableReference reference{identifier, VariableSlot{0, 0}};
+   if(!environment.resolve(identifier, reference.slot))
+      throw harriet::Exception{"found unkown identifier: '" + identifier + "'"};
+   variables.push_back(reference);
+   return variables.size() - 1;
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> Program::execute(Environment& environment) const
+{
+   return executeScalar(environment).toValue();
+}
+//---------------------------------------------------------------------------
+Scalar Program::executeScalar(Environment& environment) const
+{
+   // small programs run on the machine stack
+   Scalar inlineStack[kInlineStackSize];
+   vector<Scalar> heapStack;
+   Scalar* stack = inlineStack;
+   if(stackSize > kInlineStackSize) {
+      heapStack.resize(stackSize);
+      stack = heapStack.data();
+   }
+   uint32_t top = 0; // number of values on the stack
+   Scalar* shared = stack + sharedBase;
+   bool useSlots = boundEnvironment==environment.getId() && boundLayoutVersion==environment.getLayoutVersion();
+   bool useBoundFunctions = boundEnvironment==environment.getId() && boundFunctionVersion==environment.getFunctionVersion();
+
+   for(uint32_t position=0; position<code.size(); position++) {
+      auto& instruction = code[position];
+      switch(instruction.opcode) {
+         case Opcode::TPushConstant: stack[top++] = constants[instruction.operand]; break;
+         case Opcode::TLoadVariable: {
+            auto& variable = variables[instruction.operand];
+            stack[top++] = Scalar::fromValue(useSlots ? environment.read(variable.slot) : environment.read(variable.identifier));
+            break;
+         }
+         case Opcode::TStoreVariable: {
+            auto& variable = variables[instruction.operand];
+            if(useSlots)
+               environment.update(variable.slot, stack[--top].toValue()); else
+               environment.update(variable.identifier, stack[--top].toValue());
+            break;
+         }
+         case Opcode::TAdd: top--; stack[top-1] = stack[top-1].computeAdd(stack[top]); break;
+         case Opcode::TSub: top--; stack[top-1] = stack[top-1].computeSub(stack[top]); break;
+         case Opcode::TMul: top--; stack[top-1] = stack[top-1].computeMul(stack[top]); break;
+         case Opcode::TDiv: top--; stack[top-1] = stack[top-1].computeDiv(stack[top]); break;
+         case Opcode::TMod: top--; stack[top-1] = stack[top-1].computeMod(stack[top]); break;
+         case Opcode::TExp: top--; stack[top-1] = stack[top-1].computeExp(stack[top]); break;
+         case Opcode::TAnd: top--; stack[top-1] = stack[top-1].computeAnd(stack[top]); break;
+         case Opcode::TOr:  top--; stack[top-1] = stack[top-1].computeOr (stack[top]); break;
+         case Opcode::TGt:  top--; stack[top-1] = stack[top-1].computeGt (stack[top]); break;
+         case Opcode::TLt:  top--; stack[top-1] = stack[top-1].computeLt (stack[top]); break;
+         case Opcode::TGeq: top--; stack[top-1] = stack[top-1].computeGeq(stack[top]); break;
+         case Opcode::TLeq: top--; stack[top-1] = stack[top-1].computeLeq(stack[top]); break;
+         case Opcode::TEq:  top--; stack[top-1] = stack[top-1].computeEq (stack[top]); break;
+         case Opcode::TNeq: top--; stack[top-1] = stack[top-1].computeNeq(stack[top]); break;
+         case Opcode::TInv: stack[top-1] = stack[top-1].computeInv(); break;
+         case Opcode::TNot: stack[top-1] = stack[top-1].computeNot(); break;
+         case Opcode::TCast: stack[top-1] = stack[top-1].computeCast(static_cast<harriet::VariableType>(instruction.operand)); break;
+         case Opcode::TCall: {
+            auto function = useBoundFunctions ? boundFunctions[instruction.operand] : environment.getFunction(functions[instruction.operand]);
+            top -= function->getArgumentCount();
+            stack[top] = function->executeCall(stack+top, !useBoundFunctions, environment); // the arguments are already on the stack
+            top++;
+            break;
+         }
+         case Opcode::TJumpIfFalse: if(stack[top-1].type==harriet::VariableType::TBool && !stack[top-1].boolean) position = instruction.operand-1; break;
+         case Opcode::TJumpIfTrue:  if(stack[top-1].type==harriet::VariableType::TBool && stack[top-1].boolean) position = instruction.operand-1; break;
+         case Opcode::TStoreShared: shared[instruction.operand] = stack[top-1]; break;
+         case Opcode::TLoadShared:  stack[top++] = shared[instruction.operand]; break;
+      }
+   }
+
+   assert(top == 1);
+   return stack[0];
+}
+//---------------------------------------------------------------------------
+void Program::print(ostream& stream) const
+{
+   for(uint32_t i=0; i<code.size(); i++) {
+      stream << i << ": " << opcodeName(static_cast<uint32_t>(code[i].opcode));
+      switch(code[i].opcode) {
+         case Opcode::TPushConstant:  stream << " " << *constants[code[i].operand].toValue(); break;
+         case Opcode::TLoadVariable:
+         case Opcode::TStoreVariable: stream << " " << variables[code[i].operand].identifier; break;
+         case Opcode::TCast:          stream << " " << harriet::typeToName(static_cast<harriet::VariableType>(code[i].operand)); break;
+         case Opcode::TCall:          stream << " id:" << functions[code[i].operand]; break;
+         case Opcode::TJumpIfFalse:
+         case Opcode::TJumpIfTrue:
+         case Opcode::TStoreShared:
+         case Opcode::TLoadShared:    stream << " " << code[i].operand; break;
+         default:                     break;
+      }
+      stream << endl;
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
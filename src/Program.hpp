@@ -0,0 +1,82 @@
+#ifndef SCRIPTLANGUAGE_PROGRAM_HPP_
+#define SCRIPTLANGUAGE_PROGRAM_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "Environment.hpp"
+#include "Expression.hpp"
+#include "Scalar.hpp"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Environment;
+class Expression;
+class Function;
+class Value;
+//---------------------------------------------------------------------------
+/// A parsed expression lowered into a flat array of stack machine instructions. The program is compiled once and can then be executed any number
+/// of times without walking the tree and without allocating a value per operation.
+class Program {
+public:
+   /// lowers the expression, returns nullptr if the expression uses something the vm can not handle (strings), use the tree in this case
+   static std::unique_ptr<Program> compile(const Expression& expression, Environment& environment);
+   ~Program();
+
+   /// run the program
+   std::unique_ptr<Value> execute(Environment& environment) const;
+   Scalar executeScalar(Environment& environment) const;
+
+   /// dump the byte code
+   void print(std::ostream& stream) const;
+
+private:
+   enum struct Opcode : uint8_t {TPushConstant, TLoadVariable, TStoreVariable, TAdd, TSub, TMul, TDiv, TMod, TExp, TAnd, TOr, TGt, TLt, TGeq, TLeq, TEq, TNeq, TInv, TNot, TCast, TCall, TJumpIfFalse, TJumpIfTrue, TStoreShared, TLoadShared};
+
+   struct Instruction {
+      Opcode opcode;
+      uint32_t operand; // index into constants, variables, functions or shared results; the target type for casts; the target of jumps
+   };
+
+   struct VariableReference {
+      std::string identifier;
+      VariableSlot slot;
+   };
+
+   Program();
+   bool compileNode(const Expression& expression, Environment& environment, uint32_t depth);
+   uint32_t addVariable(const std::string& identifier, const Environment& environment);
+
+   std::vector<Instruction> code;
+   std::vector<Scalar> constants;
+   std::vector<VariableReference> variables;
+   uint64_t boundEnvironment; // slots and resolved functions are only used if the program runs in the environment it was compiled for
+   uint64_t boundLayoutVersion;
+   uint64_t boundFunctionVersion;
+   std::vector<uint32_t> functions;
+   std::vector<const Function*> boundFunctions; // resolved in the bound environment
+   uint32_t stackSize;
+   std::vector<bool> compiledShared; // shared sub trees computed by the code so far
+   uint32_t sharedBase; // the results of shared sub trees are kept above the stack
+};
+//---------------------------------------------------------------------------
+/// The tree of an expression together with its bytecode (see harriet::parse with Backend::TBytecode). The program handles changed variable
+/// types itself, so evaluating it always runs the bytecode.
+class BytecodeExpression : public CompiledExpression {
+public:
+   BytecodeExpression(std::unique_ptr<Expression> tree, std::unique_ptr<Program> program) : CompiledExpression(std::move(tree)), program(std::move(program)) {}
+   virtual std::unique_ptr<Value> evaluate(Environment& environment) const {return program->execute(environment);}
+   virtual Scalar evaluateScalar(Environment& environment) const {return program->executeScalar(environment);}
+protected:
+   std::unique_ptr<Program> program;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,154 @@
+#include "Scalar.hpp"
+#include "Expression.hpp"
+#include "Operations.hpp"
+#include "Utility.hpp"
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+void throwBinaryError(const char* sign, harriet::VariableType lhs, harriet::VariableType rhs)
+{
+   throw harriet::Exception{"binary operator '" + string(sign) + "' does not accept '" + harriet::typeToName(lhs) + "' and '" + harriet::typeToName(rhs) + "'"};
+}
+//---------------------------------------------------------------------------
+void throwUnaryError(const char* sign, harriet::VariableType type)
+{
+   throw harriet::Exception{"unary operator '" + string(sign) + "' does not accept '" + harriet::typeToName(type) + "'"};
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+auto applyBinary(const L& lhs, const R& rhs, harriet::VariableType /*lhsType*/, harriet::VariableType /*rhsType*/, int) -> decltype(Scalar(Operation::apply(lhs, rhs)))
+{
+   return Scalar(Operation::apply(lhs, rhs));
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L, class R>
+Scalar applyBinary(const L& /*lhs*/, const R& /*rhs*/, harriet::VariableType lhsType, harriet::VariableType rhsType, long)
+{
+   throwBinaryError(Operation::sign(), lhsType, rhsType);
+   throw;
+}
+//---------------------------------------------------------------------------
+template<class Operation, class L>
+Scalar dispatchRhs(const L& lhs, harriet::VariableType lhsType, const Scalar& rhs)
+{
+   switch(rhs.type) {
+      case harriet::VariableType::TInteger: return applyBinary<Operation>(lhs, rhs.integer, lhsType, rhs.type, 0);
+      case harriet::VariableType::TFloat:   return applyBinary<Operation>(lhs, rhs.floating, lhsType, rhs.type, 0);
+      case harriet::VariableType::TBool:    return applyBinary<Operation>(lhs, rhs.boolean, lhsType, rhs.type, 0);
+      case harriet::VariableType::TVector:  return applyBinary<Operation>(lhs, rhs.getVector(), lhsType, rhs.type, 0);
+      default:                                     throwBinaryError(Operation::sign(), lhsType, rhs.type); throw;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+Scalar dispatchBinary(const Scalar& lhs, const Scalar& rhs)
+{
+   switch(lhs.type) {
+      case harriet::VariableType::TInteger: return dispatchRhs<Operation>(lhs.integer, lhs.type, rhs);
+      case harriet::VariableType::TFloat:   return dispatchRhs<Operation>(lhs.floating, lhs.type, rhs);
+      case harriet::VariableType::TBool:    return dispatchRhs<Operation>(lhs.boolean, lhs.type, rhs);
+      case harriet::VariableType::TVector:  return dispatchRhs<Operation>(lhs.getVector(), lhs.type, rhs);
+      default:                                     throwBinaryError(Operation::sign(), lhs.type, rhs.type); throw;
+   }
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+auto applyUnary(const T& value, harriet::VariableType /*type*/, int) -> decltype(Scalar(Operation::apply(value)))
+{
+   return Scalar(Operation::apply(value));
+}
+//---------------------------------------------------------------------------
+template<class Operation, class T>
+Scalar applyUnary(const T& /*value*/, harriet::VariableType type, long)
+{
+   throwUnaryError(Operation::sign(), type);
+   throw;
+}
+//---------------------------------------------------------------------------
+template<class Operation>
+Scalar dispatchUnary(const Scalar& value)
+{
+   switch(value.type) {
+      case harriet::VariableType::TInteger: return applyUnary<Operation>(value.integer, value.type, 0);
+      case harriet::VariableType::TFloat:   return applyUnary<Operation>(value.floating, value.type, 0);
+      case harriet::VariableType::TBool:    return applyUnary<Operation>(value.boolean, value.type, 0);
+      case harriet::VariableType::TVector:  return applyUnary<Operation>(value.getVector(), value.type, 0);
+      default:                                     throwUnaryError(Operation::sign(), value.type); throw;
+   }
+}
+//---------------------------------------------------------------------------
+template<class T>
+Scalar castTo(const T& value, harriet::VariableType type)
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return Scalar(CastOperation::toInteger(value));
+      case harriet::VariableType::TFloat:   return Scalar(CastOperation::toFloat(value));
+      case harriet::VariableType::TBool:    return Scalar(CastOperation::toBool(value));
+      case harriet::VariableType::TVector:  return Scalar(CastOperation::toVector(value));
+      default:                                     throw harriet::Exception{"invalid cast target: '" + harriet::typeToName(type) + "'"};
+   }
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+Scalar Scalar::fromValue(const Value& value)
+{
+   switch(value.getResultType()) {
+      case harriet::VariableType::TInteger: return Scalar(reinterpret_cast<const IntegerValue&>(value).result);
+      case harriet::VariableType::TFloat:   return Scalar(reinterpret_cast<const FloatValue&>(value).result);
+      case harriet::VariableType::TBool:    return Scalar(reinterpret_cast<const BoolValue&>(value).result);
+      case harriet::VariableType::TVector:  return Scalar(reinterpret_cast<const VectorValue&>(value).result);
+      default:                                     throw harriet::Exception{"unable to represent a value of type '" + harriet::typeToName(value.getResultType()) + "' as scalar"};
+   }
+}
+//---------------------------------------------------------------------------
+unique_ptr<Value> Scalar::toValue() const
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return make_unique<IntegerValue>(integer);
+      case harriet::VariableType::TFloat:   return make_unique<FloatValue>(floating);
+      case harriet::VariableType::TBool:    return make_unique<BoolValue>(boolean);
+      case harriet::VariableType::TVector:  return make_unique<VectorValue>(getVector());
+      default:                                     throw harriet::Exception{"unreachable"};
+   }
+}
+//---------------------------------------------------------------------------
+Scalar Scalar::computeAdd(const Scalar& rhs) const {return dispatchBinary<AddOperation>(*this, rhs);}
+Scalar Scalar::computeSub(const Scalar& rhs) const {return dispatchBinary<SubOperation>(*this, rhs);}
+Scalar Scalar::computeMul(const Scalar& rhs) const {return dispatchBinary<MulOperation>(*this, rhs);}
+Scalar Scalar::computeDiv(const Scalar& rhs) const {return dispatchBinary<DivOperation>(*this, rhs);}
+Scalar Scalar::computeMod(const Scalar& rhs) const {return dispatchBinary<ModOperation>(*this, rhs);}
+Scalar Scalar::computeExp(const Scalar& rhs) const {return dispatchBinary<ExpOperation>(*this, rhs);}
+Scalar Scalar::computeAnd(const Scalar& rhs) const {return dispatchBinary<AndOperation>(*this, rhs);}
+Scalar Scalar::computeOr (const Scalar& rhs) const {return dispatchBinary<OrOperation> (*this, rhs);}
+Scalar Scalar::computeGt (const Scalar& rhs) const {return dispatchBinary<GtOperation> (*this, rhs);}
+Scalar Scalar::computeLt (const Scalar& rhs) const {return dispatchBinary<LtOperation> (*this, rhs);}
+Scalar Scalar::computeGeq(const Scalar& rhs) const {return dispatchBinary<GeqOperation>(*this, rhs);}
+Scalar Scalar::computeLeq(const Scalar& rhs) const {return dispatchBinary<LeqOperation>(*this, rhs);}
+Scalar Scalar::computeEq (const Scalar& rhs) const {return dispatchBinary<EqOperation> (*this, rhs);}
+Scalar Scalar::computeNeq(const Scalar& rhs) const {return dispatchBinary<NeqOperation>(*this, rhs);}
+//---------------------------------------------------------------------------
+Scalar Scalar::computeInv() const {return dispatchUnary<InvOperation>(*this);}
+Scalar Scalar::computeNot() const {return dispatchUnary<NotOperation>(*this);}
+//---------------------------------------------------------------------------
+Scalar Scalar::computeCast(harriet::VariableType resultType) const
+{
+   switch(type) {
+      case harriet::VariableType::TInteger: return castTo(integer, resultType);
+      case harriet::VariableType::TFloat:   return castTo(floating, resultType);
+      case harriet::VariableType::TBool:    return castTo(boolean, resultType);
+      case harriet::VariableType::TVector:  return castTo(getVector(), resultType);
+      default:                                     throw harriet::Exception{"unable to cast '" + harriet::typeToName(type) + "' to '" +  harriet::typeToName(resultType) + "'"};
+   }
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
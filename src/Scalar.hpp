@@ -0,0 +1,67 @@
+#ifndef SCRIPTLANGUAGE_SCALAR_HPP_
+#define SCRIPTLANGUAGE_SCALAR_HPP_
+//---------------------------------------------------------------------------
+#include "ScriptLanguage.hpp"
+#include "vector3.hpp"
+#include <memory>
+#include <stdint.h>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+class Value;
+//---------------------------------------------------------------------------
+/// By value variant of the non string types. Evaluating into a scalar neither allocates nor dispatches virtually on the operands, the Value
+/// classes stay the public representation and are converted at the boundary (fromValue / toValue).
+struct Scalar {
+   harriet::VariableType type;
+   union {
+      int32_t integer;
+      float floating;
+      bool boolean;
+      float vector[3];
+   };
+
+   /// ctor
+   Scalar() : type(harriet::VariableType::TInteger), integer(0) {}
+   explicit Scalar(int32_t value) : type(harriet::VariableType::TInteger), integer(value) {}
+   explicit Scalar(float value) : type(harriet::VariableType::TFloat), floating(value) {}
+   explicit Scalar(bool value) : type(harriet::VariableType::TBool), boolean(value) {}
+   explicit Scalar(const Vector3<float>& value) : type(harriet::VariableType::TVector) {vector[0]=value.x; vector[1]=value.y; vector[2]=value.z;}
+
+   /// access
+   Vector3<float> getVector() const {return Vector3<float>(vector[0], vector[1], vector[2]);}
+
+   /// conversion from and to the Value classes, strings can not be represented
+   static Scalar fromValue(const Value& value);
+   std::unique_ptr<Value> toValue() const;
+
+   /// same semantics as the compute methods of the Value classes
+   Scalar computeAdd(const Scalar& rhs) const;
+   Scalar computeSub(const Scalar& rhs) const;
+   Scalar computeMul(const Scalar& rhs) const;
+   Scalar computeDiv(const Scalar& rhs) const;
+   Scalar computeMod(const Scalar& rhs) const;
+   Scalar computeExp(const Scalar& rhs) const;
+   Scalar computeAnd(const Scalar& rhs) const;
+   Scalar computeOr (const Scalar& rhs) const;
+   Scalar computeGt (const Scalar& rhs) const;
+   Scalar computeLt (const Scalar& rhs) const;
+   Scalar computeGeq(const Scalar& rhs) const;
+   Scalar computeLeq(const Scalar& rhs) const;
+   Scalar computeEq (const Scalar& rhs) const;
+   Scalar computeNeq(const Scalar& rhs) const;
+
+   Scalar computeInv() const;
+   Scalar computeNot() const;
+
+   Scalar computeCast(harriet::VariableType resultType) const;
+};
+static_assert(sizeof(Scalar) <= 16, "scalar should fit into two registers");
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif
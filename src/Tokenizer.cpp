@@ -0,0 +1,254 @@
+#include "Tokenizer.hpp"
+#include "ScriptLanguage.hpp"
+#include <cassert>
+#include <cstring>
+#include <limits>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// locale independent character classes
+inline bool isDigit(char c) {return c>='0' && c<='9';}
+inline bool isAlpha(char c) {return (c>='a' && c<='z') || (c>='A' && c<='Z');}
+inline bool isSpace(char c) {return c==' ' || c=='\t' || c=='\n' || c=='\r' || c=='\v' || c=='\f';}
+//---------------------------------------------------------------------------
+/// powers of ten which are exact in a double
+const double kPowersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+const int32_t kMaxExactPowerOfTen = 22;
+//---------------------------------------------------------------------------
+/// mantissa * 10^exponent, exact for mantissa < 2^53 and |exponent| <= 22 (that is all a float literal ever needs)
+double scaleByPowerOfTen(double mantissa, int32_t exponent)
+{
+   while(exponent > kMaxExactPowerOfTen) {
+      mantissa *= kPowersOfTen[kMaxExactPowerOfTen];
+      exponent -= kMaxExactPowerOfTen;
+   }
+   while(exponent < -kMaxExactPowerOfTen) {
+      mantissa /= kPowersOfTen[kMaxExactPowerOfTen];
+      exponent += kMaxExactPowerOfTen;
+   }
+   return exponent<0 ? mantissa/kPowersOfTen[-exponent] : mantissa*kPowersOfTen[exponent];
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+Tokenizer::Tokenizer(const char* begin, const char* end)
+: begin(begin)
+, position(begin)
+, end(end)
+, hasLookahead(false)
+{
+}
+//---------------------------------------------------------------------------
+Tokenizer::Tokenizer(const string& input)
+: begin(input.data())
+, position(input.data())
+, end(input.data()+input.size())
+, hasLookahead(false)
+{
+}
+//---------------------------------------------------------------------------
+Token Tokenizer::next()
+{
+   if(hasLookahead) {
+      hasLookahead = false;
+      return lookahead;
+   }
+   return readToken();
+}
+//---------------------------------------------------------------------------
+Token Tokenizer::peek()
+{
+   if(!hasLookahead) {
+      lookahead = readToken();
+      hasLookahead = true;
+   }
+   return lookahead;
+}
+//---------------------------------------------------------------------------
+string Tokenizer::getText(const Token& token) const
+{
+   return string(begin+token.offset, token.length);
+}
+//---------------------------------------------------------------------------
+string Tokenizer::getString(const Token& token) const
+{
+   assert(token.type == TokenType::TString);
+   string result;
+   result.reserve(token.length);
+   for(const char* iter=begin+token.offset; iter!=begin+token.offset+token.length; iter++) {
+      if(*iter=='\\' && iter+1!=begin+token.offset+token.length)
+         iter++;
+      result.push_back(*iter);
+   }
+   return result;
+}
+//---------------------------------------------------------------------------
+string Tokenizer::getSource(uint32_t from, uint32_t to) const
+{
+   assert(from <= to && begin+to <= end);
+   return string(begin+from, to-from);
+}
+//---------------------------------------------------------------------------
+bool Tokenizer::textEquals(const Token& token, const string& text) const
+{
+   return token.length==text.size() && memcmp(begin+token.offset, text.data(), token.length)==0;
+}
+//---------------------------------------------------------------------------
+Token Tokenizer::readToken()
+{
+   while(position!=end && isSpace(*position))
+      position++;
+
+   Token token;
+   token.offset = position - begin;
+   token.length = 1;
+   token.integer = 0;
+   if(position == end) {
+      token.type = TokenType::TEnd;
+      token.length = 0;
+      return token;
+   }
+
+   char a = *position;
+   char b = position+1!=end ? position[1] : '\0';
+
+   // two letter operators
+   if(b == '=') {
+      token.length = 2;
+      switch(a) {
+         case '>': token.type = TokenType::TGreaterEqual; position+=2; return token;
+         case '<': token.type = TokenType::TLessEqual;    position+=2; return token;
+         case '=': token.type = TokenType::TEqual;        position+=2; return token;
+         case '!': token.type = TokenType::TNotEqual;     position+=2; return token;
+      }
+      token.length = 1;
+   }
+
+   // single letter operators
+   switch(a) {
+      case '(': token.type = TokenType::TOpeningPharentesis; position++; return token;
+      case ')': token.type = TokenType::TClosingPharentesis; position++; return token;
+      case ',': token.type = TokenType::TComma;              position++; return token;
+      case '+': token.type = TokenType::TPlus;               position++; return token;
+      case '-': token.type = TokenType::TMinus;              position++; return token;
+      case '*': token.type = TokenType::TAsterisk;           position++; return token;
+      case '/': token.type = TokenType::TSlash;              position++; return token;
+      case '%': token.type = TokenType::TPercent;            position++; return token;
+      case '^': token.type = TokenType::TCaret;              position++; return token;
+      case '&': token.type = TokenType::TAmpersand;          position++; return token;
+      case '|': token.type = TokenType::TPipe;               position++; return token;
+      case '!': token.type = TokenType::TExclamation;        position++; return token;
+      case '=': token.type = TokenType::TAssign;             position++; return token;
+      case '>': token.type = TokenType::TGreater;            position++; return token;
+      case '<': token.type = TokenType::TLess;               position++; return token;
+   }
+
+   // literals and identifiers
+   if(a == '"') {
+      readString(token);
+      return token;
+   }
+   if(isDigit(a)) {
+      readNumber(token);
+      return token;
+   }
+   if(isAlpha(a)) {
+      const char* first = position;
+      while(position!=end && (isAlpha(*position) || isDigit(*position) || *position=='_'))
+         position++;
+      token.type = TokenType::TIdentifier;
+      token.length = position - first;
+      return token;
+   }
+
+   throw harriet::Exception{"unable to parse expression, invaild sign '" + string(1, a) + "' at position " + to_string(token.offset)};
+}
+//---------------------------------------------------------------------------
+void Tokenizer::readNumber(Token& token)
+{
+   const char* first = position;
+
+   // integer part
+   uint64_t integerPart = 0;
+   while(position!=end && isDigit(*position)) {
+      if(integerPart <= static_cast<uint64_t>(numeric_limits<int32_t>::max()))
+         integerPart = integerPart*10 + (*position-'0');
+      position++;
+   }
+   if(integerPart > static_cast<uint64_t>(numeric_limits<int32_t>::max()))
+      throw harriet::Exception{"integer literal '" + string(first, position) + "' at position " + to_string(token.offset) + " is out of range"};
+
+   // no fraction => integer
+   if(position==end || *position!='.') {
+      token.type = TokenType::TInteger;
+      token.integer = integerPart;
+      token.length = position - first;
+      return;
+   }
+   position++;
+
+   // fraction: digits after the first 19 can not change a float anymore
+   uint64_t mantissa = 0;
+   int32_t exponent = 0;
+   uint32_t significantDigits = 0;
+   while(position!=end && isDigit(*position)) {
+      if(significantDigits < 19) {
+         mantissa = mantissa*10 + (*position-'0');
+         exponent--;
+         significantDigits += mantissa!=0;
+      }
+      position++;
+   }
+
+   // optional exponent
+   if(position!=end && (*position=='e' || *position=='E')) {
+      const char* exponentBegin = position++;
+      bool negative = false;
+      if(position!=end && (*position=='+' || *position=='-'))
+         negative = *position++=='-';
+      if(position==end || !isDigit(*position)) {
+         position = exponentBegin; // not an exponent, leave it for the next token
+      } else {
+         int32_t value = 0;
+         while(position!=end && isDigit(*position)) {
+            if(value < 1000)
+               value = value*10 + (*position-'0');
+            position++;
+         }
+         exponent += negative ? -value : value;
+      }
+   }
+
+   // same composition as the former stream based parser: float(fraction) + integer part
+   token.type = TokenType::TFloat;
+   token.floating = static_cast<float>(scaleByPowerOfTen(static_cast<double>(mantissa), exponent)) + static_cast<int32_t>(integerPart);
+   token.length = position - first;
+}
+//---------------------------------------------------------------------------
+void Tokenizer::readString(Token& token)
+{
+   assert(*position == '"');
+   const char* first = ++position;
+   while(position!=end && *position!='"') {
+      if(*position=='\\' && position+1!=end)
+         position++;
+      position++;
+   }
+   if(position == end)
+      throw harriet::Exception{"unterminated string expression"};
+   token.type = TokenType::TString;
+   token.offset = first - begin;
+   token.length = position - first;
+   position++;
+}
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
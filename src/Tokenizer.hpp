@@ -0,0 +1,58 @@
+#ifndef SCRIPTLANGUAGE_TOKENIZER_HPP_
+#define SCRIPTLANGUAGE_TOKENIZER_HPP_
+//---------------------------------------------------------------------------
+#include <string>
+#include <stdint.h>
+//---------------------------------------------------------------------------
+// Harriet Script Language
+// Copyright (c) 2013 Alexander van Renen (alexandervanrenen@gmail.com)
+// See the file LICENSE.txt for copying permission.
+//---------------------------------------------------------------------------
+namespace harriet {
+//---------------------------------------------------------------------------
+enum struct TokenType : uint8_t {TInteger, TFloat, TString, TIdentifier, TOpeningPharentesis, TClosingPharentesis, TComma,
+                                 TPlus, TMinus, TAsterisk, TSlash, TPercent, TCaret, TAmpersand, TPipe, TExclamation, TAssign,
+                                 TGreater, TLess, TGreaterEqual, TLessEqual, TEqual, TNotEqual, TEnd};
+//---------------------------------------------------------------------------
+struct Token {
+   TokenType type;
+   uint32_t offset; // position of the first character in the input
+   uint32_t length; // number of characters, for strings without the quotes
+   union {
+      int32_t integer;
+      float floating;
+   };
+};
+//---------------------------------------------------------------------------
+/// Splits the input into tokens. Works directly on the character range, which has to outlive the tokenizer.
+class Tokenizer {
+public:
+   /// ctor
+   Tokenizer(const char* begin, const char* end);
+   Tokenizer(const std::string& input);
+
+   /// get next token, returns TEnd at the end of the input
+   Token next();
+   Token peek();
+
+   /// access the source of a token
+   std::string getText(const Token& token) const;
+   std::string getString(const Token& token) const; // resolves escape sequences of a string token
+   std::string getSource(uint32_t from, uint32_t to) const;
+   bool textEquals(const Token& token, const std::string& text) const;
+
+private:
+   Token readToken();
+   void readNumber(Token& token);
+   void readString(Token& token);
+
+   const char* begin;
+   const char* position;
+   const char* end;
+   Token lookahead;
+   bool hasLookahead;
+};
+//---------------------------------------------------------------------------
+} // end of namespace harriet
+//---------------------------------------------------------------------------
+#endif